@@ -0,0 +1,64 @@
+#include "Allocations.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define BENCHMARK_TRACK_ALLOCATIONS 0
+#elif defined(__GLIBC__)
+#define BENCHMARK_TRACK_ALLOCATIONS 1
+#else
+#define BENCHMARK_TRACK_ALLOCATIONS 0
+#endif
+
+namespace {
+    std::atomic<std::uint64_t> allocationCount {0};
+    std::atomic<std::uint64_t> allocatedBytes {0};
+
+    void count(std::size_t size)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+#if BENCHMARK_TRACK_ALLOCATIONS
+// Определения в исполняемом файле перекрывают malloc из glibc для всего процесса, в том числе
+// для operator new из libstdc++. Сама память по-прежнему выделяется glibc.
+extern "C" {
+    void* __libc_malloc(std::size_t size);
+    void* __libc_calloc(std::size_t count, std::size_t size);
+    void* __libc_realloc(void* pointer, std::size_t size);
+
+    void* malloc(std::size_t size) noexcept
+    {
+        count(size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(std::size_t number, std::size_t size) noexcept
+    {
+        count(number * size);
+        return __libc_calloc(number, size);
+    }
+
+    void* realloc(void* pointer, std::size_t size) noexcept
+    {
+        count(size);
+        return __libc_realloc(pointer, size);
+    }
+}
+#endif
+
+namespace allocations {
+    bool tracked()
+    {
+        return BENCHMARK_TRACK_ALLOCATIONS != 0;
+    }
+
+    Counters current()
+    {
+        return {allocationCount.load(std::memory_order_relaxed), allocatedBytes.load(std::memory_order_relaxed)};
+    }
+}
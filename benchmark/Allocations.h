@@ -0,0 +1,20 @@
+#ifndef BENCHMARK_ALLOCATIONS_H
+#define BENCHMARK_ALLOCATIONS_H
+
+#include <cstdint>
+
+/// Счетчики выделений памяти всего процесса: и operator new, и malloc из C-кода (tinyexpr).
+///
+/// Считаются вызовы malloc, calloc и realloc: перехватываются они только в glibc и только без
+/// санитайзеров (у тех свой malloc). Без перехвата tracked() == false и счетчики стоят на нуле.
+namespace allocations {
+    struct Counters {
+        std::uint64_t count = 0; //!< Выделений.
+        std::uint64_t bytes = 0; //!< Запрошено байт.
+    };
+
+    bool     tracked();
+    Counters current();
+}
+
+#endif //BENCHMARK_ALLOCATIONS_H
@@ -0,0 +1,80 @@
+#include "Harness.h"
+
+#include <thread>
+#include <iomanip>
+
+Harness::Harness(std::chrono::milliseconds minTime, std::string filter)
+                 : m_minTime(minTime)
+                 , m_filter(std::move(filter))
+{
+}
+
+void Harness::printText(std::ostream& output) const
+{
+    std::size_t width = 10;
+    for (const auto& result : m_results) {
+        width = std::max(width, result.name.size() + 2);
+    }
+
+    output << std::left << std::setw(static_cast<int>(width)) << "benchmark" << std::right
+           << std::setw(14) << "iterations" << std::setw(12) << "ns/op" << std::setw(12) << "cpu ns/op"
+           << std::setw(12) << "allocs/op" << std::setw(12) << "bytes/op" << '\n';
+
+    output << std::fixed;
+    for (const auto& result : m_results) {
+        output << std::left << std::setw(static_cast<int>(width)) << result.name << std::right
+               << std::setw(14) << result.iterations
+               << std::setprecision(1) << std::setw(12) << result.realTime << std::setw(12) << result.cpuTime;
+        if (allocations::tracked()) {
+            output << std::setprecision(2) << std::setw(12) << result.allocations
+                   << std::setprecision(1) << std::setw(12) << result.allocatedBytes;
+        } else {
+            output << std::setw(12) << '-' << std::setw(12) << '-';
+        }
+        output << '\n';
+    }
+}
+
+void Harness::printJson(std::ostream& output) const
+{
+    const auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    std::tm local {};
+    localtime_r(&now, &local);
+
+#ifdef NDEBUG
+    constexpr auto buildType = "release";
+#else
+    constexpr auto buildType = "debug";
+#endif
+
+    output << std::fixed << std::setprecision(3);
+    output << "{\n"
+           << "  \"context\": {\n"
+           << "    \"date\": \"" << std::put_time(&local, "%Y-%m-%dT%H:%M:%S%z") << "\",\n"
+           << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+           << "    \"library_build_type\": \"" << buildType << "\",\n"
+           << "    \"allocations_tracked\": " << (allocations::tracked() ? "true" : "false") << "\n"
+           << "  },\n"
+           << "  \"benchmarks\": [";
+
+    bool first = true;
+    for (const auto& result : m_results) {
+        // Имена замеров составлены из латиницы, цифр и '/', экранировать в них нечего.
+        output << (first ? "\n" : ",\n") << "    {"
+               << "\"name\": \"" << result.name << "\""
+               << ", \"run_name\": \"" << result.name << "\""
+               << ", \"run_type\": \"iteration\""
+               << ", \"repetitions\": 1, \"repetition_index\": 0, \"threads\": 1"
+               << ", \"iterations\": " << result.iterations
+               << ", \"real_time\": " << result.realTime
+               << ", \"cpu_time\": " << result.cpuTime
+               << ", \"time_unit\": \"ns\"";
+        if (allocations::tracked()) {
+            output << ", \"allocations\": " << result.allocations
+                   << ", \"allocated_bytes\": " << result.allocatedBytes;
+        }
+        output << "}";
+        first = false;
+    }
+    output << "\n  ]\n}\n";
+}
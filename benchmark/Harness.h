@@ -0,0 +1,96 @@
+#ifndef BENCHMARK_HARNESS_H
+#define BENCHMARK_HARNESS_H
+
+#include <ctime>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include <algorithm>
+#include <string_view>
+
+#include "Allocations.h"
+
+/// Не дает компилятору выбросить вычисление value как неиспользуемое.
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/// Простейший аналог Google Benchmark: замер идет, пока один прогон не займет minTime,
+/// число итераций подбирается по предыдущему прогону. На итерацию считаются время по часам
+/// и по процессору и выделения памяти (см. Allocations.h).
+class Harness {
+
+public:
+    struct Result {
+        std::string   name;
+        std::uint64_t iterations;
+        double        realTime;       //!< Нс на итерацию.
+        double        cpuTime;        //!< Нс процессорного времени на итерацию.
+        double        allocations;    //!< Выделений памяти на итерацию.
+        double        allocatedBytes; //!< Байт на итерацию.
+    };
+
+    /// filter - подстрока имени: замеряются только подходящие (пустой - все).
+    explicit Harness(std::chrono::milliseconds minTime, std::string filter);
+
+    Harness(const Harness& other) = delete;
+    Harness& operator=(const Harness& other) = delete;
+
+    /// Замеряет body - одну итерацию.
+    template <typename Body>
+    void run(std::string_view name, Body&& body)
+    {
+        if (!m_filter.empty() && name.find(m_filter) == std::string_view::npos) return;
+
+        // Прогрев: кэши, ленивые выделения и первое заполнение буферов в замер не попадают.
+        body();
+
+        std::uint64_t iterations = 1;
+        while (true) {
+            const auto allocationsBefore = allocations::current();
+            const auto cpuBefore         = std::clock();
+            const auto realBefore        = std::chrono::steady_clock::now();
+            for (std::uint64_t i = 0; i < iterations; ++i) {
+                body();
+            }
+            const auto realTime         = std::chrono::steady_clock::now() - realBefore;
+            const auto cpuTime          = std::clock() - cpuBefore;
+            const auto allocationsAfter = allocations::current();
+
+            if (realTime >= m_minTime || iterations >= maxIterations) {
+                const auto perIteration = [iterations](double total) { return total / static_cast<double>(iterations); };
+                m_results.push_back({std::string(name), iterations,
+                                     perIteration(std::chrono::duration<double, std::nano>(realTime).count()),
+                                     perIteration(static_cast<double>(cpuTime) * 1e9 / CLOCKS_PER_SEC),
+                                     perIteration(static_cast<double>(allocationsAfter.count - allocationsBefore.count)),
+                                     perIteration(static_cast<double>(allocationsAfter.bytes - allocationsBefore.bytes))});
+                return;
+            }
+
+            // Как Google Benchmark: целимся в minTime с запасом, но растем не больше чем в 10 раз.
+            const auto elapsed = std::chrono::duration<double>(realTime).count();
+            const auto goal    = std::chrono::duration<double>(m_minTime).count();
+            const auto factor  = elapsed > 0 ? std::min(10.0, goal * 1.4 / elapsed) : 10.0;
+            iterations = std::max(iterations + 1, static_cast<std::uint64_t>(static_cast<double>(iterations) * factor));
+        }
+    }
+
+    const std::vector<Result>& results() const { return m_results; }
+
+    void printText(std::ostream& output) const;
+    /// Отчет в формате JSON Google Benchmark: его можно сравнивать tools/compare.py.
+    void printJson(std::ostream& output) const;
+
+private:
+    static constexpr std::uint64_t maxIterations = 1'000'000'000;
+
+    const std::chrono::milliseconds m_minTime;
+    const std::string               m_filter;
+    std::vector<Result>             m_results;
+};
+
+#endif //BENCHMARK_HARNESS_H
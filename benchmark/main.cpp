@@ -0,0 +1,204 @@
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <string_view>
+
+#include <tinyexpr.h>
+
+#include "Harness.h"
+#include "Calculator.h"
+#include "Program.h"
+#include "Connection.h"
+#include "config.h"
+
+/// Микробенчмарки горячих путей сервера, которым не нужны ни сеть, ни база: разбор текстовой
+/// команды, ее диспетчеризация до калькулятора и вычисление выражений.
+/// Пример: calc_microbench --json > before.json
+///
+/// Замеряются те же функции, что работают в сервере (isValidRequest, shift и commandLength из
+/// Connection.h, Calculator, Program и tinyexpr), а не их копии.
+
+static void printUsage()
+{
+    std::cerr <<
+        "Использование: calc_microbench [--параметр=значение ...]\n"
+        "  --filter=STRING                  только замеры, в имени которых есть STRING\n"
+        "  --min-time=500                   наименьшая длительность одного замера, мс\n"
+        "  --json                           отчет в JSON (формат Google Benchmark)\n";
+}
+
+/// Наборы выражений: короткая арифметика, глубокие скобки, вызовы функций.
+struct Corpus {
+    std::string_view         name;
+    std::vector<std::string> expressions;
+};
+
+static std::vector<Corpus> makeCorpora()
+{
+    return {
+        {"small",     {"1+2", "2*3-4", "7/2", "10%3", "-5+8", "2^10", "9-3*2", "1.5*4"}},
+        {"nested",    {"((1+2)*(3+4))/((5-6)*(7+8))", "(((((1+2)*3)-4)/5)^2)",
+                       "1+(2*(3+(4*(5+(6*(7+(8*9)))))))", "((((((((1))))))))+(((2)))*(((3)))",
+                       "(1-(2-(3-(4-(5-(6-(7-8)))))))*((9+1)/(2+3))"}},
+        {"functions", {"sin(0.5)*cos(0.5)+tan(0.25)", "sqrt(16)+ln(10)/log(100)+exp(1)",
+                       "atan2(1,2)+pow(2,10)+abs(-7)", "fac(5)+acos(0.5)*pi", "sqrt(sin(1)^2+cos(1)^2)*e"}},
+    };
+}
+
+static bool parseOptions(int argc, char** argv, std::chrono::milliseconds& minTime, std::string& filter, bool& json)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view argument(argv[i]);
+        if (argument.substr(0, 2) != "--") return false;
+
+        const auto equals = argument.find('=');
+        const auto name   = argument.substr(2, equals == std::string_view::npos ? std::string_view::npos : equals - 2);
+        const std::string value(equals == std::string_view::npos ? std::string_view() : argument.substr(equals + 1));
+
+        if      (name == "filter")   filter  = value;
+        else if (name == "min-time") minTime = std::chrono::milliseconds(std::stol(value));
+        else if (name == "json")     json    = true;
+        else return false;
+    }
+
+    return true;
+}
+
+/// Разбор команды: isValidRequest проходит по всем символам команды ради подсчета пробелов,
+/// поэтому длинное выражение стоит заметно дороже короткого.
+static void benchmarkParsing(Harness& harness)
+{
+    std::string longExpression = "calc 1";
+    while (longExpression.size() < 256) {
+        longExpression.append("+1");
+    }
+    const std::vector<std::pair<std::string_view, std::pair<Connection::State, std::string>>> requests {
+            {"login",      {Connection::State::login, "login user0001"}},
+            {"password",   {Connection::State::password, "password secret"}},
+            {"calc_short", {Connection::State::calc, "calc 1+2"}},
+            {"calc_long",  {Connection::State::calc, longExpression}},
+            {"calcbatch",  {Connection::State::calc, "calcbatch 1+2;sin(0.5);2^10;sqrt(16);7/2;10%3;-5+8;pi"}},
+            {"history",    {Connection::State::calc, "history 20 1700000000000000:42"}},
+            {"invalid",    {Connection::State::calc, "calculate 1+2"}},
+    };
+
+    for (const auto& [name, request] : requests) {
+        const auto& [initialState, text] = request;
+        harness.run("isValidRequest/" + std::string(name), [&, state = initialState]() mutable {
+            state = initialState;
+            doNotOptimize(isValidRequest(state, text));
+            doNotOptimize(state);
+        });
+    }
+
+    const std::string calc = "calc sin(0.5)*cos(0.5)";
+    harness.run("shift/calc", [&]() {
+        doNotOptimize(shift(calc, commandLength(Connection::State::calc)));
+    });
+}
+
+/// Путь команды calc в Connection::handleRequest и execute до обращения к хранилищу: проверка,
+/// отрезание названия, копия выражения в User и калькулятор. В сервере промах кэша считается
+/// в пуле потоков; здесь - в том же потоке, чтобы замерить само вычисление.
+static void benchmarkDispatch(Harness& harness, const std::vector<Corpus>& corpora)
+{
+    Calculator hits(config::calc::cacheCapacity, config::calc::cacheShards, config::calc::maxBatchSize,
+                    config::calc::maxExpressionLength, config::calc::maxNestingDepth);
+    // Кэш на одну запись: выражения набора идут по кругу и каждый раз вытесняют друг друга.
+    Calculator misses(1, 1, config::calc::maxBatchSize, config::calc::maxExpressionLength,
+                      config::calc::maxNestingDepth);
+
+    for (const auto& corpus : corpora) {
+        std::vector<std::string> requests;
+        for (const auto& expression : corpus.expressions) {
+            requests.push_back("calc " + expression);
+        }
+
+        for (auto* calculator : {&hits, &misses}) {
+            const auto name = std::string(calculator == &hits ? "dispatch/calc_cached/" : "dispatch/calc_uncached/")
+                            + std::string(corpus.name);
+            std::size_t next = 0;
+            std::string expression; // Как User::expression: память переиспользуется между командами.
+            harness.run(name, [&]() {
+                const auto& request = requests[next++ % requests.size()];
+                auto state = Connection::State::calc;
+                if (!isValidRequest(state, request)) std::abort();
+
+                expression = shift(request, commandLength(state));
+                Calculator::CacheKey key;
+                auto evaluated = calculator->cached(expression, key);
+                if (!evaluated) {
+                    evaluated = calculator->evaluateUncached(expression, key);
+                }
+                doNotOptimize(evaluated->result);
+            });
+        }
+    }
+}
+
+/// Вычисление выражения: te_interp (им Calculator считает промахи кэша) и разбор с компиляцией
+/// в Program (так calcbatch готовит формулу с переменными). Готовую программу отдельно не
+/// замеряем: выражения без переменных Program сворачивает в одну константу.
+static void benchmarkEvaluation(Harness& harness, const std::vector<Corpus>& corpora)
+{
+    for (const auto& corpus : corpora) {
+        const auto& expressions = corpus.expressions;
+        const auto  suffix      = "/" + std::string(corpus.name);
+
+        std::size_t next = 0;
+        harness.run("te_interp" + suffix, [&]() {
+            int error = 0;
+            doNotOptimize(te_interp(expressions[next++ % expressions.size()].c_str(), &error));
+        });
+
+        next = 0;
+        harness.run("program/compile_run" + suffix, [&]() {
+            int error = 0;
+            auto* root = te_compile(expressions[next++ % expressions.size()].c_str(), nullptr, 0, &error);
+            Program program;
+            doNotOptimize(program.compile(root) ? program.run() : te_eval(root));
+            te_free(root);
+        });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::chrono::milliseconds minTime {500};
+    std::string filter;
+    bool json = false;
+    try {
+        if (!parseOptions(argc, argv, minTime, filter, json)) {
+            printUsage();
+            return 1;
+        }
+    } catch (const std::exception&) {
+        printUsage();
+        return 1;
+    }
+
+#ifndef NDEBUG
+    // Калькулятор в отладочной сборке сверяет каждую программу с te_eval - цифры будут завышены.
+    std::cerr << "Внимание: сборка без NDEBUG, замеры не показательны" << std::endl;
+#endif
+    if (!allocations::tracked()) {
+        std::cerr << "Выделения памяти не считаются (нужна glibc и сборка без санитайзеров)" << std::endl;
+    }
+
+    const auto corpora = makeCorpora();
+    Harness harness(minTime, filter);
+    benchmarkParsing(harness);
+    benchmarkDispatch(harness, corpora);
+    benchmarkEvaluation(harness, corpora);
+
+    if (json) {
+        harness.printJson(std::cout);
+    } else {
+        harness.printText(std::cout);
+    }
+
+    return 0;
+}
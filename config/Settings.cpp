@@ -0,0 +1,104 @@
+#include "Settings.h"
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+
+namespace config {
+    /// Значение key или defaultValue, если ключа нет. Неверное значение - исключение
+    /// (ptree::get с умолчанием молча вернул бы умолчание).
+    template <typename T>
+    static T get(const boost::property_tree::ptree& tree, const std::string& key, const T& defaultValue)
+    {
+        if (!tree.get_child_optional(key)) {
+            return defaultValue;
+        }
+
+        try {
+            return tree.get<T>(key);
+        } catch (const boost::property_tree::ptree_bad_data&) {
+            throw std::runtime_error("Некорректное значение " + key + " в файле настроек");
+        }
+    }
+
+    static std::chrono::milliseconds getMilliseconds(const boost::property_tree::ptree& tree,
+                                                     const std::string& key,
+                                                     std::chrono::milliseconds defaultValue)
+    {
+        return std::chrono::milliseconds(get<std::int64_t>(tree, key, defaultValue.count()));
+    }
+
+    static log::Level getLevel(const boost::property_tree::ptree& tree, const std::string& key, log::Level defaultValue)
+    {
+        const auto name = get<std::string>(tree, key, "");
+        if (name.empty())      return defaultValue;
+        if (name == "debug")   return log::Level::debug;
+        if (name == "info")    return log::Level::info;
+        if (name == "warning") return log::Level::warning;
+        if (name == "error")   return log::Level::error;
+
+        throw std::runtime_error("Некорректное значение " + key + " в файле настроек");
+    }
+
+    Settings Settings::load(const std::string& path, bool mustExist)
+    {
+        Settings settings;
+
+        std::ifstream file(path);
+        if (!file) {
+            if (mustExist) {
+                throw std::runtime_error("Не удалось открыть файл настроек " + path);
+            }
+            return settings;
+        }
+
+        // Ошибки разбора (и неверные значения) ptree сообщает исключениями с номером строки.
+        boost::property_tree::ptree tree;
+        boost::property_tree::read_ini(file, tree);
+
+        settings.net.address = get(tree, "net.address", settings.net.address);
+        settings.net.port    = get(tree, "net.port", settings.net.port);
+        settings.net.threads = get(tree, "net.threads", settings.net.threads);
+        settings.net.handshakeTimeout = getMilliseconds(tree, "net.handshake_timeout_ms", settings.net.handshakeTimeout);
+        settings.net.idleTimeout      = getMilliseconds(tree, "net.idle_timeout_ms", settings.net.idleTimeout);
+        settings.net.writeTimeout     = getMilliseconds(tree, "net.write_timeout_ms", settings.net.writeTimeout);
+        settings.net.maxSessionsPerUser = get(tree, "net.max_sessions_per_user", settings.net.maxSessionsPerUser);
+
+        auto& db = settings.db;
+        db.constring     = get(tree, "db.constring", db.constring);
+        db.poolCapacity  = get(tree, "db.pool_capacity", db.poolCapacity);
+        db.queueCapacity = get(tree, "db.queue_capacity", db.queueCapacity);
+        db.poolMinSize   = get(tree, "db.pool_min_size", db.poolMinSize);
+        db.idleTimeout   = getMilliseconds(tree, "db.idle_timeout_ms", db.idleTimeout);
+        db.lifespan      = getMilliseconds(tree, "db.lifespan_ms", db.lifespan);
+        db.authTimeout   = getMilliseconds(tree, "db.auth_timeout_ms", db.authTimeout);
+        db.queryTimeout  = getMilliseconds(tree, "db.query_timeout_ms", db.queryTimeout);
+        db.batchTimeout  = getMilliseconds(tree, "db.batch_timeout_ms", db.batchTimeout);
+
+        auto& admission = settings.admission;
+        admission.maxInFlight  = get(tree, "admission.max_in_flight", admission.maxInFlight);
+        admission.maxQueued    = get(tree, "admission.max_queued", admission.maxQueued);
+        admission.queueTimeout = getMilliseconds(tree, "admission.queue_timeout_ms", admission.queueTimeout);
+
+        settings.log.level = getLevel(tree, "log.level", settings.log.level);
+        settings.log.file  = get(tree, "log.file", settings.log.file);
+
+        settings.trace.file = get(tree, "trace.file", settings.trace.file);
+
+        const auto& net = settings.net;
+        if (net.handshakeTimeout.count() < 0 || net.idleTimeout.count() < 0 || net.writeTimeout.count() < 0) {
+            throw std::runtime_error("Сроки соединения в [net] не могут быть отрицательными");
+        }
+        if (db.poolCapacity == 0) {
+            throw std::runtime_error("db.pool_capacity должен быть больше нуля");
+        }
+        if (db.poolMinSize > db.poolCapacity) {
+            throw std::runtime_error("db.pool_min_size не может быть больше db.pool_capacity");
+        }
+
+        return settings;
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef SERVERCALCAPPLICATION_SETTINGS_H
+#define SERVERCALCAPPLICATION_SETTINGS_H
+
+#include <chrono>
+#include <string>
+#include <cstddef>
+
+#include "config.h"
+
+namespace config {
+    /// Настройки, которые можно менять без пересборки: читаются при запуске из ini-файла.
+    /// Значения по умолчанию - из config.h, в файле достаточно указать только то, что меняется.
+    ///
+    ///     [net]
+    ///     address = 0.0.0.0
+    ///     port = 1234
+    ///     threads = 8
+    ///     handshake_timeout_ms = 30000
+    ///     idle_timeout_ms = 300000
+    ///     write_timeout_ms = 30000
+    ///     max_sessions_per_user = 4
+    ///
+    ///     [db]
+    ///     constring = user=postgres host=db password=postgres dbname=CalcDatabase
+    ///     pool_capacity = 32
+    ///     queue_capacity = 256
+    ///     pool_min_size = 8
+    ///     idle_timeout_ms = 60000
+    ///     lifespan_ms = 3600000
+    ///     auth_timeout_ms = 5000
+    ///     query_timeout_ms = 2000
+    ///     batch_timeout_ms = 5000
+    ///
+    ///     [admission]
+    ///     max_in_flight = 256
+    ///     max_queued = 1024
+    ///     queue_timeout_ms = 50
+    ///
+    ///     [log]
+    ///     level = warning
+    ///     file = /var/log/calc/server.log
+    ///
+    ///     [trace]
+    ///     file = /var/tmp/calc.trace
+    struct Settings {
+        struct Net {
+            std::string    address = net::address;
+            unsigned short port    = net::port;
+            unsigned int   threads = net::threads;
+
+            /// Сроки соединения (0 - без ограничения).
+            std::chrono::milliseconds handshakeTimeout = net::timeouts::handshake;
+            std::chrono::milliseconds idleTimeout      = net::timeouts::idle;
+            std::chrono::milliseconds writeTimeout     = net::timeouts::write;
+
+            std::size_t maxSessionsPerUser = net::maxSessionsPerUser; //!< 0 - без ограничения.
+        };
+
+        struct Database {
+            std::string constring = db::constring;
+
+            /// Пул соединений ozo.
+            std::size_t               poolCapacity  = db::pool::capacity;
+            std::size_t               queueCapacity = db::pool::queueCapacity;
+            std::size_t               poolMinSize   = db::pool::minSize; //!< Прогрев пула при запуске.
+            std::chrono::milliseconds idleTimeout   = db::pool::idleTimeout;
+            std::chrono::milliseconds lifespan      = db::pool::lifespan;
+
+            /// Сроки запросов (вместе с ожиданием соединения из пула).
+            std::chrono::milliseconds authTimeout  = db::timeouts::auth;
+            std::chrono::milliseconds queryTimeout = db::timeouts::query; //!< Списание.
+            std::chrono::milliseconds batchTimeout = db::timeouts::batch; //!< Пакеты и фоновые записи.
+        };
+
+        struct Admission {
+            std::size_t               maxInFlight  = admission::maxInFlight;
+            std::size_t               maxQueued    = admission::maxQueued;
+            std::chrono::milliseconds queueTimeout = admission::queueTimeout;
+        };
+
+        struct Log {
+            log::Level  level = log::level; //!< debug, info, warning или error.
+            std::string file  = log::file;  //!< Пустой - стандартный вывод.
+        };
+
+        struct Trace {
+            std::string file = trace::file; //!< Пустой - трасса не пишется.
+        };
+
+        Net       net;
+        Database  db;
+        Admission admission;
+        Log       log;
+        Trace     trace;
+
+        /// Читает настройки из файла. Бросает исключение, если файл есть, но его не удалось разобрать.
+        /// Отсутствующий файл - не ошибка, если mustExist == false: остаются значения по умолчанию.
+        static Settings load(const std::string& path, bool mustExist);
+    };
+}
+
+#endif //SERVERCALCAPPLICATION_SETTINGS_H
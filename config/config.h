@@ -1,14 +1,157 @@
 #ifndef SERVERCALCAPPLICATION_CONFIG_H
 #define SERVERCALCAPPLICATION_CONFIG_H
 
+#include <chrono>
+#include <cstddef>
+
 namespace config {
     namespace net {
         constexpr auto address        = "127.0.0.1";
         constexpr unsigned short port = 1234;
+        /// Количество потоков (шардов) сервера. Каждый поток крутит свой io_context со своим
+        /// акцептором на общем порту (SO_REUSEPORT). 0 - по количеству ядер.
+        constexpr unsigned int threads = 0;
+        /// По сколько соединений за раз выделять память в пуле соединений шарда.
+        constexpr std::size_t connectionsPerChunk = 1024;
+        /// Сколько сессий может одновременно держать один пользователь. 0 - без ограничения.
+        constexpr std::size_t maxSessionsPerUser = 0;
+
+        /// Сроки соединения, по истечении которых сервер его закрывает. 0 - без ограничения.
+        namespace timeouts {
+            /// От подключения (или logout) до успешного входа. Неудачный пароль срок не продлевает.
+            constexpr std::chrono::milliseconds handshake {30 * 1000};
+            /// Ожидание следующей команды (или конца начатой).
+            constexpr std::chrono::milliseconds idle      {5 * 60 * 1000};
+            /// Отправка ответа клиенту, который его не читает.
+            constexpr std::chrono::milliseconds write     {30 * 1000};
+        }
+
+        /// Колесо таймеров шарда, на котором стоят сроки соединений: шаг стрелки (точность
+        /// сроков) и число корзин. Сроки длиннее оборота (tick * slots) ждут несколько оборотов.
+        namespace timingWheel {
+            constexpr std::chrono::milliseconds tick {100};
+            constexpr std::size_t               slots = 1024;
+        }
+    }
+
+    /// Ограничение числа одновременных операций с хранилищем (AdmissionController).
+    namespace admission {
+        /// Сколько команд password/calc может одновременно ждать хранилище. 0 - без ограничения.
+        constexpr std::size_t maxInFlight = 256;
+        /// Сколько команд сверх этого может ждать своей очереди, прежде чем получить отказ.
+        constexpr std::size_t maxQueued   = 1024;
+        /// Сколько команда может ждать в очереди.
+        constexpr std::chrono::milliseconds queueTimeout {50};
+    }
+
+    /// Файл настроек по умолчанию (см. Settings).
+    constexpr auto settingsFile = "server.ini";
+
+    /// Журнал сообщений сервера (Logger).
+    namespace log {
+        enum class Level { debug = 0, info, warning, error };
+
+        constexpr auto        level        = Level::info;
+        constexpr auto        file         = "";   //!< Пустой путь - стандартный вывод.
+        constexpr std::size_t ringCapacity = 1024; //!< Сообщений в буфере каждого потока.
+        constexpr std::size_t maxPerSecond = 100;  //!< Сообщений в секунду от потока, 0 - без ограничения.
+        /// Как часто фоновый поток переписывает буферы в файл.
+        constexpr std::chrono::milliseconds flushInterval {50};
+        /// Одинаковые сообщения в пределах окна пишутся один раз, дальше только считаются.
+        constexpr std::chrono::milliseconds dedupWindow {1000};
+    }
+
+    /// Запись трассы клиентского трафика для calc_replay (TraceWriter).
+    namespace trace {
+        constexpr auto        file        = "";           //!< Пустой путь - запись выключена.
+        constexpr std::size_t flushSize   = 1 << 20;      //!< Сколько накопить, чтобы писать сразу.
+        constexpr std::size_t maxBuffered = 64 << 20;     //!< Дальше записи отбрасываются.
+        constexpr std::chrono::milliseconds flushInterval {100};
+    }
+
+    /// Метрики в формате Prometheus (GET /metrics). Порт лучше не открывать наружу.
+    namespace metrics {
+        constexpr bool           enabled = true;
+        constexpr auto           address = "127.0.0.1";
+        constexpr unsigned short port    = 9100;
+        /// Срок на весь обмен с клиентом: чтение запроса и отправку ответа.
+        constexpr std::chrono::milliseconds requestTimeout {5 * 1000};
+    }
+
+    namespace calc {
+        /// Сколько результатов выражений держать в кэше и на сколько шардов его делить.
+        constexpr std::size_t cacheCapacity = 65536;
+        constexpr std::size_t cacheShards   = 16;
+        /// Максимальное число выражений в одной команде calcbatch.
+        constexpr std::size_t maxBatchSize  = 4096;
+        /// Ограничения одного выражения: длина и глубина вложенности скобок.
+        constexpr std::size_t maxExpressionLength = 1024;
+        constexpr std::size_t maxNestingDepth     = 64;
+        /// Потоки пула, в котором считаются выражения. 0 - по количеству ядер.
+        constexpr std::size_t computeThreads = 0;
+    }
+
+    /// Команда history: размер страницы по умолчанию и наибольший.
+    namespace history {
+        constexpr std::size_t pageSize    = 20;
+        constexpr std::size_t maxPageSize = 100;
     }
 
     namespace db {
         constexpr auto constring = "user=postgres host=localhost password=postgres dbname=CalcDatabase";
+
+        /// Пул соединений с базой.
+        namespace pool {
+            constexpr std::size_t capacity      = 32;  //!< Максимум открытых соединений.
+            constexpr std::size_t queueCapacity = 256; //!< Максимум ждущих соединения запросов.
+            constexpr std::size_t minSize       = 8;   //!< Сколько соединений открыть до приема клиентов.
+            constexpr std::chrono::milliseconds idleTimeout {60 * 1000};
+            constexpr std::chrono::milliseconds lifespan    {60 * 60 * 1000};
+        }
+
+        /// Сроки запросов к базе, включая ожидание соединения из пула.
+        namespace timeouts {
+            constexpr std::chrono::milliseconds auth  {5000};
+            constexpr std::chrono::milliseconds query {2000}; //!< Списание.
+            constexpr std::chrono::milliseconds batch {5000}; //!< Пакеты и фоновые записи.
+        }
+
+        /// Журнал сессий с отложенной записью.
+        namespace journal {
+            constexpr bool        enabled   = true;
+            constexpr std::size_t capacity  = 65536; //!< Максимум строк в памяти.
+            constexpr std::size_t batchSize = 512;   //!< Максимум строк в одном запросе.
+            constexpr std::chrono::milliseconds flushInterval {100};
+        }
+
+        /// Кэш пользователей и их балансов в памяти.
+        namespace users {
+            constexpr bool        enabled  = true;
+            constexpr std::size_t capacity = 100000; //!< Максимум пользователей в кэше.
+            /// Как часто писать списания в базу и перечитывать балансы (и, значит, как долго
+            /// кэш может не знать об изменениях, сделанных в базе в обход сервера).
+            constexpr std::chrono::milliseconds syncInterval {1000};
+            constexpr std::chrono::seconds      idleTimeout  {300};
+        }
+    }
+
+    /// Где хранить пользователей и журнал сессий.
+    namespace storage {
+        enum class Backend { postgresql, embedded };
+
+        constexpr auto backend = Backend::postgresql;
+
+        /// Хранилище без базы данных (EmbeddedStorage).
+        namespace embedded {
+            constexpr auto        usersFile   = "users.txt";        //!< Пользователи и начальные балансы.
+            constexpr auto        sessionLog  = "sessions.log";     //!< Файл журнала сессий.
+            constexpr std::size_t maxLogSize  = 64ull << 30;        //!< Предельный размер журнала.
+            constexpr std::size_t logGrowStep = 64ull << 20;        //!< На сколько файл растет за раз.
+            /// Как часто сбрасывать журнал на диск, если ответа никто не ждет.
+            constexpr std::chrono::milliseconds syncInterval {2};
+            /// Отвечать клиенту только после того, как запись журнала оказалась на диске.
+            constexpr bool waitForSync = true;
+        }
     }
 }
 
@@ -0,0 +1,169 @@
+#include "Client.h"
+
+#include <cctype>
+
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+void Stats::merge(const Stats& other)
+{
+    for (std::size_t i = 0; i < operationCount; ++i) {
+        latency[i].merge(other.latency[i]);
+        errors[i] += other.errors[i];
+    }
+    sessions      += other.sessions;
+    connectErrors += other.connectErrors;
+    disconnects   += other.disconnects;
+}
+
+Client::Client(boost::asio::io_context& context,
+               const Options& options,
+               const boost::asio::ip::tcp::endpoint& endpoint,
+               Stats& stats,
+               std::size_t index,
+               Clock::time_point measureFrom,
+               Clock::time_point deadline)
+               : m_socket(context)
+               , m_timer(context)
+               , mr_options(options)
+               , m_endpoint(endpoint)
+               , mr_stats(stats)
+               , m_index(index)
+               , m_measureFrom(measureFrom)
+               , m_deadline(deadline)
+               , m_random(static_cast<std::minstd_rand::result_type>(index + 1))
+{
+    if (options.rate > 0) {
+        // Каждое соединение шлет rate / connections команд в секунду. Соединения сдвинуты
+        // по фазе, чтобы не отправлять все команды одновременно.
+        m_interval = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(static_cast<double>(options.connections) / options.rate));
+        m_nextSend = Clock::now() + m_interval * static_cast<Clock::rep>(index)
+                                  / static_cast<Clock::rep>(options.connections);
+    }
+}
+
+boost::asio::awaitable<void> Client::run()
+{
+    boost::system::error_code errorCode;
+
+    co_await m_socket.async_connect(m_endpoint, boost::asio::redirect_error(boost::asio::use_awaitable, errorCode));
+    if (errorCode) {
+        ++mr_stats.connectErrors;
+        co_return;
+    }
+    m_socket.set_option(boost::asio::ip::tcp::no_delay(true));
+
+    auto sessions = m_index;
+    while (Clock::now() < m_deadline) {
+        const auto& [login, password] = mr_options.users[sessions++ % mr_options.users.size()];
+
+        m_command.assign("login ").append(login);
+        if (!co_await exchange(Operation::login)) co_return;
+
+        m_command.assign("password ").append(password);
+        if (!co_await exchange(Operation::password)) co_return;
+        // Неверный логин или пароль - сервер вернулся в состояние <login>, начинаем заново.
+        if (!m_reply.empty()) continue;
+
+        for (std::size_t i = 0; i < mr_options.callsPerSession && Clock::now() < m_deadline; ++i) {
+            if (!co_await exchange(makeCalc())) co_return;
+        }
+
+        m_command.assign("logout");
+        if (!co_await exchange(Operation::logout)) co_return;
+
+        if (Clock::now() >= m_measureFrom) {
+            ++mr_stats.sessions;
+        }
+    }
+
+    m_socket.close(errorCode);
+}
+
+Operation Client::makeCalc()
+{
+    const auto& expressions = mr_options.expressions;
+    const auto  pick = [&]() -> const std::string& { return expressions[m_random() % expressions.size()]; };
+
+    if (mr_options.batchShare > 0
+        && std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < mr_options.batchShare) {
+        m_command.assign("calcbatch ");
+        for (std::size_t i = 0; i < mr_options.batchSize; ++i) {
+            if (i != 0) m_command.push_back(';');
+            m_command.append(pick());
+        }
+        return Operation::calcbatch;
+    }
+
+    m_command.assign("calc ").append(pick());
+    return Operation::calc;
+}
+
+boost::asio::awaitable<bool> Client::exchange(Operation operation)
+{
+    boost::system::error_code errorCode;
+    const auto awaitInto = [&errorCode]() {
+        return boost::asio::redirect_error(boost::asio::use_awaitable, errorCode);
+    };
+
+    // Ждем своего времени по расписанию. Если опаздываем, отправляем сразу, но задержку
+    // все равно считаем от запланированного момента.
+    auto scheduled = Clock::now();
+    if (m_interval != Clock::duration::zero()) {
+        scheduled   = m_nextSend;
+        m_nextSend += m_interval;
+        if (scheduled > Clock::now()) {
+            m_timer.expires_at(scheduled);
+            co_await m_timer.async_wait(awaitInto());
+        }
+    }
+
+    m_command.append("\nping\n");
+    co_await boost::asio::async_write(m_socket, boost::asio::buffer(m_command), awaitInto());
+    if (errorCode) {
+        ++mr_stats.disconnects;
+        co_return false;
+    }
+
+    // Читаем строки до "pong". Все, что перед ним, - ответ на команду.
+    m_reply.clear();
+    while (true) {
+        const auto length = co_await boost::asio::async_read_until(m_socket, boost::asio::dynamic_buffer(m_input),
+                                                                   '\n', awaitInto());
+        if (errorCode) {
+            ++mr_stats.disconnects;
+            co_return false;
+        }
+
+        const std::string_view line(m_input.data(), length - 1);
+        if (line == "pong") {
+            m_input.erase(0, length);
+            break;
+        }
+        m_reply.assign(line);
+        m_input.erase(0, length);
+    }
+
+    const auto finished = Clock::now();
+    if (scheduled < m_measureFrom || finished > m_deadline) {
+        co_return true;
+    }
+
+    const auto index = static_cast<std::size_t>(operation);
+    mr_stats.latency[index].record(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(finished - scheduled).count()));
+
+    // Успешные команды остаются без ответа, кроме calcbatch - он отвечает результатами.
+    const bool failed = operation == Operation::calcbatch
+            ? m_reply.empty() || !(std::isdigit(static_cast<unsigned char>(m_reply.front()))
+                                   || m_reply.front() == '-' || m_reply.front() == 'n' || m_reply.front() == 'i')
+            : !m_reply.empty();
+    if (failed) {
+        ++mr_stats.errors[index];
+    }
+
+    co_return true;
+}
@@ -0,0 +1,116 @@
+#ifndef LOADGEN_CLIENT_H
+#define LOADGEN_CLIENT_H
+
+#include <array>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <string_view>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/awaitable.hpp>
+
+#include "Histogram.h"
+
+using Clock = std::chrono::steady_clock;
+
+/// Параметры нагрузки (задаются из командной строки, см. main.cpp).
+struct Options {
+    std::string    host = "127.0.0.1";
+    unsigned short port = 1234;
+
+    std::size_t connections = 1000; //!< Одновременных соединений.
+    unsigned    threads     = 0;    //!< Потоков с io_context. 0 - по количеству ядер.
+
+    std::chrono::seconds duration {30}; //!< Длительность замера (после прогрева).
+    std::chrono::seconds warmup   {5};  //!< Прогрев: запросы идут, но не учитываются.
+
+    /// Суммарная частота команд по всем соединениям (в секунду). 0 - без ограничения:
+    /// каждое соединение шлет следующую команду сразу после ответа на предыдущую.
+    double rate = 0;
+
+    std::size_t callsPerSession = 100; //!< Сколько calc между login/password и logout.
+    double      batchShare      = 0;   //!< Доля вычислений, отправляемых как calcbatch (0..1).
+    std::size_t batchSize       = 16;  //!< Выражений в одном calcbatch.
+
+    std::vector<std::pair<std::string, std::string>> users; //!< Логины и пароли.
+    std::vector<std::string>                         expressions;
+
+    bool json = false; //!< Печатать отчет в JSON.
+};
+
+/// Команды протокола, задержки которых считаются отдельно.
+enum class Operation : std::uint8_t { login = 0, password, calc, calcbatch, logout };
+
+constexpr std::size_t operationCount = 5;
+constexpr std::array<std::string_view, operationCount> operationNames {
+        "login", "password", "calc", "calcbatch", "logout"};
+
+/// Статистика одного потока. Потоки сводят ее в общую после завершения.
+struct Stats {
+    std::array<Histogram, operationCount>     latency;  //!< Задержки, нс.
+    std::array<std::uint64_t, operationCount> errors {};
+
+    std::uint64_t sessions      = 0; //!< Завершенных сессий (logout).
+    std::uint64_t connectErrors = 0;
+    std::uint64_t disconnects   = 0; //!< Соединений, оборванных сервером до конца замера.
+
+    void merge(const Stats& other);
+};
+
+/// Один клиент: соединение, которое по кругу проходит login -> password -> calc* -> logout.
+///
+/// На успешные login, password и calc сервер ничего не отвечает, поэтому за каждой командой
+/// клиент шлет "ping": ответ "pong" означает, что команда обработана, а строка перед ним - ее ответ.
+///
+/// При заданной частоте задержка считается от момента, когда команда должна была уйти по
+/// расписанию, а не от фактической отправки - иначе перегруженный сервер сам себе
+/// занижал бы задержки (coordinated omission).
+class Client {
+
+public:
+    explicit Client(boost::asio::io_context& context,
+                    const Options& options,
+                    const boost::asio::ip::tcp::endpoint& endpoint,
+                    Stats& stats,
+                    std::size_t index,
+                    Clock::time_point measureFrom,
+                    Clock::time_point deadline);
+
+    Client(const Client& other) = delete;
+    Client& operator=(const Client& other) = delete;
+
+    /// Корутина клиента. Завершается после deadline или при обрыве соединения.
+    boost::asio::awaitable<void> run();
+
+private:
+    /// Отправляет m_command и ждет ответа. Возвращает false, если соединение оборвалось.
+    boost::asio::awaitable<bool> exchange(Operation operation);
+    /// Составляет в m_command команду calc или calcbatch.
+    Operation makeCalc();
+
+private:
+    boost::asio::ip::tcp::socket   m_socket;
+    boost::asio::steady_timer      m_timer;
+    const Options&                 mr_options;
+    boost::asio::ip::tcp::endpoint m_endpoint;
+    Stats&                         mr_stats;
+    std::size_t                    m_index;
+
+    Clock::time_point m_measureFrom; //!< С этого момента задержки записываются.
+    Clock::time_point m_deadline;
+    Clock::duration   m_interval {};  //!< Период команд одного соединения (0 - без расписания).
+    Clock::time_point m_nextSend;     //!< Когда по расписанию уйдет следующая команда.
+
+    std::minstd_rand m_random;
+    std::string      m_command; //!< Команда вместе с "ping".
+    std::string      m_input;   //!< Непрочитанные строки ответа.
+    std::string      m_reply;   //!< Ответ на последнюю команду (без "pong").
+};
+
+#endif //LOADGEN_CLIENT_H
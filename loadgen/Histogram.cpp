@@ -0,0 +1,81 @@
+#include "Histogram.h"
+
+#include <cmath>
+#include <algorithm>
+
+/// Номер старшего единичного бита (value > 0).
+static unsigned highestBit(std::uint64_t value)
+{
+    return 63u - static_cast<unsigned>(__builtin_clzll(value));
+}
+
+Histogram::Histogram(unsigned precisionBits)
+                     : m_precisionBits(std::clamp(precisionBits, 2u, 16u))
+                     , m_halfCount(std::uint64_t {1} << (m_precisionBits - 1))
+{
+    // Корзина 0 - значения [0, 2 * half), корзина b > 0 - [half << b, half << (b + 1)).
+    const auto buckets = 64 - m_precisionBits + 1;
+    m_counts.resize((buckets + 1) * m_halfCount);
+}
+
+std::size_t Histogram::indexOf(std::uint64_t value) const
+{
+    if (value < 2 * m_halfCount) {
+        return static_cast<std::size_t>(value);
+    }
+
+    const auto bucket = highestBit(value) - (m_precisionBits - 1);
+    return static_cast<std::size_t>(bucket * m_halfCount + (value >> bucket));
+}
+
+std::uint64_t Histogram::highestOf(std::size_t index) const
+{
+    if (index < 2 * m_halfCount) {
+        return index;
+    }
+
+    const auto bucket    = index / m_halfCount - 1;
+    const auto subBucket = index - bucket * m_halfCount;
+    return ((subBucket + 1) << bucket) - 1;
+}
+
+void Histogram::record(std::uint64_t value)
+{
+    ++m_counts[indexOf(value)];
+    ++m_count;
+    m_sum += value;
+    m_min  = std::min(m_min, value);
+    m_max  = std::max(m_max, value);
+}
+
+void Histogram::merge(const Histogram& other)
+{
+    if (other.m_count == 0) return;
+
+    for (std::size_t i = 0; i < std::min(m_counts.size(), other.m_counts.size()); ++i) {
+        m_counts[i] += other.m_counts[i];
+    }
+    m_count += other.m_count;
+    m_sum   += other.m_sum;
+    m_min    = std::min(m_min, other.m_min);
+    m_max    = std::max(m_max, other.m_max);
+}
+
+std::uint64_t Histogram::percentile(double percentile) const
+{
+    if (m_count == 0) return 0;
+
+    // Ранг записи, которая отвечает за перцентиль (как в HdrHistogram: округление вверх).
+    const auto rank = std::max<std::uint64_t>(
+            1, static_cast<std::uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * m_count)));
+
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < m_counts.size(); ++i) {
+        seen += m_counts[i];
+        if (seen >= rank) {
+            return std::min(highestOf(i), m_max);
+        }
+    }
+
+    return m_max;
+}
@@ -0,0 +1,44 @@
+#ifndef LOADGEN_HISTOGRAM_H
+#define LOADGEN_HISTOGRAM_H
+
+#include <vector>
+#include <cstdint>
+
+/// Гистограмма задержек в духе HdrHistogram: логарифмические корзины, каждая поделена на
+/// 2^(precisionBits - 1) равных частей. Относительная погрешность не больше 2^-(precisionBits - 1)
+/// на всем диапазоне uint64, запись - O(1) без выделения памяти.
+class Histogram {
+
+public:
+    explicit Histogram(unsigned precisionBits = 8);
+
+    /// Записывает значение (в наносекундах).
+    void record(std::uint64_t value);
+    /// Добавляет к себе значения другой гистограммы с той же точностью.
+    void merge(const Histogram& other);
+
+    /// Значение, не меньше которого percentile процентов записей (0..100).
+    std::uint64_t percentile(double percentile) const;
+
+    std::uint64_t count() const { return m_count; }
+    std::uint64_t min() const { return m_count == 0 ? 0 : m_min; }
+    std::uint64_t max() const { return m_max; }
+    double        mean() const { return m_count == 0 ? 0.0 : static_cast<double>(m_sum) / m_count; }
+
+private:
+    std::size_t   indexOf(std::uint64_t value) const;
+    /// Наибольшее значение, попадающее в ту же ячейку, что и ячейка index.
+    std::uint64_t highestOf(std::size_t index) const;
+
+private:
+    unsigned      m_precisionBits;
+    std::uint64_t m_halfCount; //!< Половина числа ячеек в корзине.
+
+    std::vector<std::uint64_t> m_counts;
+    std::uint64_t m_count = 0;
+    std::uint64_t m_min   = UINT64_MAX;
+    std::uint64_t m_max   = 0;
+    long double   m_sum   = 0;
+};
+
+#endif //LOADGEN_HISTOGRAM_H
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Сравнение транспортов сервера (epoll и io_uring) под нагрузкой calc_loadgen.
+#
+# Собирает сервер в двух вариантах (SERVER_USE_IO_URING=OFF/ON), для каждого числа соединений
+# по очереди запускает оба и гоняет по ним calc_loadgen. Отчеты в JSON складываются
+# в $BUILD/<транспорт>-<соединений>.json, сводка печатается в конце.
+#
+# Параметры - переменные окружения:
+#   BUILD=build-bench                     каталог сборок и отчетов
+#   CONNECTIONS="1000 5000 10000 20000"   числа соединений
+#   DURATION=30 WARMUP=5                  длительность замера и прогрева, с
+#   USER_CREDENTIALS=belousotroll:pass    пользователь для calc_loadgen
+#
+# Сервер и нагрузка делят одну машину, поэтому для честного сравнения лучше ограничить
+# их разными ядрами (например, taskset) или запускать calc_loadgen с другой машины.
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=${BUILD:-$ROOT/build-bench}
+CONNECTIONS=${CONNECTIONS:-"1000 5000 10000 20000"}
+DURATION=${DURATION:-30}
+WARMUP=${WARMUP:-5}
+USER_CREDENTIALS=${USER_CREDENTIALS:-belousotroll:pass}
+
+# На каждое соединение - по дескриптору у сервера и у нагрузки.
+ulimit -n 1048576 2>/dev/null || ulimit -n 65536
+
+for transport in epoll io_uring; do
+    option=OFF
+    [ "$transport" = io_uring ] && option=ON
+    cmake -S "$ROOT" -B "$BUILD/$transport" -DCMAKE_BUILD_TYPE=Release -DSERVER_USE_IO_URING=$option > /dev/null
+    cmake --build "$BUILD/$transport" -j"$(nproc)" > /dev/null
+done
+
+for connections in $CONNECTIONS; do
+    for transport in epoll io_uring; do
+        "$BUILD/$transport/server/server" > "$BUILD/$transport-$connections.log" 2>&1 &
+        server=$!
+        sleep 2
+
+        "$BUILD/$transport/loadgen/calc_loadgen" --connections="$connections" --duration="$DURATION" \
+            --warmup="$WARMUP" --user="$USER_CREDENTIALS" --json > "$BUILD/$transport-$connections.json"
+
+        kill -INT "$server"
+        wait "$server" || true
+    done
+done
+
+# Сводка: пропускная способность и задержки calc (мкс) по каждому прогону.
+for connections in $CONNECTIONS; do
+    for transport in epoll io_uring; do
+        printf '%-9s %6s: ' "$transport" "$connections"
+        tr -d '\n ' < "$BUILD/$transport-$connections.json" \
+            | sed -n 's/.*"throughput_rps":\([0-9.]*\).*"calc":{[^}]*"latency_us":{\([^}]*\)}.*/rps=\1 \2/p'
+    done
+done
@@ -0,0 +1,237 @@
+#include <thread>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <cctype>
+#include <algorithm>
+#include <string_view>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include "Client.h"
+
+/// Нагрузочный клиент сервера-калькулятора.
+/// Пример: calc_loadgen --connections=5000 --rate=50000 --duration=60 --user=login:password --json
+
+static void printUsage()
+{
+    std::cerr <<
+        "Использование: calc_loadgen [--параметр=значение ...]\n"
+        "  --host=127.0.0.1 --port=1234     адрес сервера\n"
+        "  --connections=1000               одновременных соединений\n"
+        "  --threads=0                      потоков (0 - по количеству ядер)\n"
+        "  --duration=30 --warmup=5         длительность замера и прогрева, с\n"
+        "  --rate=0                         команд в секунду на все соединения (0 - без ограничения)\n"
+        "  --calls=100                      вычислений за сессию (между входом и выходом)\n"
+        "  --batch-share=0 --batch-size=16  доля вычислений через calcbatch и размер пакета\n"
+        "  --user=login:password            пользователь (можно несколько раз)\n"
+        "  --users=FILE                     файл со строками \"login password\"\n"
+        "  --expressions=FILE               файл с выражениями, по одному в строке\n"
+        "  --json                           отчет в JSON\n";
+}
+
+/// Пробелы внутри выражения сервер считает лишними словами команды.
+static std::string withoutSpaces(std::string_view expression)
+{
+    std::string result;
+    for (const auto character : expression) {
+        if (!std::isspace(static_cast<unsigned char>(character))) result.push_back(character);
+    }
+    return result;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view argument(argv[i]);
+        if (argument.substr(0, 2) != "--") return false;
+
+        const auto equals = argument.find('=');
+        const auto name   = argument.substr(2, equals == std::string_view::npos ? std::string_view::npos : equals - 2);
+        const std::string value(equals == std::string_view::npos ? std::string_view() : argument.substr(equals + 1));
+
+        if      (name == "host")        options.host            = value;
+        else if (name == "port")        options.port            = static_cast<unsigned short>(std::stoul(value));
+        else if (name == "connections") options.connections     = std::stoul(value);
+        else if (name == "threads")     options.threads         = static_cast<unsigned>(std::stoul(value));
+        else if (name == "duration")    options.duration        = std::chrono::seconds(std::stol(value));
+        else if (name == "warmup")      options.warmup          = std::chrono::seconds(std::stol(value));
+        else if (name == "rate")        options.rate            = std::stod(value);
+        else if (name == "calls")       options.callsPerSession = std::stoul(value);
+        else if (name == "batch-share") options.batchShare      = std::stod(value);
+        else if (name == "batch-size")  options.batchSize       = std::max<std::size_t>(std::stoul(value), 1);
+        else if (name == "json")        options.json            = true;
+        else if (name == "user") {
+            const auto colon = value.find(':');
+            if (colon == std::string::npos) return false;
+            options.users.emplace_back(value.substr(0, colon), value.substr(colon + 1));
+        } else if (name == "users") {
+            std::ifstream file(value);
+            std::string login, password;
+            while (file >> login >> password) {
+                options.users.emplace_back(login, password);
+            }
+        } else if (name == "expressions") {
+            std::ifstream file(value);
+            for (std::string line; std::getline(file, line);) {
+                if (auto expression = withoutSpaces(line); !expression.empty()) {
+                    options.expressions.push_back(std::move(expression));
+                }
+            }
+        } else {
+            return false;
+        }
+    }
+
+    if (options.expressions.empty()) {
+        options.expressions = {"1+2", "2*3-4/5", "sqrt(16)+2^10", "sin(0.5)*cos(0.5)", "(1+2)*(3+4)*(5+6)",
+                               "ln(10)/log(100)", "abs(-7)%3", "pi*2^2"};
+    }
+
+    return !options.users.empty() && options.connections != 0;
+}
+
+static void printText(const Options& options, const Stats& stats, double seconds)
+{
+    std::cout << "Соединений: " << options.connections << ", замер: " << seconds << " с, сессий: " << stats.sessions
+              << ", ошибок подключения: " << stats.connectErrors << ", обрывов: " << stats.disconnects << "\n\n";
+    // setw считает байты, а не символы, поэтому заголовок с кириллицей выравниваем сами.
+    const auto column = [](std::string_view title, std::size_t width, bool left = false) {
+        const auto length = static_cast<std::size_t>(std::count_if(title.begin(), title.end(), [](char c) {
+            return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+        }));
+        const std::string padding(width > length ? width - length : 0, ' ');
+        std::cout << (left ? std::string(title) + padding : padding + std::string(title));
+    };
+    column("команда", 10, true);
+    column("запросов", 12);
+    column("ошибок", 10);
+    column("в секунду", 12);
+    column("p50,мкс", 10);
+    column("p99,мкс", 10);
+    column("p999,мкс", 11);
+    column("max,мкс", 10);
+    std::cout << '\n';
+
+    std::cout << std::fixed << std::setprecision(1);
+    for (std::size_t i = 0; i < operationCount; ++i) {
+        const auto& histogram = stats.latency[i];
+        if (histogram.count() == 0) continue;
+        std::cout << std::left << std::setw(10) << operationNames[i] << std::right
+                  << std::setw(12) << histogram.count() << std::setw(10) << stats.errors[i]
+                  << std::setw(12) << histogram.count() / seconds
+                  << std::setw(10) << histogram.percentile(50.0) / 1e3
+                  << std::setw(10) << histogram.percentile(99.0) / 1e3
+                  << std::setw(11) << histogram.percentile(99.9) / 1e3
+                  << std::setw(10) << histogram.max() / 1e3 << '\n';
+    }
+}
+
+static void printJson(const Options& options, const Stats& stats, double seconds)
+{
+    std::uint64_t total = 0;
+    for (const auto& histogram : stats.latency) total += histogram.count();
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "{\n"
+              << "  \"connections\": " << options.connections << ",\n"
+              << "  \"rate\": " << options.rate << ",\n"
+              << "  \"duration_s\": " << seconds << ",\n"
+              << "  \"sessions\": " << stats.sessions << ",\n"
+              << "  \"connect_errors\": " << stats.connectErrors << ",\n"
+              << "  \"disconnects\": " << stats.disconnects << ",\n"
+              << "  \"throughput_rps\": " << total / seconds << ",\n"
+              << "  \"operations\": {";
+
+    bool first = true;
+    for (std::size_t i = 0; i < operationCount; ++i) {
+        const auto& histogram = stats.latency[i];
+        if (histogram.count() == 0) continue;
+        std::cout << (first ? "\n" : ",\n") << "    \"" << operationNames[i] << "\": {"
+                  << "\"count\": " << histogram.count()
+                  << ", \"errors\": " << stats.errors[i]
+                  << ", \"rps\": " << histogram.count() / seconds
+                  << ", \"latency_us\": {"
+                  << "\"mean\": " << histogram.mean() / 1e3
+                  << ", \"p50\": " << histogram.percentile(50.0) / 1e3
+                  << ", \"p90\": " << histogram.percentile(90.0) / 1e3
+                  << ", \"p99\": " << histogram.percentile(99.0) / 1e3
+                  << ", \"p999\": " << histogram.percentile(99.9) / 1e3
+                  << ", \"max\": " << histogram.max() / 1e3 << "}}";
+        first = false;
+    }
+    std::cout << "\n  }\n}\n";
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            printUsage();
+            return 1;
+        }
+    } catch (const std::exception&) {
+        printUsage();
+        return 1;
+    }
+
+    const auto threadCount = std::max(1u, std::min<unsigned>(
+            options.threads != 0 ? options.threads : std::thread::hardware_concurrency(),
+            static_cast<unsigned>(options.connections)));
+
+    try {
+        boost::asio::io_context resolverContext;
+        boost::asio::ip::tcp::resolver resolver(resolverContext);
+        const auto endpoint = resolver.resolve(options.host, std::to_string(options.port))->endpoint();
+
+        const auto started     = Clock::now();
+        const auto measureFrom = started + options.warmup;
+        const auto deadline    = measureFrom + options.duration;
+
+        // Каждый поток крутит свой io_context со своей долей клиентов и пишет свою статистику.
+        std::vector<std::unique_ptr<boost::asio::io_context>> contexts;
+        std::vector<Stats> stats(threadCount);
+        std::vector<std::unique_ptr<Client>> clients;
+        for (unsigned i = 0; i < threadCount; ++i) {
+            contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+        }
+        for (std::size_t i = 0; i < options.connections; ++i) {
+            const auto shard = i % threadCount;
+            clients.push_back(std::make_unique<Client>(*contexts[shard], options, endpoint, stats[shard],
+                                                       i, measureFrom, deadline));
+            boost::asio::co_spawn(*contexts[shard], clients.back()->run(), boost::asio::detached);
+        }
+
+        std::vector<std::thread> threads;
+        for (auto& context : contexts) {
+            // Зависшие на сервере запросы не должны держать замер бесконечно.
+            threads.emplace_back([&context, deadline]() { context->run_until(deadline + std::chrono::seconds(10)); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        Stats total;
+        for (const auto& shardStats : stats) {
+            total.merge(shardStats);
+        }
+
+        const auto seconds = std::chrono::duration<double>(options.duration).count();
+        if (options.json) {
+            printJson(options, total, seconds);
+        } else {
+            printText(options, total, seconds);
+        }
+    } catch (const std::exception& exception) {
+        std::cerr << "Ошибка: " << exception.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "Replayer.h"
+
+#include <array>
+#include <algorithm>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+Replayer::Replayer(boost::asio::io_context& context,
+                   const Session& session,
+                   const Options& options,
+                   const boost::asio::ip::tcp::endpoint& endpoint,
+                   Clock::time_point started,
+                   Outcome& outcome)
+                   : m_socket(context)
+                   , m_timer(context)
+                   , mr_session(session)
+                   , mr_options(options)
+                   , m_endpoint(endpoint)
+                   , m_started(started)
+                   , mr_outcome(outcome)
+{
+}
+
+Clock::time_point Replayer::scheduled(std::uint64_t time) const
+{
+    if (mr_options.speed <= 0) return m_started;
+
+    return m_started + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::micro>(static_cast<double>(time) / mr_options.speed));
+}
+
+boost::asio::awaitable<void> Replayer::waitUntil(Clock::time_point moment)
+{
+    if (m_closed || moment <= Clock::now()) co_return;
+
+    boost::system::error_code errorCode;
+    m_timer.expires_at(moment);
+    co_await m_timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, errorCode));
+}
+
+boost::asio::awaitable<void> Replayer::run()
+{
+    boost::system::error_code errorCode;
+    const auto awaitInto = [&errorCode]() {
+        return boost::asio::redirect_error(boost::asio::use_awaitable, errorCode);
+    };
+
+    co_await waitUntil(scheduled(mr_session.opened));
+    co_await m_socket.async_connect(m_endpoint, awaitInto());
+    if (errorCode) co_return;
+    mr_outcome.connected = true;
+    m_socket.set_option(boost::asio::ip::tcp::no_delay(true));
+
+    // Ответы читаем параллельно с отправкой: клиент трассы тоже мог слать запросы, не дожидаясь ответов.
+    boost::asio::co_spawn(m_socket.get_executor(), receive(), boost::asio::detached);
+
+    for (const auto& chunk : mr_session.requests) {
+        const auto moment = scheduled(chunk.time);
+        co_await waitUntil(moment);
+        if (m_closed) break;
+        if (mr_options.speed > 0) {
+            mr_outcome.lag = std::max(mr_outcome.lag, Clock::now() - moment);
+        }
+
+        co_await boost::asio::async_write(m_socket, boost::asio::buffer(chunk.data), awaitInto());
+        if (errorCode) break;
+    }
+
+    // Соединение закрываем тогда же, когда оно закрылось в трассе: если его закрыл сервер
+    // (quit, сроки), он сделает это и сейчас, и ожидание прервется раньше.
+    co_await waitUntil(scheduled(mr_session.closed));
+    if (m_closed) co_return;
+    m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send, errorCode);
+
+    co_await waitUntil(Clock::now() + mr_options.closeTimeout);
+    if (!m_closed) {
+        mr_outcome.timedOut = true;
+        m_socket.close(errorCode);
+    }
+}
+
+boost::asio::awaitable<void> Replayer::receive()
+{
+    std::array<char, 4096> buffer {};
+    while (true) {
+        boost::system::error_code errorCode;
+        const auto length = co_await m_socket.async_read_some(
+                boost::asio::buffer(buffer), boost::asio::redirect_error(boost::asio::use_awaitable, errorCode));
+        if (errorCode) break;
+        mr_outcome.received.append(buffer.data(), length);
+    }
+
+    m_closed = true;
+    m_timer.cancel();
+}
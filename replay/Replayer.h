@@ -0,0 +1,78 @@
+#ifndef REPLAY_REPLAYER_H
+#define REPLAY_REPLAYER_H
+
+#include <chrono>
+#include <string>
+#include <utility>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/awaitable.hpp>
+
+#include "TraceReader.h"
+
+using Clock = std::chrono::steady_clock;
+
+/// Параметры воспроизведения (задаются из командной строки, см. main.cpp).
+struct Options {
+    std::string    host = "127.0.0.1";
+    unsigned short port = 1234;
+    std::string    trace;
+
+    /// Во сколько раз быстрее исходного темпа. 0 - без пауз: каждое соединение отправляет
+    /// запросы сразу друг за другом.
+    double   speed   = 1;
+    unsigned threads = 0; //!< Потоков с io_context. 0 - по количеству ядер.
+
+    /// Сколько ждать, пока сервер закроет соединение после конца запросов.
+    std::chrono::milliseconds closeTimeout {5000};
+};
+
+/// Что получилось при воспроизведении одного соединения.
+struct Outcome {
+    bool            connected = false;
+    bool            timedOut  = false; //!< Сервер не закрыл соединение за closeTimeout.
+    std::string     received;          //!< Все, что ответил сервер.
+    Clock::duration lag {};            //!< Наибольшее опоздание отправки против расписания.
+};
+
+/// Воспроизводит одно соединение трассы: подключается и отправляет запросы теми же кусками и
+/// в те же моменты (с поправкой на скорость), что и исходный клиент, а ответы сервера копит в
+/// Outcome. Сравнивать ответы с трассой - дело вызывающего, после завершения всех соединений.
+class Replayer {
+
+public:
+    explicit Replayer(boost::asio::io_context& context,
+                      const Session& session,
+                      const Options& options,
+                      const boost::asio::ip::tcp::endpoint& endpoint,
+                      Clock::time_point started,
+                      Outcome& outcome);
+
+    Replayer(const Replayer& other) = delete;
+    Replayer& operator=(const Replayer& other) = delete;
+
+    /// Корутина соединения. Завершается, когда сервер закрыл соединение или истек closeTimeout.
+    boost::asio::awaitable<void> run();
+
+private:
+    /// Читает ответы, пока сервер не закроет соединение.
+    boost::asio::awaitable<void> receive();
+    /// Момент по расписанию для времени трассы time.
+    Clock::time_point scheduled(std::uint64_t time) const;
+    /// Ждет момента moment. Ожидание прерывается, если сервер закрыл соединение.
+    boost::asio::awaitable<void> waitUntil(Clock::time_point moment);
+
+private:
+    boost::asio::ip::tcp::socket   m_socket;
+    boost::asio::steady_timer      m_timer;
+    const Session&                 mr_session;
+    const Options&                 mr_options;
+    boost::asio::ip::tcp::endpoint m_endpoint;
+    Clock::time_point              m_started; //!< Начало трассы по часам воспроизведения.
+    Outcome&                       mr_outcome;
+    bool                           m_closed = false; //!< Сервер закрыл соединение.
+};
+
+#endif //REPLAY_REPLAYER_H
@@ -0,0 +1,75 @@
+#include "TraceReader.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "Trace.h"
+
+Trace readTrace(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Не удалось открыть трассу " + path);
+    }
+    const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!trace::isFileHeader(data)) {
+        throw std::runtime_error(path + " - не трасса calc или другой версии формата");
+    }
+
+    Trace result;
+    // Номер соединения в трассе -> индекс в result.sessions.
+    std::unordered_map<std::uint32_t, std::size_t> open;
+
+    std::size_t offset = trace::fileHeaderSize;
+    while (offset < data.size()) {
+        if (data.size() - offset < trace::recordHeaderSize) {
+            result.truncated = true;
+            break;
+        }
+        const auto header = trace::readRecordHeader(data.data() + offset);
+        offset += trace::recordHeaderSize;
+        if (data.size() - offset < header.length) {
+            result.truncated = true;
+            break;
+        }
+        const std::string_view payload(data.data() + offset, header.length);
+        offset += header.length;
+        result.duration = header.time;
+
+        if (header.type == trace::RecordType::open) {
+            open[header.connection] = result.sessions.size();
+            auto& session      = result.sessions.emplace_back();
+            session.connection = header.connection;
+            session.opened     = header.time;
+            continue;
+        }
+
+        const auto found = open.find(header.connection);
+        if (found == open.end()) continue;
+        auto& session = result.sessions[found->second];
+
+        switch (header.type) {
+            case trace::RecordType::in:
+                session.requests.push_back({header.time, std::string(payload)});
+                break;
+            case trace::RecordType::out:
+                session.responses.append(payload);
+                break;
+            case trace::RecordType::close:
+                session.closed = header.time;
+                open.erase(found);
+                break;
+            default:
+                throw std::runtime_error("Неизвестный тип записи в трассе " + path);
+        }
+    }
+
+    // Соединения, которые не успели закрыться до конца записи, закрываем концом трассы.
+    for (const auto& [connection, index] : open) {
+        result.sessions[index].closed = result.duration;
+    }
+
+    return result;
+}
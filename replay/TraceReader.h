@@ -0,0 +1,34 @@
+#ifndef REPLAY_TRACEREADER_H
+#define REPLAY_TRACEREADER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/// Кусок запроса: байты, которые сервер прочитал из сокета за одно чтение.
+struct Chunk {
+    std::uint64_t time; //!< Микросекунды от начала трассы.
+    std::string   data;
+};
+
+/// Одно соединение из трассы.
+struct Session {
+    std::uint32_t      connection = 0;
+    std::uint64_t      opened     = 0; //!< Когда сервер принял соединение.
+    std::uint64_t      closed     = 0; //!< Когда сервер закрыл соединение (или конец трассы).
+    std::vector<Chunk> requests;
+    std::string        responses;      //!< Все ответы сервера подряд.
+};
+
+/// Прочитанная трасса: соединения в порядке открытия.
+struct Trace {
+    std::vector<Session> sessions;
+    std::uint64_t        duration  = 0;     //!< Время последней записи.
+    bool                 truncated = false; //!< Последняя запись оборвана (сервер не дописал трассу).
+};
+
+/// Читает файл трассы (формат - в Trace.h сервера). Бросает исключение, если файл не удалось
+/// открыть или это не трасса. Соединения, открытые до начала трассы, пропускаются.
+Trace readTrace(const std::string& path);
+
+#endif //REPLAY_TRACEREADER_H
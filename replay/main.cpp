@@ -0,0 +1,178 @@
+#include <thread>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include "Replayer.h"
+#include "TraceReader.h"
+
+/// Воспроизведение трассы, записанной сервером ([trace] file в ini), и сравнение ответов.
+/// Пример: calc_replay --trace=/var/tmp/calc.trace --speed=10
+///
+/// Ответы сравниваются побайтно, поэтому совпадут, только если сервер начинает с того же
+/// состояния, что и при записи: те же пользователи с теми же балансами и та же история.
+
+static void printUsage()
+{
+    std::cerr <<
+        "Использование: calc_replay --trace=FILE [--параметр=значение ...]\n"
+        "  --host=127.0.0.1 --port=1234     адрес сервера\n"
+        "  --speed=1                        во сколько раз быстрее записи (0 - без пауз)\n"
+        "  --threads=0                      потоков (0 - по количеству ядер)\n"
+        "  --close-timeout=5000             сколько ждать закрытия соединения сервером, мс\n"
+        "  --show=10                        сколько расхождений показать подробно\n";
+}
+
+static bool parseOptions(int argc, char** argv, Options& options, std::size_t& show)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view argument(argv[i]);
+        if (argument.substr(0, 2) != "--") return false;
+
+        const auto equals = argument.find('=');
+        const auto name   = argument.substr(2, equals == std::string_view::npos ? std::string_view::npos : equals - 2);
+        const std::string value(equals == std::string_view::npos ? std::string_view() : argument.substr(equals + 1));
+
+        if      (name == "trace")         options.trace        = value;
+        else if (name == "host")          options.host         = value;
+        else if (name == "port")          options.port         = static_cast<unsigned short>(std::stoul(value));
+        else if (name == "speed")         options.speed        = std::stod(value);
+        else if (name == "threads")       options.threads      = static_cast<unsigned>(std::stoul(value));
+        else if (name == "close-timeout") options.closeTimeout = std::chrono::milliseconds(std::stol(value));
+        else if (name == "show")          show                 = std::stoul(value);
+        else return false;
+    }
+
+    return !options.trace.empty() && options.speed >= 0;
+}
+
+/// Кусок ответа для отчета: непечатные байты - escape-последовательностями.
+static std::string excerpt(std::string_view data, std::size_t offset)
+{
+    constexpr std::size_t length = 40;
+    const auto part = data.substr(std::min(offset, data.size()), length);
+
+    std::string result;
+    for (const auto character : part) {
+        const auto byte = static_cast<unsigned char>(character);
+        if (character == '\n') {
+            result.append("\\n");
+        } else if (character == '\\') {
+            result.append("\\\\");
+        } else if (byte < 0x20 || byte == 0x7F) {
+            constexpr char digits[] = "0123456789abcdef";
+            result.append("\\x").push_back(digits[byte >> 4]);
+            result.push_back(digits[byte & 0xF]);
+        } else {
+            result.push_back(character);
+        }
+    }
+    if (data.size() > offset + length) result.append("...");
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::size_t show = 10;
+    try {
+        if (!parseOptions(argc, argv, options, show)) {
+            printUsage();
+            return 1;
+        }
+    } catch (const std::exception&) {
+        printUsage();
+        return 1;
+    }
+
+    try {
+        const auto trace = readTrace(options.trace);
+        if (trace.truncated) {
+            std::cerr << "Последняя запись трассы оборвана, она пропущена" << std::endl;
+        }
+        if (trace.sessions.empty()) {
+            std::cout << "В трассе нет соединений" << std::endl;
+            return 0;
+        }
+
+        boost::asio::io_context resolverContext;
+        boost::asio::ip::tcp::resolver resolver(resolverContext);
+        const auto endpoint = resolver.resolve(options.host, std::to_string(options.port))->endpoint();
+
+        const auto threadCount = std::max(1u, std::min<unsigned>(
+                options.threads != 0 ? options.threads : std::thread::hardware_concurrency(),
+                static_cast<unsigned>(trace.sessions.size())));
+
+        // Соединения раскладываются по потокам по кругу. Каждое пишет только свой Outcome.
+        std::vector<std::unique_ptr<boost::asio::io_context>> contexts;
+        for (unsigned i = 0; i < threadCount; ++i) {
+            contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+        }
+        std::vector<Outcome> outcomes(trace.sessions.size());
+        std::vector<std::unique_ptr<Replayer>> replayers;
+        // Небольшой запас, чтобы первые соединения не опаздывали, пока создаются остальные.
+        const auto started = Clock::now() + std::chrono::milliseconds(100);
+        for (std::size_t i = 0; i < trace.sessions.size(); ++i) {
+            auto& context = *contexts[i % threadCount];
+            replayers.push_back(std::make_unique<Replayer>(context, trace.sessions[i], options, endpoint,
+                                                           started, outcomes[i]));
+            boost::asio::co_spawn(context, replayers.back()->run(), boost::asio::detached);
+        }
+
+        std::vector<std::thread> threads;
+        for (auto& context : contexts) {
+            threads.emplace_back([&context]() { context->run(); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        const auto elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+
+        std::size_t matched = 0, connectErrors = 0, timedOut = 0, shown = 0;
+        Clock::duration lag {};
+        for (std::size_t i = 0; i < trace.sessions.size(); ++i) {
+            const auto& session = trace.sessions[i];
+            const auto& outcome = outcomes[i];
+            lag = std::max(lag, outcome.lag);
+            if (!outcome.connected) {
+                ++connectErrors;
+                continue;
+            }
+            if (outcome.timedOut) ++timedOut;
+            if (outcome.received == session.responses) {
+                ++matched;
+                continue;
+            }
+            if (shown++ >= show) continue;
+
+            const auto difference = std::mismatch(session.responses.begin(), session.responses.end(),
+                                                  outcome.received.begin(), outcome.received.end());
+            const auto offset = static_cast<std::size_t>(difference.first - session.responses.begin());
+            std::cout << "Соединение " << session.connection << ": ответ расходится с байта " << offset << "\n"
+                      << "  в трассе: \"" << excerpt(session.responses, offset) << "\"\n"
+                      << "  получено: \"" << excerpt(outcome.received, offset) << "\"\n";
+        }
+
+        const auto mismatched = trace.sessions.size() - matched - connectErrors;
+        std::cout << std::fixed << std::setprecision(3)
+                  << "Соединений: " << trace.sessions.size() << ", совпало: " << matched
+                  << ", расхождений: " << mismatched << ", ошибок подключения: " << connectErrors
+                  << ", не закрыты сервером: " << timedOut << "\n"
+                  << "Трасса: " << static_cast<double>(trace.duration) / 1e6 << " с, воспроизведение: " << elapsed
+                  << " с, наибольшее опоздание отправки: "
+                  << std::chrono::duration<double, std::milli>(lag).count() << " мс" << std::endl;
+
+        return mismatched == 0 && connectErrors == 0 ? 0 : 2;
+    } catch (const std::exception& exception) {
+        std::cerr << "Ошибка: " << exception.what() << std::endl;
+        return 1;
+    }
+}
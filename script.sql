@@ -25,8 +25,119 @@ CREATE TABLE sessions (
 	result_of_expression 	text NOT NULL
 );
 
+-- История пользователя читается страницами от новых записей к старым (calc_history): индекс
+-- отдает страницу, начиная с позиции предыдущей, не просматривая ни чужие, ни уже отданные
+-- строки, поэтому время запроса не зависит от размера таблицы. id в ключе делает позицию
+-- однозначной при совпадении времени. Выражение в индекс не включено: выражения пакетов с
+-- переменными не ограничены по длине, а строка индекса - ограничена (около 2,7 КБ); страница
+-- все равно читает из таблицы только свои строки.
+CREATE INDEX sessions_user_date_idx ON sessions (user_id, date DESC, id DESC);
+
+-- Для журнала в миллиарды строк sessions лучше секционировать по времени: старые секции
+-- можно отсоединять и удалять целиком, а индекс каждой секции остается небольшим. Для этого
+-- таблицу создают так (вместо CREATE TABLE sessions выше; индекс создается так же, как выше,
+-- и наследуется секциями), а секции на каждый месяц - функцией calc_create_sessions_partition:
+--
+-- CREATE TABLE sessions (
+-- 	id 			BIGSERIAL NOT NULL,
+-- 	user_id 		INTEGER REFERENCES users NOT NULL,
+-- 	date    		timestamp without time zone NOT NULL,
+-- 	expression 		text NOT NULL,
+-- 	result_of_expression 	text NOT NULL,
+-- 	PRIMARY KEY (id, date)
+-- ) PARTITION BY RANGE (date);
+--
+-- SELECT calc_create_sessions_partition(date_trunc('month', now())::date);
+-- SELECT calc_create_sessions_partition((date_trunc('month', now()) + interval '1 month')::date);
+
 INSERT INTO users(login, password, account_balance) 
 VALUES 	('belousotroll', 'pass', 15),
 	   	('gladkikh', 'daniil', 10),
 		('sappyk', 'sappyk', 5);
 
+-- Запросы сервера к users и sessions. План каждого запроса внутри функции PL/pgSQL строится
+-- один раз на соединение и дальше переиспользуется, как у подготовленного запроса.
+
+CREATE OR REPLACE FUNCTION calc_auth(p_login text, p_password text)
+    RETURNS TABLE(id bigint, account_balance integer)
+    LANGUAGE plpgsql STABLE AS $$
+BEGIN
+    RETURN QUERY
+        SELECT u.id, u.account_balance FROM users u
+        WHERE u.login = p_login AND u.password = p_password;
+END $$;
+
+-- Списывает p_amount с баланса, если его хватает. Нет строки - не хватило.
+CREATE OR REPLACE FUNCTION calc_charge(p_user_id bigint, p_amount integer)
+    RETURNS TABLE(account_balance integer)
+    LANGUAGE plpgsql AS $$
+DECLARE
+    v_balance integer;
+BEGIN
+    UPDATE users u SET account_balance = u.account_balance - p_amount
+    WHERE u.id = p_user_id AND u.account_balance >= p_amount
+    RETURNING u.account_balance INTO v_balance;
+    IF FOUND THEN
+        account_balance := v_balance;
+        RETURN NEXT;
+    END IF;
+END $$;
+
+-- Списывает по единице за каждое выражение и записывает выражения в sessions. Нет строки - не хватило.
+CREATE OR REPLACE FUNCTION calc_charge_and_log(p_user_id bigint, p_expressions text[], p_results float8[])
+    RETURNS TABLE(account_balance integer)
+    LANGUAGE plpgsql AS $$
+DECLARE
+    v_balance integer;
+BEGIN
+    UPDATE users u SET account_balance = u.account_balance - cardinality(p_expressions)
+    WHERE u.id = p_user_id AND u.account_balance >= cardinality(p_expressions)
+    RETURNING u.account_balance INTO v_balance;
+    IF NOT FOUND THEN
+        RETURN;
+    END IF;
+
+    INSERT INTO sessions(user_id, date, expression, result_of_expression)
+    SELECT p_user_id, NOW(), t.expression, t.result::text
+    FROM unnest(p_expressions, p_results) AS t(expression, result);
+
+    account_balance := v_balance;
+    RETURN NEXT;
+END $$;
+
+-- Страница истории пользователя: не больше p_limit записей строго старше позиции
+-- (p_before_us, p_before_id), от новых к старым. Без позиции (NULL) - с самой новой записи.
+-- Время - микросекунды с начала эпохи, без учета часового пояса (как хранится в sessions).
+CREATE OR REPLACE FUNCTION calc_history(p_user_id bigint, p_before_us bigint, p_before_id bigint, p_limit integer)
+    RETURNS TABLE(date_us bigint, id bigint, expression text, result_of_expression text)
+    LANGUAGE plpgsql STABLE AS $$
+BEGIN
+    IF p_before_us IS NULL THEN
+        RETURN QUERY
+            SELECT (extract(epoch FROM s.date) * 1000000)::bigint, s.id, s.expression, s.result_of_expression
+            FROM sessions s
+            WHERE s.user_id = p_user_id
+            ORDER BY s.date DESC, s.id DESC
+            LIMIT p_limit;
+    ELSE
+        RETURN QUERY
+            SELECT (extract(epoch FROM s.date) * 1000000)::bigint, s.id, s.expression, s.result_of_expression
+            FROM sessions s
+            WHERE s.user_id = p_user_id
+              AND (s.date, s.id) < ('epoch'::timestamp + p_before_us * interval '1 microsecond', p_before_id)
+            ORDER BY s.date DESC, s.id DESC
+            LIMIT p_limit;
+    END IF;
+END $$;
+
+-- Создает секцию sessions на месяц, начинающийся с p_month (только для секционированной sessions).
+CREATE OR REPLACE FUNCTION calc_create_sessions_partition(p_month date)
+    RETURNS void
+    LANGUAGE plpgsql AS $$
+DECLARE
+    v_from date := date_trunc('month', p_month)::date;
+    v_to   date := (date_trunc('month', p_month) + interval '1 month')::date;
+BEGIN
+    EXECUTE format('CREATE TABLE IF NOT EXISTS %I PARTITION OF sessions FOR VALUES FROM (%L) TO (%L)',
+                   'sessions_' || to_char(v_from, 'YYYY_MM'), v_from, v_to);
+END $$;
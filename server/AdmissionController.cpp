@@ -0,0 +1,116 @@
+#include "AdmissionController.h"
+
+#include <algorithm>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+/// Ждущий места. Таймер живет в шарде ждущего, и трогать его можно только оттуда.
+struct AdmissionController::Waiter {
+    explicit Waiter(boost::asio::io_context& context) : context(context), timer(context) {}
+
+    boost::asio::io_context&  context;
+    boost::asio::steady_timer timer;
+    /// Кто первым поставил флаг, тот и решил судьбу ожидания: release() - место отдано,
+    /// сам ждущий по таймеру - отказ.
+    std::atomic<bool>         done {false};
+};
+
+AdmissionController::Permit& AdmissionController::Permit::operator=(Permit&& other) noexcept
+{
+    if (this != &other) {
+        if (m_controller) m_controller->release();
+        m_controller = std::exchange(other.m_controller, nullptr);
+    }
+
+    return *this;
+}
+
+AdmissionController::Permit::~Permit()
+{
+    if (m_controller) m_controller->release();
+}
+
+AdmissionController::AdmissionController(std::size_t maxInFlight,
+                                         std::size_t maxQueued,
+                                         std::chrono::milliseconds queueTimeout)
+                                         : m_maxInFlight(maxInFlight)
+                                         , m_maxQueued(maxQueued)
+                                         , m_queueTimeout(queueTimeout) {}
+
+bool AdmissionController::tryAcquire()
+{
+    auto inFlight = m_inFlight.load(std::memory_order_relaxed);
+    while (inFlight < m_maxInFlight) {
+        if (m_inFlight.compare_exchange_weak(inFlight, inFlight + 1, std::memory_order_acquire)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+boost::asio::awaitable<AdmissionController::Permit> AdmissionController::admit(boost::asio::io_context& context)
+{
+    if (m_maxInFlight == 0) {
+        co_return Permit {this};
+    }
+    if (tryAcquire()) {
+        co_return Permit {this};
+    }
+    if (m_maxQueued == 0) {
+        co_return Permit {};
+    }
+
+    auto waiter = std::make_shared<Waiter>(context);
+    {
+        std::lock_guard lock(m_mutex);
+        // Проверяем еще раз под мьютексом: место могли освободить, пока мы его не держали.
+        if (tryAcquire()) {
+            co_return Permit {this};
+        }
+        if (m_waiters.size() >= m_maxQueued) {
+            co_return Permit {};
+        }
+        m_waiters.push_back(waiter);
+    }
+
+    // release() отменяет таймер, когда отдает нам место.
+    boost::system::error_code errorCode;
+    waiter->timer.expires_after(m_queueTimeout);
+    co_await waiter->timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, errorCode));
+
+    if (!waiter->done.exchange(true, std::memory_order_acq_rel)) {
+        // Срок вышел раньше, чем освободилось место. Уходим из очереди сразу, а не когда до нас
+        // дойдет release(), иначе просроченные ждущие занимали бы места в очереди и новым
+        // командам отказывали бы зря. Очередь не длиннее maxQueued, так что поиск недорог.
+        std::lock_guard lock(m_mutex);
+        const auto position = std::find(m_waiters.begin(), m_waiters.end(), waiter);
+        if (position != m_waiters.end()) {
+            m_waiters.erase(position);
+        }
+        co_return Permit {};
+    }
+
+    co_return Permit {this};
+}
+
+void AdmissionController::release()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        while (!m_waiters.empty()) {
+            auto waiter = std::move(m_waiters.front());
+            m_waiters.pop_front();
+            // Место переходит ждущему напрямую, счетчик не меняется.
+            if (!waiter->done.exchange(true, std::memory_order_acq_rel)) {
+                auto& context = waiter->context;
+                boost::asio::post(context, [waiter = std::move(waiter)]() { waiter->timer.cancel(); });
+                return;
+            }
+        }
+    }
+
+    m_inFlight.fetch_sub(1, std::memory_order_release);
+}
@@ -0,0 +1,68 @@
+#ifndef SERVER_ADMISSIONCONTROLLER_H
+#define SERVER_ADMISSIONCONTROLLER_H
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <utility>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+/// Ограничивает число команд, одновременно работающих с хранилищем (общее на все шарды).
+///
+/// Пока мест хватает, место занимается одним CAS. Когда места кончились, команда ждет
+/// в короткой очереди (не дольше queueTimeout), а если переполнена и очередь - сразу
+/// получает отказ, и клиенту отвечают "сервер занят". Так при перегрузке лишние команды
+/// не копятся в очереди пула соединений базы, где их задержка росла бы без предела.
+class AdmissionController {
+
+    struct Waiter;
+
+public:
+    /// Занятое место. Освобождается при разрушении.
+    class Permit {
+    public:
+        Permit() = default;
+        explicit Permit(AdmissionController* controller) : m_controller(controller) {}
+        Permit(Permit&& other) noexcept : m_controller(std::exchange(other.m_controller, nullptr)) {}
+        Permit& operator=(Permit&& other) noexcept;
+        ~Permit();
+
+        explicit operator bool() const { return m_controller != nullptr; }
+
+    private:
+        AdmissionController* m_controller = nullptr;
+    };
+
+    /// maxInFlight == 0 - без ограничения.
+    explicit AdmissionController(std::size_t maxInFlight,
+                                 std::size_t maxQueued,
+                                 std::chrono::milliseconds queueTimeout);
+
+    /// Явно запрещаем любое копирование данных.
+    AdmissionController(const AdmissionController& other) = delete;
+    AdmissionController& operator=(const AdmissionController& other) = delete;
+
+    /// Занимает место (при необходимости дожидаясь его в очереди). Пустой Permit - отказ.
+    boost::asio::awaitable<Permit> admit(boost::asio::io_context& context);
+
+private:
+    bool tryAcquire();
+    void release();
+
+private:
+    const std::size_t               m_maxInFlight;
+    const std::size_t               m_maxQueued;
+    const std::chrono::milliseconds m_queueTimeout;
+
+    std::atomic<std::size_t> m_inFlight {0};
+
+    std::mutex                          m_mutex;   //!< Защищает очередь.
+    std::deque<std::shared_ptr<Waiter>> m_waiters; //!< Ждущие места, по порядку прихода.
+};
+
+#endif //SERVER_ADMISSIONCONTROLLER_H
@@ -0,0 +1,99 @@
+#include "ComputePool.h"
+
+#include <algorithm>
+
+ComputePool::ComputePool(std::size_t threads)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (std::size_t i = 0; i < threads; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+        m_threads.emplace_back([this, i]() { work(i); });
+    }
+}
+
+ComputePool::~ComputePool()
+{
+    stop();
+}
+
+void ComputePool::stop()
+{
+    {
+        const std::lock_guard lock(m_sleepMutex);
+        if (m_stopped) return;
+        m_stopped = true;
+    }
+    m_wakeup.notify_all();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ComputePool::enqueue(std::unique_ptr<Task> task)
+{
+    // Счетчик увеличиваем до того, как задачу можно забрать, иначе он мог бы уйти ниже нуля.
+    // Поток, собравшийся спать, сначала отмечается в m_sleeping, потом проверяет m_pending;
+    // мы - наоборот. Хотя бы один из двоих увидит изменение другого, и задача не потеряется.
+    m_pending.fetch_add(1);
+
+    auto& queue = *m_queues[m_next.fetch_add(1, std::memory_order_relaxed) % m_queues.size()];
+    {
+        const std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    if (m_sleeping.load() != 0) {
+        { const std::lock_guard lock(m_sleepMutex); }
+        m_wakeup.notify_one();
+    }
+}
+
+std::unique_ptr<ComputePool::Task> ComputePool::take(const std::size_t index)
+{
+    {
+        auto& own = *m_queues[index];
+        const std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            auto task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return task;
+        }
+    }
+
+    // Своя очередь пуста - крадем самую позднюю задачу у соседей, начиная со следующего.
+    for (std::size_t offset = 1; offset < m_queues.size(); ++offset) {
+        auto& other = *m_queues[(index + offset) % m_queues.size()];
+        const std::lock_guard lock(other.mutex);
+        if (!other.tasks.empty()) {
+            auto task = std::move(other.tasks.back());
+            other.tasks.pop_back();
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+void ComputePool::work(const std::size_t index)
+{
+    while (true) {
+        if (auto task = take(index)) {
+            m_pending.fetch_sub(1);
+            task->run();
+            continue;
+        }
+
+        std::unique_lock lock(m_sleepMutex);
+        m_sleeping.fetch_add(1);
+        // Останавливаемся, только когда выполнены все поставленные задачи.
+        m_wakeup.wait(lock, [this]() { return m_pending.load() != 0 || m_stopped; });
+        m_sleeping.fetch_sub(1);
+        if (m_stopped && m_pending.load() == 0) return;
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef SERVER_COMPUTEPOOL_H
+#define SERVER_COMPUTEPOOL_H
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <exception>
+#include <type_traits>
+#include <condition_variable>
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/execution/outstanding_work.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/prefer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+/// Пул потоков для вычислений, общий для всех шардов: пока выражение считается, поток шарда
+/// обслуживает остальные соединения, а не ждет его.
+///
+/// У каждого потока своя очередь. Задачи раскладываются по очередям по кругу, поток берет
+/// задачи из начала своей, а опустев - крадет из конца чужих, так что одна долгая задача
+/// не задерживает те, что попали в очередь следом за ней. Спящие потоки будятся только
+/// тогда, когда они есть, поэтому при загруженном пуле постановка задачи - две короткие
+/// блокировки без системных вызовов.
+class ComputePool {
+
+    /// Задача с произвольным (в том числе только перемещаемым) обработчиком.
+    struct Task {
+        virtual ~Task() = default;
+        virtual void run() = 0;
+    };
+
+    template <typename Function>
+    struct TaskFor : Task {
+        explicit TaskFor(Function&& function) : m_function(std::move(function)) {}
+        void run() override { m_function(); }
+        Function m_function;
+    };
+
+public:
+    /// threads == 0 - по количеству ядер.
+    explicit ComputePool(std::size_t threads);
+    ~ComputePool();
+
+    /// Явно запрещаем любое копирование данных.
+    ComputePool(const ComputePool& other) = delete;
+    ComputePool& operator=(const ComputePool& other) = delete;
+
+    /// Выполняет function в пуле. Корутина продолжается в своем шарде, когда результат готов;
+    /// исключение из function пробрасывается в корутину.
+    template <typename Function>
+    boost::asio::awaitable<std::invoke_result_t<Function&>> run(Function function)
+    {
+        using Result = std::invoke_result_t<Function&>;
+
+        boost::asio::use_awaitable_t<> token;
+        return boost::asio::async_initiate<boost::asio::use_awaitable_t<>, void(std::exception_ptr, Result)>(
+                [this](auto handler, Function function) {
+                    // Шард не должен считать себя свободным, пока его корутина ждет пул.
+                    auto executor = boost::asio::prefer(boost::asio::get_associated_executor(handler),
+                                                        boost::asio::execution::outstanding_work.tracked);
+                    submit([handler  = std::move(handler),
+                            executor = std::move(executor),
+                            function = std::move(function)]() mutable {
+                        std::exception_ptr exception;
+                        Result result {};
+                        try {
+                            result = function();
+                        } catch (...) {
+                            exception = std::current_exception();
+                        }
+                        boost::asio::post(executor, [handler   = std::move(handler),
+                                                     exception = std::move(exception),
+                                                     result    = std::move(result)]() mutable {
+                            std::move(handler)(exception, std::move(result));
+                        });
+                    });
+                }, token, std::move(function));
+    }
+
+    /// Дожидается выполнения уже поставленных задач и останавливает потоки.
+    void stop();
+
+    std::size_t size() const { return m_threads.size(); }
+
+private:
+    template <typename Function>
+    void submit(Function&& function)
+    {
+        enqueue(std::make_unique<TaskFor<std::decay_t<Function>>>(std::forward<Function>(function)));
+    }
+    void enqueue(std::unique_ptr<Task> task);
+
+    /// Цикл потока index.
+    void work(std::size_t index);
+    /// Берет задачу из своей очереди, а если она пуста - из чужой.
+    std::unique_ptr<Task> take(std::size_t index);
+
+private:
+    struct alignas(64) Queue {
+        std::mutex                        mutex;
+        std::deque<std::unique_ptr<Task>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread>            m_threads;
+    std::atomic<std::size_t>            m_next {0};     //!< Очередь для следующей задачи.
+    std::atomic<std::size_t>            m_pending {0};  //!< Задачи во всех очередях.
+    std::atomic<std::size_t>            m_sleeping {0}; //!< Потоки, ждущие задач.
+    std::mutex                          m_sleepMutex;
+    std::condition_variable             m_wakeup;
+    bool                                m_stopped = false;
+};
+
+#endif //SERVER_COMPUTEPOOL_H
@@ -1,22 +1,118 @@
+#include <array>
+#include <charconv>
 #include <iostream>
+#include <utility>
+#include <algorithm>
 
-#include <tinyexpr.h>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
 
-#include <boost/bind.hpp>
-#include <boost/asio/placeholders.hpp>
-#include <boost/asio/spawn.hpp>
-
-#include "PostgreSQLDatabase.h"
+#include "Storage.h"
+#include "AdmissionController.h"
 #include "ConnectionPool.h"
+#include "Calculator.h"
 #include "Connection.h"
+#include "SessionRegistry.h"
+#include "ComputePool.h"
+#include "TraceWriter.h"
+#include "Metrics.h"
+#include "config.h"
+
+/// Считает команду обрабатываемой, пока жив.
+class InFlightGuard {
+public:
+    explicit InFlightGuard(Counter& counter) : mr_counter(counter) { mr_counter.add(1); }
+    ~InFlightGuard() { mr_counter.add(-1); }
+
+    InFlightGuard(const InFlightGuard& other) = delete;
+    InFlightGuard& operator=(const InFlightGuard& other) = delete;
+
+private:
+    Counter& mr_counter;
+};
+
+/// Закрытие соединения клиентом или сервером ошибкой не считаем.
+static bool isSocketError(const boost::system::error_code& errorCode)
+{
+    return errorCode != boost::asio::error::eof
+        && errorCode != boost::asio::error::connection_reset
+        && errorCode != boost::asio::error::operation_aborted;
+}
+
+/// Дописывает число в кратчайшей десятичной записи, которая однозначно его восстанавливает.
+static void appendNumber(std::string& output, const double value)
+{
+    std::array<char, 32> buffer;
+    const auto [end, error] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    output.append(buffer.data(), end);
+}
+
+/// Разбирает аргумент history: "[N] [время:id]". Без N - страница по умолчанию, без позиции -
+/// с самой новой записи.
+static bool parseHistoryArgument(std::string_view argument, std::size_t& limit,
+                                 std::optional<Storage::HistoryCursor>& cursor)
+{
+    limit = config::history::pageSize;
+    cursor.reset();
+
+    const auto parse = [](const std::string_view text, auto& value) {
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return error == std::errc() && end == text.data() + text.size();
+    };
+
+    const auto space = argument.find(' ');
+    if (const auto count = argument.substr(0, space); !count.empty()) {
+        if (!parse(count, limit) || limit == 0) return false;
+        limit = std::min(limit, config::history::maxPageSize);
+    }
+    if (space == std::string_view::npos) return true;
+
+    const auto position = argument.substr(space + 1);
+    const auto colon    = position.find(':');
+    if (colon == std::string_view::npos) return false;
+
+    Storage::HistoryCursor parsed {};
+    if (!parse(position.substr(0, colon), parsed.time) || !parse(position.substr(colon + 1), parsed.id)) {
+        return false;
+    }
+    cursor = parsed;
+    return true;
+}
+
+/// Дописывает время из микросекунд как секунды с шестью знаками после запятой.
+static void appendTime(std::string& output, const std::int64_t microseconds)
+{
+    const auto fraction = std::to_string(microseconds % 1000000);
+    output.append(std::to_string(microseconds / 1000000)).append(".").append(6 - fraction.size(), '0').append(fraction);
+}
 
 Connection::Connection(boost::asio::io_context& context,
-                       PostgreSQLDatabase& database,
-                       ConnectionPool& connectionPool)
+                       Storage& database,
+                       Calculator& calculator,
+                       ConnectionPool& connectionPool,
+                       AdmissionController& admission,
+                       Metrics& metrics,
+                       TimingWheel& timingWheel,
+                       const Timeouts& timeouts,
+                       SessionRegistry& sessions,
+                       ComputePool& compute,
+                       TraceWriter* trace)
                        : mr_context(context)
                        , mr_database(database)
+                       , mr_calculator(calculator)
                        , m_socket(context)
                        , mr_connectionPool(connectionPool)
+                       , mr_admission(admission)
+                       , mr_metrics(metrics)
+                       , mr_timingWheel(timingWheel)
+                       , mr_timeouts(timeouts)
+                       , mr_sessions(sessions)
+                       , mr_compute(compute)
+                       , m_trace(trace)
+                       , m_user()
                        , m_currentState(State::login) {}
 
 boost::asio::ip::tcp::socket &Connection::socket()
@@ -24,118 +120,619 @@ boost::asio::ip::tcp::socket &Connection::socket()
     return m_socket;
 }
 
-void Connection::read()
+boost::asio::awaitable<void> Connection::handle()
+{
+    boost::system::error_code errorCode;
+    auto awaitInto = boost::asio::redirect_error(boost::asio::use_awaitable, errorCode);
+
+    while (true) {
+        // Уведомление, пришедшее, пока команда обрабатывалась, отправляем до следующего чтения.
+        if (m_pendingBalance) {
+            m_writeBuffers.clear();
+            if (!co_await writeResponses()) break;
+        }
+
+        // Дочитываем данные в хвост буфера, при необходимости расширяя его.
+        if (m_request.size() - m_received < readChunkSize) {
+            m_request.resize(m_received + readChunkSize);
+        }
+
+        // Время чтения учитываем, только если ждем продолжения уже начатой команды:
+        // ожидание следующей команды - это простой клиента, а не задержка сервера.
+        const bool partial = m_received > 0;
+        const auto started = Metrics::Clock::now();
+        // Срок стоит только на ожидании клиента: пока команда обрабатывается, за сроки
+        // отвечают хранилище и AdmissionController.
+        armReadTimeout();
+        m_reading = true;
+        const auto bytesTransferred = co_await m_socket.async_read_some(
+                boost::asio::buffer(m_request.data() + m_received, m_request.size() - m_received),
+                awaitInto);
+        m_reading = false;
+        TimingWheel::cancel(*this);
+        if (errorCode) {
+            // Чтение прервано ради уведомления (см. pushBalance) - отправим его в начале цикла.
+            if (errorCode == boost::asio::error::operation_aborted && m_pendingBalance && m_socket.is_open()) {
+                continue;
+            }
+            if (isSocketError(errorCode)) mr_metrics.record(Metrics::Error::socket);
+            break;
+        }
+        if (partial) {
+            mr_metrics.record(Metrics::Stage::read, started);
+        }
+        // В трассу - ровно то, что пришло, вместе с кусками недочитанных команд.
+        if (m_trace) {
+            m_trace->record(trace::RecordType::in, m_traceConnection,
+                            boost::asio::buffer(m_request.data() + m_received, bytesTransferred));
+        }
+
+        m_received     += bytesTransferred;
+        m_responseCount = 0;
+
+        // Протокол определяется первым байтом соединения.
+        if (m_protocol == Protocol::unknown) {
+            if (static_cast<unsigned char>(m_request.front()) == protocol::binary::magic) {
+                m_protocol = Protocol::binary;
+                std::copy(m_request.begin() + 1, m_request.begin() + m_received, m_request.begin());
+                m_received -= 1;
+            } else {
+                m_protocol = Protocol::text;
+            }
+        }
+
+        const bool binary = m_protocol == Protocol::binary;
+        if (binary ? splitFrames() : splitRequests()) {
+            // Все команды из одного чтения обрабатываем строго по порядку,
+            // а ответы на них отправляем одной операцией записи.
+            for (const auto request : m_requests) {
+                if (binary) {
+                    co_await handleFrame(request, nextResponse());
+                } else {
+                    co_await handleRequest(request, nextResponse());
+                }
+            }
+        } else if (m_protocolError) {
+            mr_metrics.record(Metrics::Error::badRequest);
+            break;
+        } else if (binary) {
+            continue;
+        } else if (m_received >= maxRequestSize) {
+            // Команда еще не дочитана и подозрительно длинная - выбрасываем ее.
+            m_consumed     = m_received;
+            nextResponse() = "Некорректный запрос!\n";
+            mr_metrics.record(Metrics::Error::badRequest);
+        } else {
+            continue;
+        }
+
+        // Собираем все непустые ответы в одну операцию записи (gather write).
+        m_writeBuffers.clear();
+        for (std::size_t i = 0; i < m_responseCount; ++i) {
+            if (!m_responses[i].empty()) {
+                m_writeBuffers.push_back(boost::asio::buffer(m_responses[i]));
+            }
+        }
+
+        if (!co_await writeResponses()) break;
+        // После испорченного кадра границ следующих не найти - закрываем соединение.
+        if (m_protocolError) {
+            mr_metrics.record(Metrics::Error::badRequest);
+            break;
+        }
+
+        // Сдвигаем недочитанный хвост в начало буфера.
+        std::copy(m_request.begin() + m_consumed, m_request.begin() + m_received, m_request.begin());
+        m_received -= m_consumed;
+        m_consumed  = 0;
+
+        if (m_request.size() > keptBufferSize && m_received < readChunkSize) {
+            m_request.resize(readChunkSize);
+            m_request.shrink_to_fit();
+        }
+    }
+
+    unregisterSession();
+    if (m_trace) {
+        m_trace->record(trace::RecordType::close, m_traceConnection);
+    }
+    mr_connectionPool.remove(*this);
+}
+
+boost::asio::awaitable<bool> Connection::writeResponses()
+{
+    // Уведомление о балансе уходит вместе с ответами. Его порядок относительно ответов
+    // не важен: клиент узнает уведомление по виду ("balance ..." или opcode balance).
+    if (m_pendingBalance) {
+        using namespace protocol::binary;
+        if (m_protocol == Protocol::binary) {
+            beginResponse(m_push, static_cast<std::uint8_t>(Opcode::balance), 0, protocol::Status::ok,
+                          *m_pendingBalance);
+            finishResponse(m_push);
+        } else {
+            m_push = "balance " + std::to_string(*m_pendingBalance) + '\n';
+        }
+        m_pendingBalance.reset();
+        m_writeBuffers.push_back(boost::asio::buffer(m_push));
+    }
+
+    if (m_writeBuffers.empty()) co_return true;
+    if (m_trace) {
+        m_trace->record(trace::RecordType::out, m_traceConnection, m_writeBuffers);
+    }
+
+    boost::system::error_code errorCode;
+    const auto started = Metrics::Clock::now();
+    armTimeout(Metrics::Timeout::write, mr_timeouts.write, mr_timeouts.write);
+    co_await boost::asio::async_write(m_socket, m_writeBuffers,
+                                      boost::asio::redirect_error(boost::asio::use_awaitable, errorCode));
+    TimingWheel::cancel(*this);
+    if (errorCode) {
+        if (isSocketError(errorCode)) mr_metrics.record(Metrics::Error::socket);
+        co_return false;
+    }
+    mr_metrics.record(Metrics::Stage::write, started);
+
+    co_return true;
+}
+
+bool Connection::splitRequests()
 {
-    // Пока что считаем, что все работает корректно.
-    m_response = "";
-    m_socket.async_read_some(
-            boost::asio::buffer(m_request),
-            boost::bind(&Connection::handleRead,
-                    shared_from_this(),
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
+    // Нарезаем прочитанное на команды по символу конца строки ('\n'). Одно чтение может
+    // содержать несколько команд, а может - только кусок одной из них.
+    const std::string_view received(m_request.data(), m_received);
+    m_requests.clear();
+    m_consumed = 0;
+
+    for (auto end = received.find('\n'); end != std::string_view::npos; end = received.find('\n', m_consumed)) {
+        auto request = received.substr(m_consumed, end - m_consumed);
+        // Клиенты, присылающие "\r\n", тоже должны работать.
+        if (!request.empty() && request.back() == '\r') {
+            request.remove_suffix(1);
+        }
+        m_requests.push_back(request);
+        m_consumed = end + 1;
+    }
+
+    return !m_requests.empty();
+}
+
+bool Connection::splitFrames()
+{
+    // То же для двоичного протокола: кадры выделяем по длине из их заголовка.
+    using namespace protocol::binary;
+
+    const std::string_view received(m_request.data(), m_received);
+    m_requests.clear();
+    m_consumed = 0;
+
+    while (received.size() - m_consumed >= lengthSize) {
+        const auto length = readInteger(received.data() + m_consumed, lengthSize);
+        // Кадр с непосильной длиной не пропустить - дальше в потоке не найти границ кадров.
+        if (length < requestHeaderSize || length > maxRequestSize) {
+            m_protocolError = true;
+            break;
+        }
+        if (received.size() - m_consumed - lengthSize < length) break;
+
+        m_requests.push_back(received.substr(m_consumed + lengthSize, length));
+        m_consumed += lengthSize + length;
+    }
+
+    return !m_requests.empty();
 }
 
-void Connection::handleRead(const boost::system::error_code &errorCode, std::size_t bytesTransferred)
+boost::asio::awaitable<void> Connection::handleRequest(const std::string_view request, std::string& response)
 {
-    if (errorCode) return;
-    // Мы помещаем данные из буфера чтения в <string_view> (наблюдатель), но без последнего
-    // байта, так как он содержит в себе символ конца строки ('\n'), который нам не нужен.
-    const std::string_view request(m_request.data(), bytesTransferred - 1);
+    // Служебная команда, доступна в любом состоянии. Ответы приходят строго по порядку команд,
+    // поэтому "pong" означает, что все команды перед "ping" обработаны (на успешные login,
+    // password и calc сервер ничего не отвечает). Ею пользуется calc_loadgen.
+    if (request == "ping") {
+        response = "pong\n";
+        co_return;
+    }
+
+    const InFlightGuard inFlight(mr_metrics.inFlight());
+
     // Проверяем запрос пользователя на валидность.
-    if (!isValidRequest(m_currentState, request)) {
-        m_response = "Некорректный запрос!\n";
-        write();
-        return;
+    const auto validateStarted = Metrics::Clock::now();
+    const auto isValid = isValidRequest(m_currentState, request);
+    mr_metrics.record(Metrics::Stage::validate, validateStarted);
+    if (!isValid) {
+        mr_metrics.record(Metrics::Error::badRequest);
+        response = "Некорректный запрос!\n";
+        co_return;
     }
 
-    const auto coroutine = [&](boost::asio::yield_context yield) {
-        switch (m_currentState) {
-            case login:
-                m_user.login = shift(request, 6);
-                // Меняем состояние.
-                m_currentState = password;
-                break;
-            case password: {
-                m_user.password = shift(request, 9);
-                // Делаем запрос в базу данных.
-                const auto [id, balance] = mr_database.auth(m_user.login, m_user.password, yield);
-                // Пустое значение можно интерпретировать как отсутствие пользователя в базе данных.
-                // Прерываем операцию, возвращаемся к изначальному состоянию.
-                if (!id && !balance) {
-                    m_response = "Неверный логин или пароль! Попробуйте ещё раз!\n";
-                    m_currentState = login;
-                    break;
+    // Отрезаем название команды (состояние уже соответствует ей).
+    const auto state = m_currentState;
+    const auto status = co_await execute(state == logout ? std::string_view() : shift(request, commandLength(state)));
+
+    switch (status) {
+        case protocol::Status::ok:
+            // Отвечаем результатами пакета через ';' в порядке выражений.
+            if (state == calcbatch) {
+                for (std::size_t i = 0; i < m_batchResults.size(); ++i) {
+                    if (i != 0) response.push_back(';');
+                    appendNumber(response, m_batchResults[i]);
                 }
-                // Присваием пользователю идентификатор и баланс счета и переходим в состояние <calc>.
-                m_user.id              = *id;
-                m_user.account_balance = *balance;
-                // Меняем состояние.
-                m_currentState = calc;
-                break;
-            }
-            case calc: {
-                // Если у пользователя нулевой баланс, прерываем операцию.
-                if (m_user.account_balance <= 0) {
-                    m_response = "Недостаточно денях, извините ...\n";
-                    break;
+                response.push_back('\n');
+            }
+            // Заголовок страницы истории, затем по строке на запись.
+            if (state == history) {
+                response.append("history ").append(std::to_string(m_history.size()));
+                if (m_historyNext) {
+                    response.append(" ").append(std::to_string(m_historyNext->time))
+                            .append(":").append(std::to_string(m_historyNext->id));
                 }
-                // Пытаемся посчитать ...
-                int errorCode = 0;
-                m_user.expression         = shift(request, 5);
-                m_user.resultOfExpression = te_interp(m_user.expression.data(), &errorCode);
-                // Если ввели некорректные данные, прерываем операцию.
-                if (errorCode != 0) {
-                    m_response = "Вы ввели некорректное мат. выражение! Попробуйте ещё раз!\n";
-                    break;
+                response.push_back('\n');
+                for (const auto& entry : m_history) {
+                    appendTime(response, entry.time);
+                    response.append("\t").append(entry.expression).append("\t").append(entry.result).append("\n");
                 }
+            }
+            break;
+        case protocol::Status::badRequest:
+            response = "Некорректный запрос!\n";
+            break;
+        case protocol::Status::authFailed:
+            response = "Неверный логин или пароль! Попробуйте ещё раз!\n";
+            break;
+        case protocol::Status::badExpression:
+            response = state == calcbatch
+                    ? "Вы ввели некорректное мат. выражение №" + std::to_string(m_failedIndex + 1)
+                      + "! Попробуйте ещё раз!\n"
+                    : "Вы ввели некорректное мат. выражение! Попробуйте ещё раз!\n";
+            break;
+        case protocol::Status::tooLarge:
+            response = "Слишком много выражений в пакете!\n";
+            break;
+        case protocol::Status::insufficientFunds:
+            response = "Недостаточно денях, извините ...\n";
+            break;
+        case protocol::Status::busy:
+            response = "Сервер перегружен! Попробуйте позже!\n";
+            break;
+        case protocol::Status::storageError:
+            response = "Не удалось выполнить запрос! Попробуйте позже!\n";
+            break;
+        case protocol::Status::sessionLimit:
+            response = "Слишком много открытых сессий! Закройте одну из них и попробуйте ещё раз!\n";
+            break;
+    }
+}
+
+boost::asio::awaitable<void> Connection::handleFrame(const std::string_view frame, std::string& response)
+{
+    using namespace protocol::binary;
+
+    const auto opcode   = static_cast<std::uint8_t>(frame[0]);
+    const auto id       = static_cast<std::uint32_t>(readInteger(frame.data() + 1, sizeof(std::uint32_t)));
+    const auto argument = frame.substr(requestHeaderSize);
+
+    if (opcode == static_cast<std::uint8_t>(Opcode::ping)) {
+        beginResponse(response, opcode, id, protocol::Status::ok, m_user.account_balance);
+        finishResponse(response);
+        co_return;
+    }
+
+    const InFlightGuard inFlight(mr_metrics.inFlight());
+
+    // Проверяем, что команда допустима в текущем состоянии. Разбирать текст не нужно:
+    // тип команды - opcode, аргумент - остаток кадра.
+    const auto validateStarted = Metrics::Clock::now();
+    bool isValid = false;
+    switch (static_cast<Opcode>(opcode)) {
+        case Opcode::login:     isValid = acceptTransition(m_currentState, login);     break;
+        case Opcode::password:  isValid = acceptTransition(m_currentState, password);  break;
+        case Opcode::calc:      isValid = acceptTransition(m_currentState, calc);      break;
+        case Opcode::calcbatch: isValid = acceptTransition(m_currentState, calcbatch); break;
+        case Opcode::logout:    isValid = acceptTransition(m_currentState, logout);    break;
+        case Opcode::subscribe: isValid = acceptTransition(m_currentState, subscribe); break;
+        case Opcode::history:   isValid = acceptTransition(m_currentState, history);   break;
+        default:                break;
+    }
+    mr_metrics.record(Metrics::Stage::validate, validateStarted);
+
+    const auto state  = m_currentState;
+    auto       status = protocol::Status::badRequest;
+    if (isValid) {
+        status = co_await execute(argument);
+    } else {
+        mr_metrics.record(Metrics::Error::badRequest);
+    }
+
+    beginResponse(response, opcode, id, status, m_user.account_balance);
+    if (isValid && status == protocol::Status::ok && state == calc) {
+        appendDouble(response, m_user.resultOfExpression);
+    } else if (isValid && status == protocol::Status::ok && state == calcbatch) {
+        appendInteger(response, m_batchResults.size(), sizeof(std::uint32_t));
+        for (const auto result : m_batchResults) {
+            appendDouble(response, result);
+        }
+    } else if (isValid && status == protocol::Status::badExpression && state == calcbatch) {
+        appendInteger(response, m_failedIndex, sizeof(std::uint32_t));
+    } else if (isValid && status == protocol::Status::ok && state == history) {
+        appendInteger(response, m_history.size(), sizeof(std::uint32_t));
+        appendInteger(response, static_cast<std::uint64_t>(m_historyNext ? m_historyNext->time : 0), sizeof(std::int64_t));
+        appendInteger(response, static_cast<std::uint64_t>(m_historyNext ? m_historyNext->id : 0), sizeof(std::int64_t));
+        for (const auto& entry : m_history) {
+            appendInteger(response, static_cast<std::uint64_t>(entry.time), sizeof(entry.time));
+            appendInteger(response, entry.expression.size(), sizeof(std::uint32_t));
+            response.append(entry.expression);
+            appendInteger(response, entry.result.size(), sizeof(std::uint32_t));
+            response.append(entry.result);
+        }
+    }
+    finishResponse(response);
+}
 
-                m_user.account_balance--;
-                // Отправляем данные в базу данных.
-                mr_database.sendCalcResult(m_user.id, m_user.expression, m_user.resultOfExpression, yield);
-                mr_database.updateBalance(m_user.id, m_user.account_balance, yield);
+boost::asio::awaitable<protocol::Status> Connection::execute(const std::string_view argument)
+{
+    using protocol::Status;
 
-                break;
+    switch (m_currentState) {
+        case login:
+            m_user.login = argument;
+            // Меняем состояние.
+            m_currentState = password;
+            co_return Status::ok;
+        case password: {
+            m_user.password = argument;
+            // Если хранилище перегружено, отказываем сразу: пароль можно прислать еще раз.
+            const auto permit = co_await mr_admission.admit(mr_context);
+            if (!permit) {
+                mr_metrics.record(Metrics::Error::busy);
+                co_return Status::busy;
             }
-            case logout:
-                // Меняем состояние на изначальное, т.е. на <login>.
+            // Делаем запрос в базу данных.
+            const auto started = Metrics::Clock::now();
+            const auto [id, balance] = co_await mr_database.auth(mr_context, m_user.login, m_user.password);
+            mr_metrics.record(Metrics::Stage::auth, started);
+            // Пустое значение можно интерпретировать как отсутствие пользователя в базе данных.
+            // Прерываем операцию, возвращаемся к изначальному состоянию.
+            if (!id && !balance) {
+                mr_metrics.record(Metrics::Error::authFailed);
                 m_currentState = login;
-                break;
+                co_return Status::authFailed;
+            }
+            // Присваием пользователю идентификатор и баланс счета и переходим в состояние <calc>.
+            m_user.id              = *id;
+            m_user.account_balance = *balance;
+            // У пользователя может быть не больше net.max_sessions_per_user сессий.
+            if (!mr_sessions.add(m_user.id, *this, mr_context)) {
+                mr_metrics.record(Metrics::Error::sessionLimit);
+                m_currentState = login;
+                co_return Status::sessionLimit;
+            }
+            m_registered = true;
+            // Меняем состояние.
+            m_currentState = calc;
+            co_return Status::ok;
         }
+        case calc: {
+            // Пытаемся посчитать (или достаем уже посчитанное из кэша) ...
+            m_user.expression = argument;
+            const auto evaluateStarted = Metrics::Clock::now();
+            // Из кэша берем сразу, а считаем в пуле потоков: поток шарда тем временем
+            // обслуживает остальные соединения.
+            Calculator::CacheKey key;
+            auto evaluated = mr_calculator.cached(m_user.expression, key);
+            if (!evaluated) {
+                evaluated = co_await mr_compute.run([this, &key]() {
+                    return mr_calculator.evaluateUncached(m_user.expression, key);
+                });
+            }
+            const auto [result, errorCode] = *evaluated;
+            mr_metrics.record(Metrics::Stage::evaluate, evaluateStarted);
+            m_user.resultOfExpression = result;
+            // Если ввели некорректные данные, прерываем операцию.
+            if (errorCode != 0) {
+                mr_metrics.record(Metrics::Error::badExpression);
+                co_return Status::badExpression;
+            }
 
-        // Помещаем в очередь задачу на запись и отправку данных пользователю.
-        write();
-    };
+            const auto permit = co_await mr_admission.admit(mr_context);
+            if (!permit) {
+                mr_metrics.record(Metrics::Error::busy);
+                co_return Status::busy;
+            }
+            // Списываем деньги и записываем результат одним запросом. Баланс проверяет сама база,
+            // поэтому закэшированное при входе значение не может затереть чужие изменения.
+            const auto chargeStarted = Metrics::Clock::now();
+            const auto [status, balance] = co_await mr_database.chargeAndLog(mr_context, m_user.id, m_user.expression,
+                                                                             m_user.resultOfExpression);
+            mr_metrics.record(Metrics::Stage::charge, chargeStarted);
+            co_return chargeStatus(status, balance);
+        }
+        case calcbatch: {
+            // После пакета остаемся в состоянии <calc>.
+            m_currentState = calc;
+            // Считаем весь пакет. Формула с переменными разбирается один раз.
+            const auto evaluateStarted = Metrics::Clock::now();
+            // Пакет считается в пуле потоков целиком. Буфер чтения (argument) и векторы пакета
+            // до возвращения корутины никто не трогает.
+            const auto [batchStatus, failedIndex] = co_await mr_compute.run([this, argument]() {
+                return mr_calculator.evaluateBatch(argument, m_batchExpressions, m_batchResults);
+            });
+            mr_metrics.record(Metrics::Stage::evaluate, evaluateStarted);
+            if (batchStatus == Calculator::BatchStatus::badSyntax) {
+                mr_metrics.record(Metrics::Error::badRequest);
+                co_return Status::badRequest;
+            }
+            if (batchStatus == Calculator::BatchStatus::tooLarge) {
+                mr_metrics.record(Metrics::Error::badRequest);
+                co_return Status::tooLarge;
+            }
+            if (batchStatus == Calculator::BatchStatus::badExpression) {
+                m_failedIndex = failedIndex;
+                mr_metrics.record(Metrics::Error::badExpression);
+                co_return Status::badExpression;
+            }
+
+            const auto permit = co_await mr_admission.admit(mr_context);
+            if (!permit) {
+                mr_metrics.record(Metrics::Error::busy);
+                co_return Status::busy;
+            }
+            // Списываем деньги за весь пакет и записываем результаты одной операцией.
+            const auto chargeStarted = Metrics::Clock::now();
+            const auto [status, balance] = co_await mr_database.chargeAndLogBatch(mr_context, m_user.id,
+                                                                                  m_batchExpressions,
+                                                                                  m_batchResults);
+            mr_metrics.record(Metrics::Stage::charge, chargeStarted);
+            co_return chargeStatus(status, balance);
+        }
+        case subscribe:
+            // Дальше клиент получает уведомления, когда баланс меняют другие его сессии.
+            m_currentState = calc;
+            if (!m_subscribed) {
+                m_subscribed = true;
+                mr_sessions.subscribe(m_user.id, *this);
+            }
+            co_return Status::ok;
+        case history: {
+            // После страницы истории остаемся в состоянии <calc>.
+            m_currentState = calc;
+            std::size_t                           limit = 0;
+            std::optional<Storage::HistoryCursor> before;
+            if (!parseHistoryArgument(argument, limit, before)) {
+                mr_metrics.record(Metrics::Error::badRequest);
+                co_return Status::badRequest;
+            }
+
+            const auto permit = co_await mr_admission.admit(mr_context);
+            if (!permit) {
+                mr_metrics.record(Metrics::Error::busy);
+                co_return Status::busy;
+            }
+            // Страница ищется по позиции предыдущей, поэтому листать можно сколь угодно далеко.
+            const auto started = Metrics::Clock::now();
+            auto entries = co_await mr_database.history(mr_context, m_user.id, before, limit);
+            mr_metrics.record(Metrics::Stage::history, started);
+            if (!entries) {
+                mr_metrics.record(Metrics::Error::storage);
+                co_return Status::storageError;
+            }
 
-    boost::asio::spawn(mr_context, coroutine);
+            m_history = std::move(*entries);
+            // Неполная страница - последняя. Полная может оказаться и последней: тогда
+            // следующая придет пустой.
+            m_historyNext.reset();
+            if (m_history.size() == limit) {
+                m_historyNext = Storage::HistoryCursor {m_history.back().time, m_history.back().id};
+            }
+            co_return Status::ok;
+        }
+        case logout:
+            unregisterSession();
+            // Меняем состояние на изначальное, т.е. на <login>. Срок входа начинается заново.
+            m_currentState     = login;
+            m_handshakeStarted = TimingWheel::Clock::now();
+            co_return Status::ok;
+    }
+
+    co_return Status::badRequest;
 }
 
-void Connection::write()
+protocol::Status Connection::chargeStatus(const Storage::ChargeStatus status, const std::int32_t balance)
 {
-    m_socket.async_write_some(
-            boost::asio::buffer(m_response),
-            boost::bind(&Connection::handleWrite,
-                        shared_from_this(),
-                        boost::asio::placeholders::error,
-                        boost::asio::placeholders::bytes_transferred)
-    );
+    // Если у пользователя нулевой баланс, прерываем операцию.
+    if (status == Storage::ChargeStatus::insufficientFunds) {
+        mr_metrics.record(Metrics::Error::insufficientFunds);
+        return protocol::Status::insufficientFunds;
+    }
+    if (status == Storage::ChargeStatus::failed) {
+        mr_metrics.record(Metrics::Error::storage);
+        return protocol::Status::storageError;
+    }
+
+    m_user.account_balance = balance;
+    mr_sessions.publishBalance(m_user.id, balance, this);
+    return protocol::Status::ok;
 }
 
-void Connection::handleWrite(const boost::system::error_code &code, std::size_t bytesTransferred)
+std::string& Connection::nextResponse()
 {
-    if (code) {
-        mr_connectionPool.remove(shared_from_this());
+    // Строки ответов переиспользуются между чтениями, чтобы не выделять память заново.
+    if (m_responseCount == m_responses.size()) {
+        m_responses.emplace_back();
     }
 
-    read();
+    auto& response = m_responses[m_responseCount++];
+    response.clear();
+
+    return response;
 }
 
 void Connection::startHandling()
 {
-    read();
+    m_handshakeStarted = TimingWheel::Clock::now();
+    if (m_trace) {
+        m_traceConnection = m_trace->nextConnection();
+        m_trace->record(trace::RecordType::open, m_traceConnection);
+    }
+    // Корутина держит соединение живым, пока не завершится.
+    boost::asio::co_spawn(mr_context, [self = shared_from_this()]() { return self->handle(); },
+                          boost::asio::detached);
 }
 
 void Connection::stopHandling()
 {
     m_socket.close();
+}
+
+void Connection::pushBalance(const std::int32_t balance)
+{
+    if (!m_subscribed) return;
+
+    // Уведомления не копятся: клиенту важен только последний баланс.
+    m_pendingBalance = balance;
+    // Соединение ждет команду - прерываем чтение, чтобы корутина отправила уведомление сразу.
+    if (m_reading) {
+        boost::system::error_code errorCode;
+        m_socket.cancel(errorCode);
+    }
+}
+
+void Connection::unregisterSession()
+{
+    if (!m_registered) return;
+
+    mr_sessions.remove(m_user.id, *this);
+    m_registered = false;
+    m_subscribed = false;
+    m_pendingBalance.reset();
+}
+
+void Connection::onTimeout()
+{
+    mr_metrics.record(m_timeoutKind);
+    // Ожидающая операция сокета завершится с operation_aborted, и корутина соединения
+    // уберет его из пула.
+    stopHandling();
+}
+
+void Connection::armReadTimeout()
+{
+    if (m_currentState == login || m_currentState == password) {
+        // Срок входа не продлевается от команды к команде: иначе клиент, присылающий неверные
+        // пароли (или команду по байту), держал бы соединение сколько угодно.
+        const auto elapsed = TimingWheel::Clock::now() - m_handshakeStarted;
+        armTimeout(Metrics::Timeout::handshake, mr_timeouts.handshake - elapsed, mr_timeouts.handshake);
+    } else {
+        armTimeout(Metrics::Timeout::idle, mr_timeouts.idle, mr_timeouts.idle);
+    }
+}
+
+void Connection::armTimeout(const Metrics::Timeout kind, const TimingWheel::Clock::duration timeout,
+                            const std::chrono::milliseconds limit)
+{
+    if (limit.count() == 0) {
+        TimingWheel::cancel(*this);
+        return;
+    }
+
+    m_timeoutKind = kind;
+    mr_timingWheel.schedule(*this, timeout);
 }
\ No newline at end of file
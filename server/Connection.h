@@ -1,22 +1,59 @@
 #ifndef SERVER_SESSION_H
 #define SERVER_SESSION_H
 
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <optional>
+#include <string_view>
+
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/intrusive/list_hook.hpp>
 
-#include "PostgreSQLDatabase.h"
+#include "Storage.h"
+#include "Protocol.h"
+#include "TimingWheel.h"
+#include "Metrics.h"
 #include "models/Structures.h"
 
-class PostgreSQLDatabase;
+class Storage;
 class ConnectionPool;
+class Calculator;
+class AdmissionController;
+class SessionRegistry;
+class ComputePool;
+class TraceWriter;
+
+/// Хук интрузивного списка соединений (ConnectionPool). При разрушении соединение
+/// само исключает себя из списка.
+using ConnectionHook = boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>>;
 
-class Connection : public std::enable_shared_from_this<Connection> {
+/// Соединение с клиентом. Его сроки (вход, простой, отправка ответа) стоят на колесе таймеров
+/// шарда: соединение само является записью колеса, так что отдельных таймеров у него нет.
+class Connection : public std::enable_shared_from_this<Connection>, public ConnectionHook, public TimingWheel::Entry {
 
 public:
+    /// Сроки соединения. 0 - без ограничения.
+    struct Timeouts {
+        std::chrono::milliseconds handshake; //!< От подключения (или logout) до успешного входа.
+        std::chrono::milliseconds idle;      //!< Ожидание следующей команды.
+        std::chrono::milliseconds write;     //!< Отправка ответов.
+    };
+
     /// Параметризированный конструктор класса.
     explicit Connection(boost::asio::io_context& context,
-                        PostgreSQLDatabase& database,
-                        ConnectionPool& connectionPool);
+                        Storage& database,
+                        Calculator& calculator,
+                        ConnectionPool& connectionPool,
+                        AdmissionController& admission,
+                        Metrics& metrics,
+                        TimingWheel& timingWheel,
+                        const Timeouts& timeouts,
+                        SessionRegistry& sessions,
+                        ComputePool& compute,
+                        TraceWriter* trace);
 
     /// Явно запрещаем любое копирование данных.
     Connection(const Connection& other) = delete;
@@ -27,53 +64,157 @@ public:
     void startHandling();
     /// Прекращает обработку соединений.
     void stopHandling();
+    /// Срок истек: закрывает соединение.
+    void onTimeout() override;
+    /// Баланс пользователя изменила другая его сессия. Вызывается в шарде соединения
+    /// (SessionRegistry::publishBalance); подписанному клиенту уходит уведомление.
+    void pushBalance(std::int32_t balance);
 
     /// Возвращает сокет.
     boost::asio::ip:: tcp::socket& socket();
 
-    /// Кладет в асинхронную очередь задачи на чтение данных из сокета.
-    void read();
-    /// Кладет в асинхронную очередь задачи на запись данных в сокет.
-    void write();
-
-    /** Задачи, которые закидываются в очередь. */
+    enum State : uint8_t  { login = 0, password, calc, logout = 4, calcbatch, subscribe, history };
+    enum class Protocol : uint8_t { unknown = 0, text, binary };
 
-    void handleRead(const boost::system::error_code& code, std::size_t bytes);
-    void handleWrite(const boost::system::error_code& code, std::size_t bytes);
-
-    enum State : uint8_t  { login = 0, password, calc, logout = 4};
+private:
+    /// Корутина соединения: читает команды, обрабатывает их и отправляет ответы, пока
+    /// соединение не закроется. Одна на все время жизни соединения.
+    boost::asio::awaitable<void> handle();
+    /// Нарезает прочитанное на команды (m_requests). Возвращает false, если не найдено ни одной.
+    bool splitRequests();
+    /// То же для кадров двоичного протокола. При испорченном кадре выставляет m_protocolError.
+    bool splitFrames();
+    /// Обрабатывает одну текстовую команду и записывает ответ на нее в response.
+    boost::asio::awaitable<void> handleRequest(std::string_view request, std::string& response);
+    /// Обрабатывает один кадр двоичного протокола (без поля длины) и записывает кадр ответа.
+    boost::asio::awaitable<void> handleFrame(std::string_view frame, std::string& response);
+    /// Выполняет команду, которой соответствует текущее (уже проверенное) состояние.
+    /// Протокол тут не важен: argument - аргумент команды, ответ формирует вызывающий.
+    boost::asio::awaitable<protocol::Status> execute(std::string_view argument);
+    /// Переводит результат списания в исход команды и запоминает новый баланс.
+    protocol::Status chargeStatus(Storage::ChargeStatus status, std::int32_t balance);
+    /// Возвращает очищенную строку под очередной ответ.
+    std::string& nextResponse();
+    /// Отправляет m_writeBuffers (и ждущее уведомление о балансе) одной операцией записи.
+    /// false - соединение надо закрыть.
+    boost::asio::awaitable<bool> writeResponses();
+    /// Выписывает сессию из реестра (logout или закрытие соединения).
+    void unregisterSession();
+    /// Ставит срок на ожидание команды: до входа - остаток срока входа, после - срок простоя.
+    void armReadTimeout();
+    /// Ставит срок timeout вида kind. Нулевой limit (срок из настроек) - без ограничения.
+    void armTimeout(Metrics::Timeout kind, TimingWheel::Clock::duration timeout, std::chrono::milliseconds limit);
+
+    static constexpr std::size_t readChunkSize  = 4096;      //!< Минимум свободного места под чтение.
+    static constexpr std::size_t maxRequestSize = 64 * 1024; //!< Максимальная длина одной команды.
+    /// Буфер чтения больше этого размера после длинной команды ужимается обратно -
+    /// иначе простаивающие соединения держали бы память под самую длинную команду.
+    static constexpr std::size_t keptBufferSize = 4 * readChunkSize;
 
 private:
     boost::asio::ip::tcp::socket m_socket;   //!< Сокет.
     boost::asio::io_context&     mr_context; //!< Ссылка на обработчик.
-    std::string           m_response; //!< Хранит данные для записи в сокет.
-    std::array<char, 512> m_request;  //!< Содержит данные чтения из сокета.
 
-    PostgreSQLDatabase& mr_database; //!< База данных.
+    std::string                   m_request;      //!< Растущий буфер чтения из сокета.
+    std::size_t                   m_received = 0; //!< Сколько байт в буфере чтения занято данными.
+    std::size_t                   m_consumed = 0; //!< Сколько байт уже разобрано на команды.
+    std::vector<std::string_view> m_requests;     //!< Команды, выделенные из одного чтения.
+
+    std::vector<std::string>               m_responses;         //!< Ответы на команды из одного чтения.
+    std::size_t                            m_responseCount = 0; //!< Сколько ответов заполнено.
+    std::vector<boost::asio::const_buffer> m_writeBuffers;      //!< Буферы для одной операции записи.
+
+    std::vector<std::string> m_batchExpressions; //!< Выражения пакета calcbatch.
+    std::vector<double>      m_batchResults;     //!< Результаты пакета calcbatch.
+    std::size_t              m_failedIndex = 0;  //!< Номер некорректного выражения пакета.
+
+    std::vector<Storage::HistoryEntry>     m_history;     //!< Страница истории (команда history).
+    std::optional<Storage::HistoryCursor>  m_historyNext; //!< Позиция следующей страницы, если она есть.
+
+    Protocol m_protocol      = Protocol::unknown; //!< Определяется по первому байту соединения.
+    bool     m_protocolError = false;             //!< Пришел кадр, после которого поток не разобрать.
+
+    bool                        m_registered = false; //!< Сессия записана в SessionRegistry.
+    bool                        m_subscribed = false; //!< Клиент ждет уведомлений о балансе.
+    bool                        m_reading    = false; //!< Корутина ждет данных от клиента.
+    std::optional<std::int32_t> m_pendingBalance;     //!< Неотправленное уведомление (только последнее).
+    std::string                 m_push;               //!< Буфер отправляемого уведомления.
+
+    Storage&            mr_database; //!< Хранилище пользователей и журнала.
+    Calculator&         mr_calculator; //!< Калькулятор с кэшем результатов.
     ConnectionPool&     mr_connectionPool; //!< Ссылка на коллекция подключений.
+    AdmissionController& mr_admission; //!< Ограничение одновременных операций с хранилищем.
+    Metrics&            mr_metrics;    //!< Метрики сервера.
+    TimingWheel&        mr_timingWheel; //!< Колесо таймеров шарда.
+    const Timeouts&     mr_timeouts;    //!< Сроки соединения.
+
+    SessionRegistry&    mr_sessions;    //!< Сессии пользователей всех шардов.
+    ComputePool&        mr_compute;     //!< Потоки для вычисления выражений.
+    TraceWriter*        m_trace;        //!< Запись трассы трафика (nullptr - выключена).
+    std::uint32_t       m_traceConnection = 0; //!< Номер соединения в трассе.
+
+    Metrics::Timeout               m_timeoutKind = Metrics::Timeout::idle; //!< Какой срок сейчас стоит.
+    TimingWheel::Clock::time_point m_handshakeStarted;                      //!< Начало входа.
     User  m_user;         //!< Пользователь.
     State m_currentState; //!< Текущее состояние.
 };
 
-static std::string shift(const std::string_view unhandled, uint8_t n)
+/// Длина названия текстовой команды вместе с пробелом после него.
+static std::uint8_t commandLength(const Connection::State state)
+{
+    switch (state) {
+        case Connection::State::login:     return 6;
+        case Connection::State::password:  return 9;
+        case Connection::State::calc:      return 5;
+        case Connection::State::calcbatch: return 10;
+        case Connection::State::history:   return 8;
+        default:                           return 0;
+    }
+}
+
+/// Отрезает от команды ее название. Результат присваивается в уже существующие строки,
+/// поэтому их память переиспользуется от запроса к запросу.
+static std::string_view shift(const std::string_view unhandled, uint8_t n)
 {
-    return {unhandled.data() + n, unhandled.size() - n};
+    return unhandled.substr(std::min<std::size_t>(n, unhandled.size()));
 };
 
+/// Проверяет, что команда requestType допустима в состоянии currectState, и переводит в него.
+static bool acceptTransition(Connection::State& currectState, const Connection::State requestType)
+{
+    if (requestType == Connection::State::logout && currectState == Connection::State::calc) {
+        currectState = Connection::State::logout;
+        return true;
+    }
+
+    // Пакетное вычисление и подписка доступны там же, где и обычное вычисление.
+    if (requestType == Connection::State::calcbatch && currectState == Connection::State::calc) {
+        currectState = Connection::State::calcbatch;
+        return true;
+    }
+    if (requestType == Connection::State::subscribe && currectState == Connection::State::calc) {
+        currectState = Connection::State::subscribe;
+        return true;
+    }
+    if (requestType == Connection::State::history && currectState == Connection::State::calc) {
+        currectState = Connection::State::history;
+        return true;
+    }
+
+    return currectState == requestType;
+}
+
 static auto isValidRequest(Connection::State& currectState, const std::string_view request)
 {
-    const auto isLessThanTwoWords = [&request]() {
+    const auto isLessThanTwoWords = [&request](unsigned short maxSpaces) {
         unsigned short spaceCount = 0;
         for (const auto& character : request) {
             if (isspace(character)) { spaceCount++; }
         }
 
-        return (spaceCount <= 1);
+        return (spaceCount <= maxSpaces);
     };
 
-    // Если больше двух пробелов, то можем считать запрос некорректным.
-    if (!isLessThanTwoWords()) return false;
-
     Connection::State requestType;
 
     if (const auto login_position = request.find("login "); login_position == 0) {
@@ -82,18 +223,22 @@ static auto isValidRequest(Connection::State& currectState, const std::string_vi
         requestType = Connection::State::password;
     } else if (const auto calc_position = request.find("calc "); calc_position == 0) {
         requestType = Connection::State::calc;
+    } else if (const auto calcbatch_position = request.find("calcbatch "); calcbatch_position == 0) {
+        requestType = Connection::State::calcbatch;
     } else if (const auto logout_position = request.find("logout"); logout_position == 0) {
         requestType = Connection::State::logout;
+    } else if (const auto subscribe_position = request.find("subscribe"); subscribe_position == 0) {
+        requestType = Connection::State::subscribe;
+    } else if (const auto history_position = request.find("history"); history_position == 0) {
+        requestType = Connection::State::history;
     } else {
         return false;
     }
 
-    if (requestType == Connection::State::logout && currectState == Connection::State::calc) {
-        currectState = Connection::State::logout;
-        return true;
-    }
+    // Если больше двух слов (у history - трех), то можем считать запрос некорректным.
+    if (!isLessThanTwoWords(requestType == Connection::State::history ? 2 : 1)) return false;
 
-    return currectState == requestType;
+    return acceptTransition(currectState, requestType);
 }
 
 #endif //SERVER_SESSION_H
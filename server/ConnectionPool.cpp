@@ -1,25 +1,32 @@
 #include "ConnectionPool.h"
-#include "Connection.h"
 
-#include <iostream>
+ConnectionPool::ConnectionPool(Counter& connections)
+                               : mr_connectionCount(connections) {}
 
-void ConnectionPool::insert(ConnectionPool::ConnectionPtr connection)
+void ConnectionPool::insert(Connection& connection)
 {
-    m_connections.insert(connection);
-    connection->startHandling();
+    m_connections.push_back(connection);
+    mr_connectionCount.add(1);
+    connection.startHandling();
 }
 
-void ConnectionPool::remove(ConnectionPool::ConnectionPtr connection)
+void ConnectionPool::remove(Connection& connection)
 {
-    m_connections.erase(connection);
-    connection->stopHandling();
+    if (connection.ConnectionHook::is_linked()) {
+        m_connections.erase(m_connections.iterator_to(connection));
+        mr_connectionCount.add(-1);
+    }
+    connection.stopHandling();
 }
 
 void ConnectionPool::removeAll()
 {
+    std::int64_t count = 0;
     for (auto &connection : m_connections) {
-        connection->stopHandling();
+        connection.stopHandling();
+        ++count;
     }
 
     m_connections.clear();
+    mr_connectionCount.add(-count);
 }
\ No newline at end of file
@@ -1,30 +1,34 @@
 #ifndef SERVER_CONNECTIONPOOL_H
 #define SERVER_CONNECTIONPOOL_H
 
-#include <set>
-#include <memory>
+#include <boost/intrusive/list.hpp>
 
-/// Forward-declaration
-class Connection;
+#include "Connection.h"
+#include "Metrics.h"
 
 /// Занимается управлением соединений.
-/// @todo 1. Сделать поиск по ключу (в моем случае это будет пользователь).
-/// @todo 2. Сделать из него Singleton.
+/// Соединения связаны в интрузивный список: добавление и удаление - O(1) без выделения памяти.
+/// Пул не владеет соединениями (ими владеют их асинхронные операции), а разрушенное
+/// соединение само исключает себя из списка.
+/// Соединения пользователя (общие для всех шардов) ищутся в SessionRegistry.
+/// @todo 1. Сделать из него Singleton.
 class ConnectionPool {
 
-    using ConnectionPtr = std::shared_ptr<Connection>;
+    using ConnectionList = boost::intrusive::list<Connection, boost::intrusive::constant_time_size<false>>;
 
 public:
-    ConnectionPool() = default;
+    /// connections - счетчик открытых соединений в метриках.
+    explicit ConnectionPool(Counter& connections);
     ConnectionPool(const ConnectionPool& other) = delete;
     ConnectionPool& operator=(const ConnectionPool& other) = delete;
 
-    void insert(ConnectionPtr connection);
-    void remove(ConnectionPtr connection);
+    void insert(Connection& connection);
+    void remove(Connection& connection);
     void removeAll();
 
 private:
-    std::set<ConnectionPtr> m_connections; //!< Коллекция активных соединений
+    ConnectionList m_connections; //!< Коллекция активных соединений
+    Counter&       mr_connectionCount;
 };
 
 
@@ -0,0 +1,66 @@
+#include "ConnectionSlab.h"
+
+#include <new>
+#include <algorithm>
+
+/// Округляет размер до блока с выравниванием как у operator new.
+static std::size_t blockSizeFor(std::size_t size)
+{
+    constexpr auto alignment = alignof(std::max_align_t);
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+ConnectionSlab::ConnectionSlab(std::size_t blocksPerChunk)
+                               : m_blocksPerChunk(std::max<std::size_t>(blocksPerChunk, 1)) {}
+
+void* ConnectionSlab::allocate(std::size_t size)
+{
+    // Размер блока определяется первым выделением.
+    if (m_blockSize == 0) {
+        m_blockSize = blockSizeFor(std::max(size, sizeof(FreeBlock)));
+    }
+
+    if (blockSizeFor(size) != m_blockSize) {
+        return ::operator new(size);
+    }
+
+    --m_available;
+    if (m_free != nullptr) {
+        auto* block = m_free;
+        m_free = block->next;
+        return block;
+    }
+
+    if (m_next == m_end) {
+        grow();
+    }
+    auto* block = m_next;
+    m_next += m_blockSize;
+
+    return block;
+}
+
+void ConnectionSlab::deallocate(void* block, std::size_t size) noexcept
+{
+    if (blockSizeFor(size) != m_blockSize) {
+        ::operator delete(block);
+        return;
+    }
+
+    auto* freeBlock = static_cast<FreeBlock*>(block);
+    freeBlock->next = m_free;
+    m_free = freeBlock;
+    ++m_available;
+}
+
+void ConnectionSlab::grow()
+{
+    // Память не зануляем и не размечаем: блоки отрезаются в allocate, и страница куска
+    // впервые трогается, только когда в нее попадает соединение.
+    std::unique_ptr<std::byte[]> chunk(new std::byte[m_blockSize * m_blocksPerChunk]);
+    m_next = chunk.get();
+    m_end  = m_next + m_blockSize * m_blocksPerChunk;
+
+    m_available += m_blocksPerChunk;
+    m_chunks.push_back(std::move(chunk));
+}
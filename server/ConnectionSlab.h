@@ -0,0 +1,92 @@
+#ifndef SERVER_CONNECTIONSLAB_H
+#define SERVER_CONNECTIONSLAB_H
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+/// Пул блоков одинакового размера под соединения одного шарда.
+/// Память берется у системы кусками по blocksPerChunk блоков и больше не возвращается:
+/// освобожденный блок попадает в список свободных и отдается следующему соединению.
+/// Новый кусок на блоки заранее не нарезается - блоки отрезаются от него по одному, когда
+/// список свободных пуст, поэтому его страницы трогаются только по мере прихода соединений.
+/// Не потокобезопасен - каждый шард (поток) держит свой пул.
+class ConnectionSlab {
+
+public:
+    explicit ConnectionSlab(std::size_t blocksPerChunk);
+    ~ConnectionSlab() = default;
+
+    ConnectionSlab(const ConnectionSlab& other) = delete;
+    ConnectionSlab& operator=(const ConnectionSlab& other) = delete;
+
+    /// Выдает блок размером size байт. Размер задается первым вызовом, блоки другого
+    /// размера обслуживает обычный operator new.
+    void* allocate(std::size_t size);
+    void  deallocate(void* block, std::size_t size) noexcept;
+
+    /// Сколько блоков выделено у системы и сколько из них сейчас свободно.
+    std::size_t capacity() const { return m_chunks.size() * m_blocksPerChunk; }
+    std::size_t available() const { return m_available; }
+
+private:
+    /// Свободный блок хранит в себе указатель на следующий свободный.
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    void grow();
+
+private:
+    std::size_t m_blocksPerChunk;
+    std::size_t m_blockSize = 0;
+    std::size_t m_available = 0;
+    FreeBlock*  m_free      = nullptr;
+    std::byte*  m_next      = nullptr; //!< Первый еще не выданный блок последнего куска.
+    std::byte*  m_end       = nullptr; //!< Конец последнего куска.
+
+    std::vector<std::unique_ptr<std::byte[]>> m_chunks;
+};
+
+/// Аллокатор для std::allocate_shared: объект и его счетчик ссылок живут в одном блоке пула.
+/// Держит пул через shared_ptr - блок хранит копию аллокатора, поэтому пул не умрет раньше
+/// последнего соединения, даже если то переживет свой сервер (обработчик в очереди io_context).
+template <typename T>
+class SlabAllocator {
+
+public:
+    using value_type = T;
+
+    explicit SlabAllocator(std::shared_ptr<ConnectionSlab> slab) noexcept : m_slab(std::move(slab)) {}
+
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U>& other) noexcept : m_slab(other.m_slab) {}
+
+    T* allocate(std::size_t n)
+    {
+        if (n != 1) return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(m_slab->allocate(sizeof(T)));
+    }
+
+    void deallocate(T* pointer, std::size_t n) noexcept
+    {
+        if (n != 1) {
+            ::operator delete(pointer);
+            return;
+        }
+        m_slab->deallocate(pointer, sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const SlabAllocator<U>& other) const noexcept { return m_slab == other.m_slab; }
+    template <typename U>
+    bool operator!=(const SlabAllocator<U>& other) const noexcept { return m_slab != other.m_slab; }
+
+private:
+    template <typename U> friend class SlabAllocator;
+
+    std::shared_ptr<ConnectionSlab> m_slab;
+};
+
+
+#endif //SERVER_CONNECTIONSLAB_H
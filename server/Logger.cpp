@@ -0,0 +1,204 @@
+#include "Logger.h"
+
+#include <ctime>
+#include <system_error>
+
+namespace {
+    constexpr const char* levelNames[] = {"debug", "info", "warning", "error"};
+
+    std::atomic<std::uint64_t> nextLoggerID {1};
+
+    /// Буфер потока в последнем журнале, куда поток писал. Журналов в процессе обычно один,
+    /// поэтому после первой записи поиск буфера - одно сравнение.
+    struct ThreadRing {
+        std::uint64_t loggerID = 0;
+        void*         ring     = nullptr;
+    };
+    thread_local ThreadRing threadRingCache;
+}
+
+Logger::Logger(const std::string& path,
+               Level level,
+               std::size_t ringCapacity,
+               std::size_t maxPerSecond,
+               std::chrono::milliseconds flushInterval,
+               std::chrono::milliseconds dedupWindow)
+               : m_id(nextLoggerID.fetch_add(1))
+               , m_level(level)
+               , m_ringCapacity(std::max<std::size_t>(ringCapacity, 1))
+               , m_maxPerSecond(maxPerSecond)
+               , m_flushInterval(flushInterval)
+               , m_dedupWindow(std::chrono::duration_cast<std::chrono::microseconds>(dedupWindow).count())
+               , m_file(path.empty() ? stdout : std::fopen(path.c_str(), "a"))
+{
+    if (m_file == nullptr) {
+        throw std::system_error(errno, std::system_category(), "Не удалось открыть журнал " + path);
+    }
+
+    m_thread = std::thread([this]() { run(); });
+}
+
+Logger::~Logger()
+{
+    stop();
+
+    if (m_file != stdout) {
+        std::fclose(m_file);
+    }
+}
+
+void Logger::stop()
+{
+    {
+        const std::lock_guard lock(m_stopMutex);
+        if (m_stopping) return;
+        m_stopping = true;
+    }
+    m_wakeup.notify_one();
+    m_thread.join();
+}
+
+std::int64_t Logger::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+Logger::Ring& Logger::threadRing()
+{
+    if (threadRingCache.loggerID == m_id) {
+        return *static_cast<Ring*>(threadRingCache.ring);
+    }
+
+    // Первая запись потока: заводим ему буфер. Только здесь писатель берет мьютекс.
+    const std::lock_guard lock(m_ringsMutex);
+    auto& ring = *m_rings.emplace_back(std::make_unique<Ring>(m_ringCapacity));
+    threadRingCache = {m_id, &ring};
+    return ring;
+}
+
+void Logger::run()
+{
+    std::unique_lock lock(m_stopMutex);
+    while (!m_stopping) {
+        m_wakeup.wait_for(lock, m_flushInterval, [this]() { return m_stopping; });
+
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+
+    // Писатели к этому моменту остановлены: дописываем остатки и итоги всех окон склейки.
+    lock.unlock();
+    drain();
+    flushRepeats(now(), true);
+    std::fflush(m_file);
+}
+
+void Logger::drain()
+{
+    {
+        const std::lock_guard lock(m_ringsMutex);
+        m_snapshot.clear();
+        for (const auto& ring : m_rings) {
+            m_snapshot.push_back(ring.get());
+        }
+    }
+
+    // Сообщения разных потоков сводим в один поток по времени. Ячейки остаются за нами,
+    // пока tail не сдвинут, поэтому копировать их не нужно.
+    m_pending.clear();
+    m_heads.resize(m_snapshot.size());
+    std::uint64_t dropped = 0, suppressed = 0;
+    for (std::size_t i = 0; i < m_snapshot.size(); ++i) {
+        auto& ring = *m_snapshot[i];
+        m_heads[i] = ring.head.load(std::memory_order_acquire);
+        for (auto position = ring.tail.load(std::memory_order_relaxed); position != m_heads[i]; ++position) {
+            m_pending.push_back(&ring.records[position % ring.records.size()]);
+        }
+        dropped    += ring.dropped.load(std::memory_order_relaxed);
+        suppressed += ring.suppressed.load(std::memory_order_relaxed);
+    }
+    std::stable_sort(m_pending.begin(), m_pending.end(),
+                     [](const Record* left, const Record* right) { return left->time < right->time; });
+
+    for (const auto* record : m_pending) {
+        emit(*record);
+    }
+    for (std::size_t i = 0; i < m_snapshot.size(); ++i) {
+        m_snapshot[i]->tail.store(m_heads[i], std::memory_order_release);
+    }
+
+    const auto time = now();
+    flushRepeats(time, false);
+
+    // О потерянных сообщениях сообщаем одной строкой за проход.
+    if (dropped != m_reportedDropped || suppressed != m_reportedSuppressed) {
+        m_line.clear();
+        m_line.append("logger: отброшено сообщений: ")
+              .append(std::to_string(dropped - m_reportedDropped)).append(" (буфер полон), ")
+              .append(std::to_string(suppressed - m_reportedSuppressed)).append(" (ограничение частоты)");
+        writeLine(time, Level::warning, m_line);
+        m_reportedDropped    = dropped;
+        m_reportedSuppressed = suppressed;
+    }
+
+    std::fflush(m_file);
+}
+
+void Logger::emit(const Record& record)
+{
+    const std::string_view text(record.text.data(), record.length);
+
+    m_key.assign(1, static_cast<char>(record.level)).append(text);
+    const auto repeat = m_repeats.find(m_key);
+    if (repeat != m_repeats.end() && record.time - repeat->second.windowStart < m_dedupWindow) {
+        ++repeat->second.count;
+        return;
+    }
+
+    if (repeat != m_repeats.end()) {
+        // Окно истекло в этом же проходе: сначала итог старого окна, потом начало нового.
+        if (repeat->second.count != 0) {
+            m_line.assign(text).append(" (повторилось ").append(std::to_string(repeat->second.count)).append(" раз)");
+            writeLine(record.time, record.level, m_line);
+        }
+        repeat->second = {record.level, record.time, 0};
+    } else {
+        m_repeats.emplace(m_key, Repeat {record.level, record.time, 0});
+    }
+    writeLine(record.time, record.level, text);
+}
+
+void Logger::flushRepeats(const std::int64_t time, const bool force)
+{
+    for (auto repeat = m_repeats.begin(); repeat != m_repeats.end();) {
+        if (!force && time - repeat->second.windowStart < m_dedupWindow) {
+            ++repeat;
+            continue;
+        }
+
+        if (repeat->second.count != 0) {
+            m_line.assign(repeat->first, 1).append(" (повторилось ").append(std::to_string(repeat->second.count))
+                  .append(" раз)");
+            writeLine(time, repeat->second.level, m_line);
+        }
+        repeat = m_repeats.erase(repeat);
+    }
+}
+
+void Logger::writeLine(const std::int64_t time, const Level level, const std::string_view text)
+{
+    const auto seconds = static_cast<std::time_t>(time / 1000000);
+    std::tm utc {};
+    gmtime_r(&seconds, &utc);
+
+    char stamp[40];
+    const auto length = std::snprintf(stamp, sizeof(stamp), "%04d-%02d-%02dT%02d:%02d:%02d.%06dZ %s ",
+                                      utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                                      utc.tm_hour, utc.tm_min, utc.tm_sec, static_cast<int>(time % 1000000),
+                                      levelNames[static_cast<std::size_t>(level)]);
+    std::fwrite(stamp, 1, static_cast<std::size_t>(length), m_file);
+    std::fwrite(text.data(), 1, text.size(), m_file);
+    std::fputc('\n', m_file);
+}
@@ -0,0 +1,197 @@
+#ifndef SERVER_LOGGER_H
+#define SERVER_LOGGER_H
+
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <charconv>
+#include <algorithm>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "config.h"
+
+/// Журнал сообщений сервера: строки "<время UTC> <уровень> <источник>: <сообщение>".
+///
+/// Запись не ждет ни файла, ни других потоков: сообщение собирается прямо в ячейку кольцевого
+/// буфера своего потока (один писатель, один читатель - без блокировок), а в файл буферы
+/// переписывает фоновый поток. Если буфер полон, сообщение отбрасывается и только учитывается.
+/// Во время лавины ошибок поток пишет не больше maxPerSecond сообщений в секунду, а одинаковые
+/// сообщения фоновый поток склеивает: повтор в пределах dedupWindow только считается, а по
+/// истечении окна пишется одна строка с числом повторов.
+class Logger {
+
+public:
+    using Level = config::log::Level;
+
+    /// path - файл (дописывается), пустой - стандартный вывод. Бросает исключение, если файл
+    /// не удалось открыть.
+    explicit Logger(const std::string& path,
+                    Level level,
+                    std::size_t ringCapacity,
+                    std::size_t maxPerSecond,
+                    std::chrono::milliseconds flushInterval,
+                    std::chrono::milliseconds dedupWindow);
+    ~Logger();
+
+    /// Явно запрещаем любое копирование данных.
+    Logger(const Logger& other) = delete;
+    Logger& operator=(const Logger& other) = delete;
+
+    /// Пишет сообщение из частей parts: строк и чисел. Сообщение длиннее maxMessageSize обрезается.
+    template <typename... Parts>
+    void write(Level level, std::string_view source, const Parts&... parts)
+    {
+        if (level < m_level) return;
+
+        auto& ring = threadRing();
+        const auto time = now();
+        if (!ring.admit(time, m_maxPerSecond)) {
+            ring.suppressed.store(ring.suppressed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+
+        const auto head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) == ring.records.size()) {
+            ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto& record  = ring.records[head % ring.records.size()];
+        record.level  = level;
+        record.time   = time;
+        record.length = 0;
+        append(record, source);
+        append(record, ": ");
+        (append(record, parts), ...);
+        // Ячейка заполнена - отдаем ее фоновому потоку.
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    template <typename... Parts>
+    void error(std::string_view source, const Parts&... parts) { write(Level::error, source, parts...); }
+    template <typename... Parts>
+    void warning(std::string_view source, const Parts&... parts) { write(Level::warning, source, parts...); }
+    template <typename... Parts>
+    void info(std::string_view source, const Parts&... parts) { write(Level::info, source, parts...); }
+
+    /// Дописывает все, что осталось в буферах, и останавливает фоновый поток.
+    void stop();
+
+private:
+    static constexpr std::size_t maxMessageSize = 240;
+
+    struct Record {
+        Level                            level;
+        std::uint16_t                    length;
+        std::int64_t                     time;   //!< Микросекунды с начала эпохи.
+        std::array<char, maxMessageSize> text;
+    };
+
+    /// Буфер одного потока. head двигает только этот поток, tail - только фоновый.
+    struct Ring {
+        explicit Ring(std::size_t capacity) : records(capacity) {}
+
+        /// Ограничение частоты: не больше maxPerSecond сообщений за секунду (0 - без ограничения).
+        bool admit(std::int64_t time, std::size_t maxPerSecond)
+        {
+            if (maxPerSecond == 0) return true;
+            if (time - windowStart >= 1000000) {
+                windowStart = time;
+                windowCount = 0;
+            }
+            return windowCount++ < maxPerSecond;
+        }
+
+        std::vector<Record> records;
+        alignas(64) std::atomic<std::uint64_t> head {0};
+        alignas(64) std::atomic<std::uint64_t> tail {0};
+        /// Счетчики пишет поток буфера, читает фоновый.
+        alignas(64) std::atomic<std::uint64_t> dropped {0};    //!< Буфер был полон.
+        std::atomic<std::uint64_t>             suppressed {0}; //!< Отброшено ограничением частоты.
+        std::int64_t windowStart = 0; //!< Начало текущей секунды ограничения (только поток буфера).
+        std::size_t  windowCount = 0;
+    };
+
+    /// Повторы сообщения в пределах окна склейки.
+    struct Repeat {
+        Level        level;
+        std::int64_t windowStart;
+        std::size_t  count;
+    };
+
+    static std::int64_t now();
+
+    template <typename Part>
+    static void append(Record& record, const Part& part)
+    {
+        const auto free = record.text.size() - record.length;
+        auto* const out = record.text.data() + record.length;
+        if constexpr (std::is_same_v<Part, char>) {
+            if (free != 0) {
+                *out = part;
+                ++record.length;
+            }
+        } else if constexpr (std::is_arithmetic_v<Part>) {
+            const auto [end, error] = std::to_chars(out, out + free, part);
+            if (error == std::errc()) {
+                record.length += static_cast<std::uint16_t>(end - out);
+            }
+        } else {
+            const std::string_view text(part);
+            const auto size = std::min(text.size(), free);
+            text.copy(out, size);
+            record.length += static_cast<std::uint16_t>(size);
+        }
+    }
+
+    /// Буфер вызывающего потока (создается при первой записи).
+    Ring& threadRing();
+
+    void run();
+    /// Переписывает буферы всех потоков в файл, по порядку времени.
+    void drain();
+    /// Пишет сообщение или засчитывает его повтором.
+    void emit(const Record& record);
+    /// Пишет итоги окон склейки, которые истекли к моменту time (все - если force).
+    void flushRepeats(std::int64_t time, bool force);
+    void writeLine(std::int64_t time, Level level, std::string_view text);
+
+private:
+    const std::uint64_t             m_id;          //!< Отличает этот журнал в кэше буферов потока.
+    const Level                     m_level;
+    const std::size_t               m_ringCapacity;
+    const std::size_t               m_maxPerSecond;
+    const std::chrono::milliseconds m_flushInterval;
+    const std::int64_t              m_dedupWindow; //!< Микросекунды.
+
+    std::mutex                         m_ringsMutex; //!< Защищает m_rings (только регистрация потоков).
+    std::vector<std::unique_ptr<Ring>> m_rings;
+
+    /// Состояние фонового потока.
+    std::FILE*                              m_file;
+    std::vector<Ring*>                      m_snapshot;
+    std::vector<std::uint64_t>              m_heads;
+    std::vector<const Record*>              m_pending;
+    std::unordered_map<std::string, Repeat> m_repeats; //!< Ключ - уровень и текст сообщения.
+    std::string                             m_key;
+    std::string                             m_line;
+    std::uint64_t                           m_reportedDropped    = 0;
+    std::uint64_t                           m_reportedSuppressed = 0;
+
+    std::mutex              m_stopMutex;
+    std::condition_variable m_wakeup;
+    bool                    m_stopping = false;
+    std::thread             m_thread;
+};
+
+#endif //SERVER_LOGGER_H
@@ -0,0 +1,103 @@
+#ifndef SERVER_PROTOCOL_H
+#define SERVER_PROTOCOL_H
+
+#include <bit>
+#include <string>
+#include <cstdint>
+#include <string_view>
+
+/// Протоколы клиента.
+///
+/// Текстовый: команды - строки вида "calc 2+2\n", ответы - строки (на успех, кроме calcbatch, - пустые).
+/// После команды "subscribe" сервер сам присылает "balance <баланс>\n", когда баланс меняет
+/// другая сессия того же пользователя.
+/// Команда "history [N] [позиция]" возвращает до N последних вычислений, от новых к старым:
+/// строку "history <n> [позиция следующей страницы]\n", затем n строк
+/// "<время, с>\t<выражение>\t<результат>\n". Позиции следующей страницы нет, если страница неполная.
+///
+/// Двоичный: включается, если первый байт соединения - binary::magic (в тексте такого байта нет).
+/// Дальше в обе стороны идут кадры, все числа - little-endian:
+///   запрос: [длина: u32][opcode: u8][id: u32][аргумент команды: текст]
+///   ответ:  [длина: u32][opcode: u8][id: u32][status: u8][balance: i32][данные]
+/// Длина - размер кадра без самого поля длины. id запроса возвращается в ответе, поэтому клиент
+/// сопоставляет ответы по нему, а не по порядку. Данные ответа:
+///   calc, status == ok:                  [результат: f64]
+///   calcbatch, status == ok:             [n: u32][n результатов: f64]
+///   calcbatch, status == badExpression:  [номер выражения с нуля: u32]
+///   history, status == ok:               [n: u32][позиция следующей страницы: i64 время, i64 id]
+///                                        [n записей: [время, мкс: i64][u32 длина][выражение]
+///                                                    [u32 длина][результат]]
+/// Аргумент history - текст, как в текстовом протоколе ("N позиция"); нулевая позиция в ответе -
+/// страница неполная, дальше записей нет.
+/// Ответ приходит на каждый запрос, в том числе на login и logout. После subscribe сервер сам
+/// присылает кадры с opcode balance и id 0: новый баланс - в поле balance.
+namespace protocol {
+    /// Исход команды (в двоичном протоколе - поле status).
+    enum class Status : std::uint8_t {
+        ok = 0,
+        badRequest,        //!< Некорректная команда или команда не в свое время.
+        authFailed,        //!< Неверный логин или пароль.
+        badExpression,     //!< Некорректное выражение.
+        tooLarge,          //!< Слишком много выражений в пакете.
+        insufficientFunds, //!< Недостаточно средств.
+        busy,              //!< Сервер перегружен, команду можно повторить.
+        storageError,      //!< Хранилище не смогло выполнить запрос.
+        sessionLimit       //!< У пользователя уже открыто максимальное число сессий.
+    };
+
+    namespace binary {
+        constexpr unsigned char magic = 0xB1;
+
+        enum class Opcode : std::uint8_t { login = 1, password, calc, calcbatch, logout, ping, subscribe,
+                                           balance /*!< Уведомление сервера. */, history };
+
+        constexpr std::size_t lengthSize         = sizeof(std::uint32_t);
+        constexpr std::size_t requestHeaderSize  = sizeof(std::uint8_t) + sizeof(std::uint32_t);
+        constexpr std::size_t responseHeaderSize = requestHeaderSize + sizeof(std::uint8_t) + sizeof(std::int32_t);
+
+        /// Дописывает беззнаковое число из size байт в little-endian.
+        inline void appendInteger(std::string& output, std::uint64_t value, std::size_t size)
+        {
+            for (std::size_t i = 0; i < size; ++i) {
+                output.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        inline void appendDouble(std::string& output, double value)
+        {
+            appendInteger(output, std::bit_cast<std::uint64_t>(value), sizeof(value));
+        }
+
+        /// Читает беззнаковое число из size байт в little-endian.
+        inline std::uint64_t readInteger(const char* data, std::size_t size)
+        {
+            std::uint64_t value = 0;
+            for (std::size_t i = 0; i < size; ++i) {
+                value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+            }
+            return value;
+        }
+
+        /// Начинает кадр ответа. Длину кадра дописывает finishResponse.
+        inline void beginResponse(std::string& output, std::uint8_t opcode, std::uint32_t id,
+                                  Status status, std::int32_t balance)
+        {
+            output.clear();
+            appendInteger(output, 0, lengthSize);
+            appendInteger(output, opcode, sizeof(opcode));
+            appendInteger(output, id, sizeof(id));
+            appendInteger(output, static_cast<std::uint8_t>(status), sizeof(status));
+            appendInteger(output, static_cast<std::uint32_t>(balance), sizeof(balance));
+        }
+
+        inline void finishResponse(std::string& output)
+        {
+            const auto length = static_cast<std::uint32_t>(output.size() - lengthSize);
+            for (std::size_t i = 0; i < lengthSize; ++i) {
+                output[i] = static_cast<char>((length >> (8 * i)) & 0xFF);
+            }
+        }
+    }
+}
+
+#endif //SERVER_PROTOCOL_H
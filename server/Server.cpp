@@ -1,49 +1,86 @@
 #include "Server.h"
 
 #include <iostream>
-#include <boost/bind.hpp>
-#include <boost/asio/placeholders.hpp>
-#include <boost/asio/spawn.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
 
-#include "PostgreSQLDatabase.h"
+#include "Storage.h"
 #include "Connection.h"
+#include "config.h"
+
+/// Позволяет нескольким акцепторам (по одному на поток) слушать один и тот же порт,
+/// ядро само распределяет входящие соединения между ними.
+using ReusePort = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
 
 Server::Server(boost::asio::io_context& context,
-               PostgreSQLDatabase& database,
-               boost::asio::ip::tcp::endpoint& endpoint)
+               Storage& database,
+               Calculator& calculator,
+               boost::asio::ip::tcp::endpoint& endpoint,
+               std::size_t connectionsPerChunk,
+               const Connection::Timeouts& timeouts,
+               AdmissionController& admission,
+               SessionRegistry& sessions,
+               ComputePool& compute,
+               Metrics& metrics,
+               TraceWriter* trace)
                : mr_context(context)
                , mr_databaseAccessor(database)
-               , m_acceptor(mr_context, endpoint)
+               , mr_calculator(calculator)
+               , mr_admission(admission)
+               , mr_sessions(sessions)
+               , mr_compute(compute)
+               , mr_metrics(metrics)
+               , m_trace(trace)
+               , m_acceptor(mr_context)
+               , m_connectionPool(metrics.connections())
+               , m_connectionSlab(std::make_shared<ConnectionSlab>(connectionsPerChunk))
+               , m_timingWheel(context, config::net::timingWheel::tick, config::net::timingWheel::slots)
+               , m_timeouts(timeouts)
 {
+    m_acceptor.open(endpoint.protocol());
+    m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+    m_acceptor.set_option(ReusePort(true));
+    m_acceptor.bind(endpoint);
+    m_acceptor.listen();
+
+    m_timingWheel.start();
+
     std::clog << "Статус сервера: работает нармальна! НАР-МАЛЬ-НА! НАРМАЛЬНА РАБОТАЕТ!" << std::endl;
-    accept();
+    boost::asio::co_spawn(mr_context, accept(), boost::asio::detached);
 }
 
-void Server::accept()
+boost::asio::awaitable<void> Server::accept()
 {
-    /// @todo: Это соединение обособлено от того, что я передаю в boost:bind(), и потому не добавляется в
-    ///        коллекцию соединений в методе self::handleAccept. Однако если заменить handle-метод на
-    ///        лямбда-функцию с boost::asio::ip::tcp::socket в аргументе и исправить конструктор класса
-    ///        <Connection>, проблем не будет. Этот connectionPtr куда-то деётся и уничтожается
-    ///        после обрыва соединения.
-    auto connectionPtr = std::make_shared<Connection>(mr_context, mr_databaseAccessor, m_connectionPool);
-    // Заставяляем ожидать соединения.
-    m_acceptor.async_accept(connectionPtr->socket(),
-                            boost::bind(&Server::handleAccept,
-                                        this,
-                                        connectionPtr, boost::asio::placeholders::error));
-}
+    boost::system::error_code errorCode;
 
-void Server::handleAccept(ConnectionPtr connectionPtr, const boost::system::error_code &errorCode) {
-    if (errorCode) {
-        m_connectionPool.removeAll();
-        return;
+    while (true) {
+        // Соединение и его счетчик ссылок занимают один блок из пула шарда.
+        auto connectionPtr = std::allocate_shared<Connection>(SlabAllocator<Connection>(m_connectionSlab),
+                                                              mr_context, mr_databaseAccessor,
+                                                              mr_calculator, m_connectionPool, mr_admission, mr_metrics,
+                                                              m_timingWheel, m_timeouts, mr_sessions,
+                                                              mr_compute, m_trace);
+        // Заставяляем ожидать соединения.
+        co_await m_acceptor.async_accept(connectionPtr->socket(),
+                                         boost::asio::redirect_error(boost::asio::use_awaitable, errorCode));
+        if (errorCode) {
+            m_connectionPool.removeAll();
+            co_return;
+        }
+
+        // Добавляем соединение к пулу соединений.
+        m_connectionPool.insert(*connectionPtr);
     }
+}
 
-    // Добавляем соединение к пулу соединений.
-    m_connectionPool.insert(connectionPtr);
-    // Продолжаем ожидать соединения.
-    accept();
+void Server::stop()
+{
+    // Ожидающий async_accept завершится с ошибкой, и корутина приема закроет все соединения.
+    boost::system::error_code errorCode;
+    m_acceptor.close(errorCode);
+    m_timingWheel.stop();
 }
 
 unsigned int Server::run() {
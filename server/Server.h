@@ -6,38 +6,64 @@
 #include <boost/asio.hpp>
 
 #include "ConnectionPool.h"
+#include "ConnectionSlab.h"
+#include "TimingWheel.h"
 
 class Connection;
-class PostgreSQLDatabase;
+class Calculator;
+class Storage;
+class Metrics;
+class AdmissionController;
+class SessionRegistry;
+class ComputePool;
+class TraceWriter;
 
 class Server {
 
-    using ConnectionPtr = std::shared_ptr<Connection>;
-
 public:
     /// Параметризированный конструктор класса.
     explicit Server(boost::asio::io_context& context,
-                    PostgreSQLDatabase& database,
-                    boost::asio::ip::tcp::endpoint& endpoint);
+                    Storage& database,
+                    Calculator& calculator,
+                    boost::asio::ip::tcp::endpoint& endpoint,
+                    std::size_t connectionsPerChunk,
+                    const Connection::Timeouts& timeouts,
+                    AdmissionController& admission,
+                    SessionRegistry& sessions,
+                    ComputePool& compute,
+                    Metrics& metrics,
+                    TraceWriter* trace);
     ~Server() = default;
 
     /// Явно запрещает любое копирование данных.
     Server(const Server& other) = delete;
     Server& operator=(const Server& other) = delete;
 
-    /// Запускает сервер.
+    /// Запускает сервер. Блокирует вызывающий поток, пока в очереди задач есть работа.
+    /// Каждый экземпляр сервера (шард) должен крутиться в своем потоке.
     unsigned int run();
+    /// Прекращает прием новых соединений и закрывает текущие.
+    void stop();
 
 private /*methods*/:
-    void accept();
-    void handleAccept(ConnectionPtr connectionPtr, const boost::system::error_code &errorCode);
+    /// Корутина приема соединений. Работает, пока не закроют акцептор.
+    boost::asio::awaitable<void> accept();
 
 private /*members*/:
     boost::asio::io_context&        mr_context;
     boost::asio::ip::tcp::acceptor  m_acceptor;
     ConnectionPool                  m_connectionPool;
+    std::shared_ptr<ConnectionSlab> m_connectionSlab; //!< Память под соединения этого шарда.
+    TimingWheel                     m_timingWheel;    //!< Сроки соединений этого шарда.
+    const Connection::Timeouts      m_timeouts;
 
-    PostgreSQLDatabase&             mr_databaseAccessor;
+    Storage&                        mr_databaseAccessor;
+    Calculator&                     mr_calculator;
+    AdmissionController&            mr_admission;
+    SessionRegistry&                mr_sessions;
+    ComputePool&                    mr_compute;
+    Metrics&                        mr_metrics;
+    TraceWriter*                    m_trace;          //!< Запись трассы (nullptr - выключена).
 };
 
 
@@ -0,0 +1,128 @@
+#include "SessionRegistry.h"
+
+#include <algorithm>
+
+#include <boost/asio/post.hpp>
+
+#include "Connection.h"
+
+SessionRegistry::SessionRegistry(std::size_t maxSessionsPerUser)
+                                 : m_maxSessionsPerUser(maxSessionsPerUser) {}
+
+SessionRegistry::Stripe& SessionRegistry::stripe(const std::int64_t userID)
+{
+    return m_stripes[static_cast<std::uint64_t>(userID) % stripeCount];
+}
+
+const SessionRegistry::Stripe& SessionRegistry::stripe(const std::int64_t userID) const
+{
+    return m_stripes[static_cast<std::uint64_t>(userID) % stripeCount];
+}
+
+bool SessionRegistry::add(const std::int64_t userID, Connection& connection, boost::asio::io_context& context)
+{
+    auto& userStripe = stripe(userID);
+    const std::lock_guard lock(userStripe.mutex);
+
+    auto& sessions = userStripe.users[userID];
+    if (m_maxSessionsPerUser != 0 && sessions.size() >= m_maxSessionsPerUser) {
+        if (sessions.empty()) userStripe.users.erase(userID);
+        return false;
+    }
+
+    sessions.push_back({&connection, &context, false});
+    return true;
+}
+
+void SessionRegistry::remove(const std::int64_t userID, const Connection& connection)
+{
+    auto& userStripe = stripe(userID);
+    const std::lock_guard lock(userStripe.mutex);
+
+    const auto user = userStripe.users.find(userID);
+    if (user == userStripe.users.end()) return;
+
+    auto& sessions = user->second;
+    const auto session = std::find_if(sessions.begin(), sessions.end(),
+                                      [&connection](const Session& s) { return s.connection == &connection; });
+    if (session == sessions.end()) return;
+
+    if (session->subscribed) {
+        m_subscribers.fetch_sub(1, std::memory_order_relaxed);
+    }
+    // Порядок сессий не важен: переносим последнюю на место удаляемой.
+    *session = sessions.back();
+    sessions.pop_back();
+
+    if (sessions.empty()) {
+        userStripe.users.erase(user);
+    }
+}
+
+void SessionRegistry::subscribe(const std::int64_t userID, const Connection& connection)
+{
+    auto& userStripe = stripe(userID);
+    const std::lock_guard lock(userStripe.mutex);
+
+    const auto user = userStripe.users.find(userID);
+    if (user == userStripe.users.end()) return;
+
+    for (auto& session : user->second) {
+        if (session.connection == &connection && !session.subscribed) {
+            session.subscribed = true;
+            m_subscribers.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::size_t SessionRegistry::count(const std::int64_t userID) const
+{
+    const auto& userStripe = stripe(userID);
+    const std::lock_guard lock(userStripe.mutex);
+
+    const auto user = userStripe.users.find(userID);
+    return user == userStripe.users.end() ? 0 : user->second.size();
+}
+
+bool SessionRegistry::contains(const std::int64_t userID, const Connection* connection) const
+{
+    const auto& userStripe = stripe(userID);
+    const std::lock_guard lock(userStripe.mutex);
+
+    const auto user = userStripe.users.find(userID);
+    return user != userStripe.users.end()
+        && std::any_of(user->second.begin(), user->second.end(),
+                       [connection](const Session& s) { return s.connection == connection; });
+}
+
+void SessionRegistry::publishBalance(const std::int64_t userID, const std::int32_t balance,
+                                     const Connection* source)
+{
+    if (m_subscribers.load(std::memory_order_relaxed) == 0) return;
+
+    // Собираем адресатов под блокировкой, а задачи в их шарды ставим уже без нее.
+    std::vector<Session> targets;
+    {
+        auto& userStripe = stripe(userID);
+        const std::lock_guard lock(userStripe.mutex);
+
+        const auto user = userStripe.users.find(userID);
+        if (user == userStripe.users.end()) return;
+
+        for (const auto& session : user->second) {
+            if (session.subscribed && session.connection != source) {
+                targets.push_back(session);
+            }
+        }
+    }
+
+    for (const auto& target : targets) {
+        // Соединение могло закрыться, пока задача шла до его шарда. Там оно выписывается
+        // из реестра до разрушения, поэтому, если сессия еще записана, соединение живо.
+        boost::asio::post(*target.context, [this, userID, balance, connection = target.connection]() {
+            if (contains(userID, connection)) {
+                connection->pushBalance(balance);
+            }
+        });
+    }
+}
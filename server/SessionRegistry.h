@@ -0,0 +1,72 @@
+#ifndef SERVER_SESSIONREGISTRY_H
+#define SERVER_SESSIONREGISTRY_H
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <boost/asio/io_context.hpp>
+
+class Connection;
+
+/// Вошедшие пользователи и их соединения (сессии), общие для всех шардов.
+///
+/// Пользователи разложены по полосам, у каждой полосы свой мьютекс и своя кэш-линия,
+/// так что шарды, работающие с разными пользователями, почти не встречаются на блокировках.
+/// Реестр не владеет соединениями: соединение само выписывается из него в своем шарде
+/// до разрушения, а уведомления передаются соединению только через очередь его шарда.
+class SessionRegistry {
+
+public:
+    /// maxSessionsPerUser == 0 - без ограничения.
+    explicit SessionRegistry(std::size_t maxSessionsPerUser);
+
+    /// Явно запрещаем любое копирование данных.
+    SessionRegistry(const SessionRegistry& other) = delete;
+    SessionRegistry& operator=(const SessionRegistry& other) = delete;
+
+    /// Записывает сессию пользователя. false - у него уже maxSessionsPerUser сессий.
+    /// context - очередь задач шарда, в котором живет соединение.
+    bool add(std::int64_t userID, Connection& connection, boost::asio::io_context& context);
+    /// Выписывает сессию. Вызывается в шарде соединения.
+    void remove(std::int64_t userID, const Connection& connection);
+    /// Подписывает сессию на уведомления об изменении баланса.
+    void subscribe(std::int64_t userID, const Connection& connection);
+
+    /// Сколько сессий у пользователя.
+    std::size_t count(std::int64_t userID) const;
+
+    /// Сообщает новый баланс пользователя всем его подписанным сессиям, кроме source.
+    /// Пока подписчиков нет ни у кого, это одна атомарная загрузка.
+    void publishBalance(std::int64_t userID, std::int32_t balance, const Connection* source);
+
+private:
+    struct Session {
+        Connection*              connection;
+        boost::asio::io_context* context;
+        bool                     subscribed;
+    };
+
+    struct alignas(64) Stripe {
+        mutable std::mutex                                     mutex;
+        std::unordered_map<std::int64_t, std::vector<Session>> users;
+    };
+
+    static constexpr std::size_t stripeCount = 64;
+
+    Stripe& stripe(std::int64_t userID);
+    const Stripe& stripe(std::int64_t userID) const;
+    /// Записана ли еще сессия. Вызывается в шарде соединения, поэтому, пока она записана,
+    /// соединение живо.
+    bool contains(std::int64_t userID, const Connection* connection) const;
+
+private:
+    const std::size_t               m_maxSessionsPerUser;
+    std::array<Stripe, stripeCount> m_stripes;
+    std::atomic<std::size_t>        m_subscribers {0}; //!< Подписанные сессии всех пользователей.
+};
+
+#endif //SERVER_SESSIONREGISTRY_H
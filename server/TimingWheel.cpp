@@ -0,0 +1,84 @@
+#include "TimingWheel.h"
+
+#include <algorithm>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+TimingWheel::TimingWheel(boost::asio::io_context& context, Clock::duration tick, std::size_t slots)
+                         : m_timer(context)
+                         , m_tick(std::max<Clock::duration>(tick, std::chrono::milliseconds(1)))
+                         , m_slots(std::max<std::size_t>(slots, 1)) {}
+
+void TimingWheel::schedule(Entry& entry, Clock::duration timeout)
+{
+    // Округляем вверх: срок не должен наступить раньше заказанного. Уже истекший срок
+    // наступит на следующем тике.
+    const auto count = std::max<Clock::rep>(timeout.count(), 0);
+    const auto ticks = std::max<std::uint64_t>((count + m_tick.count() - 1) / m_tick.count(), 1);
+
+    entry.Hook::unlink();
+    entry.m_rounds = (ticks - 1) / m_slots.size();
+    m_slots[(m_current + ticks) % m_slots.size()].push_back(entry);
+}
+
+void TimingWheel::start()
+{
+    boost::asio::co_spawn(m_timer.get_executor(), run(), boost::asio::detached);
+}
+
+void TimingWheel::stop()
+{
+    m_stopped = true;
+    m_timer.cancel();
+    // Снимаем все сроки: записи могут пережить колесо.
+    for (auto& slot : m_slots) {
+        slot.clear();
+    }
+}
+
+boost::asio::awaitable<void> TimingWheel::run()
+{
+    boost::system::error_code errorCode;
+    auto next = Clock::now() + m_tick;
+
+    while (!m_stopped) {
+        m_timer.expires_at(next);
+        co_await m_timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, errorCode));
+        if (m_stopped) co_return;
+
+        // Если шард был занят дольше тика, догоняем пропущенные тики.
+        const auto now = Clock::now();
+        while (next <= now && !m_stopped) {
+            advance();
+            next += m_tick;
+        }
+    }
+}
+
+void TimingWheel::advance()
+{
+    m_current = (m_current + 1) % m_slots.size();
+    auto& slot = m_slots[m_current];
+
+    // Истекшие сначала переносим в отдельный список: обработчик может переставить свой
+    // или чужой срок, и корзину под стрелкой в это время обходить нельзя.
+    Slot expired;
+    for (auto it = slot.begin(); it != slot.end();) {
+        auto& entry = *it++;
+        if (entry.m_rounds == 0) {
+            entry.Hook::unlink();
+            expired.push_back(entry);
+        } else {
+            --entry.m_rounds;
+        }
+    }
+
+    while (!expired.empty()) {
+        auto& entry = expired.front();
+        expired.pop_front();
+        entry.onTimeout();
+    }
+}
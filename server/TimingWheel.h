@@ -0,0 +1,76 @@
+#ifndef SERVER_TIMINGWHEEL_H
+#define SERVER_TIMINGWHEEL_H
+
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/intrusive/list.hpp>
+
+/// Хэшированное колесо таймеров шарда: тысячи сроков (таймауты соединений) на одном steady_timer.
+///
+/// Колесо - кольцо из slots корзин, стрелка сдвигается на одну корзину каждый tick. Срок через
+/// n тиков попадает в корзину (текущая + n) % slots и ждет там n / slots полных оборотов.
+/// Записи связаны в интрузивные списки: поставить, перенести и снять срок - O(1) без выделения
+/// памяти, а запись, разрушенная раньше срока, сама исключает себя из корзины.
+/// Не потокобезопасно: колесо и все его записи живут в одном шарде.
+class TimingWheel {
+
+    struct Tag;
+    using Hook = boost::intrusive::list_base_hook<boost::intrusive::tag<Tag>,
+                                                  boost::intrusive::link_mode<boost::intrusive::auto_unlink>>;
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Запись колеса. Наследуется владельцем срока.
+    class Entry : public Hook {
+    public:
+        virtual ~Entry() = default;
+
+        /// Вызывается, когда срок истек (запись уже снята с колеса).
+        virtual void onTimeout() = 0;
+
+        bool isScheduled() const { return Hook::is_linked(); }
+
+    private:
+        friend class TimingWheel;
+        std::uint64_t m_rounds = 0; //!< Сколько еще полных оборотов ждать.
+    };
+
+    explicit TimingWheel(boost::asio::io_context& context, Clock::duration tick, std::size_t slots);
+
+    /// Явно запрещаем любое копирование данных.
+    TimingWheel(const TimingWheel& other) = delete;
+    TimingWheel& operator=(const TimingWheel& other) = delete;
+
+    /// Ставит (или переносит) срок записи: через timeout, с точностью до тика в большую сторону.
+    void schedule(Entry& entry, Clock::duration timeout);
+    /// Снимает срок записи, если он стоит.
+    static void cancel(Entry& entry) { entry.Hook::unlink(); }
+
+    /// Запускает и останавливает ход стрелки.
+    void start();
+    void stop();
+
+private:
+    using Slot = boost::intrusive::list<Entry, boost::intrusive::base_hook<Hook>,
+                                        boost::intrusive::constant_time_size<false>>;
+
+    boost::asio::awaitable<void> run();
+    /// Сдвигает стрелку на одну корзину и вызывает истекшие сроки.
+    void advance();
+
+private:
+    boost::asio::steady_timer m_timer;
+    const Clock::duration     m_tick;
+    std::vector<Slot>         m_slots;
+    std::size_t               m_current = 0; //!< Корзина под стрелкой.
+    bool                      m_stopped = false;
+};
+
+#endif //SERVER_TIMINGWHEEL_H
@@ -0,0 +1,83 @@
+#ifndef SERVER_TRACE_H
+#define SERVER_TRACE_H
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+/// Формат файла трассы (TraceWriter пишет, calc_replay читает).
+///
+/// Заголовок: [magic: 8 байт][version: u32]. Дальше записи, все числа - little-endian:
+///   [type: u8][connection: u32][time: u64][length: u32][данные: length байт]
+/// connection - номер соединения в трассе, time - микросекунды от начала записи трассы.
+/// На каждое соединение: open, затем in (байты, прочитанные из сокета, ровно как пришли - с
+/// байтом двоичного протокола и кусками команд) и out (байты ответов), в конце close.
+namespace trace {
+    constexpr char          magic[8] = {'C', 'A', 'L', 'C', 'T', 'R', 'C', 'E'};
+    constexpr std::uint32_t version  = 1;
+
+    constexpr std::size_t fileHeaderSize   = sizeof(magic) + sizeof(std::uint32_t);
+    constexpr std::size_t recordHeaderSize = sizeof(std::uint8_t) + sizeof(std::uint32_t)
+                                           + sizeof(std::uint64_t) + sizeof(std::uint32_t);
+
+    enum class RecordType : std::uint8_t { open = 1, in, out, close };
+
+    struct RecordHeader {
+        RecordType    type;
+        std::uint32_t connection;
+        std::uint64_t time;
+        std::uint32_t length;
+    };
+
+    /// Дописывает беззнаковое число из size байт в little-endian.
+    inline void appendInteger(std::string& output, std::uint64_t value, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; ++i) {
+            output.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    /// Читает беззнаковое число из size байт в little-endian.
+    inline std::uint64_t readInteger(const char* data, std::size_t size)
+    {
+        std::uint64_t value = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    inline void appendFileHeader(std::string& output)
+    {
+        output.append(magic, sizeof(magic));
+        appendInteger(output, version, sizeof(version));
+    }
+
+    inline bool isFileHeader(std::string_view data)
+    {
+        return data.size() >= fileHeaderSize && std::memcmp(data.data(), magic, sizeof(magic)) == 0
+            && readInteger(data.data() + sizeof(magic), sizeof(std::uint32_t)) == version;
+    }
+
+    inline void appendRecordHeader(std::string& output, const RecordHeader& header)
+    {
+        appendInteger(output, static_cast<std::uint8_t>(header.type), sizeof(std::uint8_t));
+        appendInteger(output, header.connection, sizeof(header.connection));
+        appendInteger(output, header.time, sizeof(header.time));
+        appendInteger(output, header.length, sizeof(header.length));
+    }
+
+    /// data - не меньше recordHeaderSize байт.
+    inline RecordHeader readRecordHeader(const char* data)
+    {
+        RecordHeader header {};
+        header.type       = static_cast<RecordType>(readInteger(data, 1));
+        header.connection = static_cast<std::uint32_t>(readInteger(data + 1, 4));
+        header.time       = readInteger(data + 5, 8);
+        header.length     = static_cast<std::uint32_t>(readInteger(data + 13, 4));
+        return header;
+    }
+}
+
+#endif //SERVER_TRACE_H
@@ -0,0 +1,90 @@
+#include "TraceWriter.h"
+#include "Logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <system_error>
+
+TraceWriter::TraceWriter(const std::string& path,
+                         std::size_t flushSize,
+                         std::size_t maxBuffered,
+                         std::chrono::milliseconds flushInterval,
+                         Logger& logger)
+                         : m_file(std::fopen(path.c_str(), "wb"))
+                         , m_started(std::chrono::steady_clock::now())
+                         , m_flushSize(flushSize)
+                         , m_maxBuffered(std::max(maxBuffered, flushSize))
+                         , m_flushInterval(flushInterval)
+                         , mr_logger(logger)
+{
+    if (m_file == nullptr) {
+        throw std::system_error(errno, std::system_category(), "Не удалось открыть файл трассы " + path);
+    }
+
+    m_buffer.reserve(m_flushSize);
+    trace::appendFileHeader(m_buffer);
+
+    m_thread = std::thread([this]() { writeLoop(); });
+}
+
+TraceWriter::~TraceWriter()
+{
+    stop();
+    std::fclose(m_file);
+}
+
+void TraceWriter::stop()
+{
+    {
+        const std::lock_guard lock(m_mutex);
+        if (m_stopping) return;
+        m_stopping = true;
+    }
+    m_wakeup.notify_one();
+    m_thread.join();
+
+    if (m_dropped != 0) {
+        mr_logger.warning("trace", "dropped ", m_dropped, " records: the writer could not keep up");
+    }
+    if (m_lostBytes != 0) {
+        mr_logger.warning("trace", "trace is truncated: ", m_lostBytes, " bytes were not written");
+    }
+}
+
+std::uint64_t TraceWriter::elapsed() const
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - m_started).count());
+}
+
+void TraceWriter::writeLoop()
+{
+    std::unique_lock lock(m_mutex);
+    while (true) {
+        m_wakeup.wait_for(lock, m_flushInterval,
+                          [this]() { return m_stopping || m_buffer.size() >= m_flushSize; });
+        const bool stopping = m_stopping;
+
+        // Забираем накопленное, а соединениям оставляем пустой буфер той же емкости.
+        m_writing.swap(m_buffer);
+        lock.unlock();
+
+        if (!m_writing.empty()) {
+            if (m_failed) {
+                m_lostBytes += m_writing.size();
+            } else {
+                const auto written = std::fwrite(m_writing.data(), 1, m_writing.size(), m_file);
+                if (written != m_writing.size() || std::fflush(m_file) != 0) {
+                    m_failed     = true;
+                    m_lostBytes += m_writing.size() - written;
+                    mr_logger.error("trace", "failed to write the trace file: ", std::strerror(errno));
+                }
+            }
+            m_writing.clear();
+        }
+        if (stopping) return;
+
+        lock.lock();
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef SERVER_TRACEWRITER_H
+#define SERVER_TRACEWRITER_H
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <condition_variable>
+
+#include <boost/asio/buffer.hpp>
+
+#include "Trace.h"
+
+class Logger;
+
+/// Запись трассы клиентского трафика (формат - в Trace.h) для воспроизведения calc_replay.
+///
+/// Соединения только дописывают записи в буфер в памяти - под мьютексом, без системных вызовов.
+/// В файл буфер уходит из отдельного потока: он забирает накопленное целиком, подменяя буфер
+/// пустым, и пишет уже без мьютекса. Если диск не успевает и в памяти набралось больше
+/// maxBuffered байт, новые записи отбрасываются (и учитываются), а соединения не ждут.
+/// Если файл перестал принимать данные (например, кончилось место), трасса дальше не пишется:
+/// обрезанная посреди записи она все равно не читается, а остальное только учитывается.
+class TraceWriter {
+
+public:
+    /// Открывает (перезаписывает) файл трассы. Бросает исключение, если файл не удалось открыть.
+    explicit TraceWriter(const std::string& path,
+                         std::size_t flushSize,
+                         std::size_t maxBuffered,
+                         std::chrono::milliseconds flushInterval,
+                         Logger& logger);
+    ~TraceWriter();
+
+    /// Явно запрещаем любое копирование данных.
+    TraceWriter(const TraceWriter& other) = delete;
+    TraceWriter& operator=(const TraceWriter& other) = delete;
+
+    /// Номер для нового соединения.
+    std::uint32_t nextConnection() { return m_nextConnection.fetch_add(1, std::memory_order_relaxed); }
+
+    /// Дописывает запись с данными из буферов buffers (для open и close - пустых).
+    template <typename ConstBufferSequence>
+    void record(trace::RecordType type, std::uint32_t connection, const ConstBufferSequence& buffers)
+    {
+        const auto size = boost::asio::buffer_size(buffers);
+        const trace::RecordHeader header {type, connection, elapsed(), static_cast<std::uint32_t>(size)};
+
+        const std::lock_guard lock(m_mutex);
+        if (m_buffer.size() + trace::recordHeaderSize + size > m_maxBuffered || m_stopping) {
+            ++m_dropped;
+            return;
+        }
+        trace::appendRecordHeader(m_buffer, header);
+        for (auto buffer = boost::asio::buffer_sequence_begin(buffers);
+             buffer != boost::asio::buffer_sequence_end(buffers); ++buffer) {
+            m_buffer.append(static_cast<const char*>(boost::asio::const_buffer(*buffer).data()),
+                            boost::asio::const_buffer(*buffer).size());
+        }
+        if (m_buffer.size() >= m_flushSize) {
+            m_wakeup.notify_one();
+        }
+    }
+
+    void record(trace::RecordType type, std::uint32_t connection)
+    {
+        record(type, connection, boost::asio::const_buffer());
+    }
+
+    /// Дописывает все накопленное в файл и останавливает поток записи.
+    void stop();
+
+private:
+    /// Микросекунды от начала трассы.
+    std::uint64_t elapsed() const;
+    void writeLoop();
+
+private:
+    std::FILE*                                  m_file;
+    const std::chrono::steady_clock::time_point m_started;
+    const std::size_t                           m_flushSize;   //!< Сколько накопить, чтобы писать, не дожидаясь таймера.
+    const std::size_t                           m_maxBuffered; //!< Предел памяти под ненаписанное.
+    const std::chrono::milliseconds             m_flushInterval;
+    std::atomic<std::uint32_t>                  m_nextConnection {1};
+    Logger&                                     mr_logger;
+
+    std::mutex              m_mutex;        //!< Защищает поля ниже.
+    std::condition_variable m_wakeup;
+    std::string             m_buffer;       //!< Записи, ожидающие потока записи.
+    std::uint64_t           m_dropped = 0;  //!< Отброшено записей (память кончилась).
+    bool                    m_stopping = false;
+
+    std::string   m_writing;         //!< Записи, которые сейчас пишет поток записи.
+    bool          m_failed    = false; //!< Файл не принял данные, дальше не пишем.
+    std::uint64_t m_lostBytes = 0;     //!< Сколько байт не попало в файл из-за ошибки записи.
+    std::thread   m_thread;
+};
+
+#endif //SERVER_TRACEWRITER_H
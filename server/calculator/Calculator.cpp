@@ -0,0 +1,304 @@
+#include "Calculator.h"
+
+#include <array>
+#include <string>
+#include <cctype>
+#include <limits>
+#include <charconv>
+
+#include <tinyexpr.h>
+
+#include "Program.h"
+
+/// Символ числа или имени: пробел между двумя такими символами разделяет лексемы tinyexpr.
+static bool isWordCharacter(const char character)
+{
+    return isalnum(static_cast<unsigned char>(character)) || character == '.' || character == '_';
+}
+
+/// Можно ли убрать пробелы между символами left и right, не изменив разбор выражения.
+static bool isSeparable(const char left, const char right)
+{
+    if (isWordCharacter(left) && isWordCharacter(right)) return false;
+    // "1e -5" без пробела стало бы числом 1e-5.
+    return !((left == 'e' || left == 'E') && (right == '+' || right == '-'));
+}
+
+/// Приводит выражение к каноническому виду (без пробельных символов) и кладет его в буфер
+/// с завершающим нулем - это ключ кэша. Возвращает пустое представление, если выражение не
+/// влезло в буфер или пробел внутри него разделяет лексемы ("1 2", "sin 1"): без пробела
+/// выражение разбиралось бы иначе, и такие выражения мимо кэша считаются как есть.
+template <std::size_t Size>
+static std::string_view normalize(const std::string_view expression, std::array<char, Size>& buffer)
+{
+    std::size_t length = 0;
+    bool        space  = false; //!< Перед текущим символом были пробелы.
+
+    for (const auto character : expression) {
+        if (isspace(static_cast<unsigned char>(character))) {
+            space = true;
+            continue;
+        }
+        if (space && length != 0 && !isSeparable(buffer[length - 1], character)) return {};
+        if (length == Size - 1) return {};
+        buffer[length++] = character;
+        space = false;
+    }
+
+    buffer[length] = '\0';
+    return {buffer.data(), length};
+}
+
+/// Делит строку по разделителю, вызывая обработчик для каждой части. Обработчик может
+/// прервать обход, вернув false; тогда и сама функция вернет false.
+template <typename Handler>
+static bool split(std::string_view text, const char separator, Handler&& handler)
+{
+    while (true) {
+        const auto end = text.find(separator);
+        if (!handler(text.substr(0, end))) return false;
+        if (end == std::string_view::npos) return true;
+        text.remove_prefix(end + 1);
+    }
+}
+
+/// Имя переменной: латинские буквы, цифры и '_', начинается не с цифры.
+static bool isIdentifier(const std::string_view name)
+{
+    if (name.empty() || isdigit(static_cast<unsigned char>(name.front()))) return false;
+
+    for (const auto character : name) {
+        if (!isalnum(static_cast<unsigned char>(character)) && character != '_') return false;
+    }
+
+    return true;
+}
+
+/// Разбирает и считает одно выражение без переменных. Дерево нужно ровно один раз, поэтому
+/// компилировать его в Program (как для пакетов с переменными) дороже, чем обойти te_eval.
+static Calculator::Result compute(const char* expression)
+{
+    Calculator::Result result {std::numeric_limits<double>::quiet_NaN(), 0};
+    result.result = te_interp(expression, &result.errorCode);
+    return result;
+}
+
+Calculator::Calculator(std::size_t cacheCapacity, std::size_t cacheShards, std::size_t maxBatchSize,
+                       std::size_t maxExpressionLength, std::size_t maxNestingDepth)
+                       : m_cache(cacheCapacity, cacheShards)
+                       , m_maxBatchSize(maxBatchSize)
+                       , m_maxExpressionLength(maxExpressionLength)
+                       , m_maxNestingDepth(maxNestingDepth) {}
+
+bool Calculator::isWithinLimits(const std::string_view expression) const
+{
+    if (expression.size() > m_maxExpressionLength) return false;
+
+    std::size_t depth = 0;
+    for (const auto character : expression) {
+        if (character == '(' && ++depth > m_maxNestingDepth) return false;
+        if (character == ')' && depth > 0) --depth;
+    }
+
+    return true;
+}
+
+std::optional<Calculator::Result> Calculator::cached(const std::string_view expression, CacheKey& key)
+{
+    key.length = normalize(expression, key.buffer).size();
+    if (key.length == 0) {
+        return std::nullopt;
+    }
+
+    return m_cache.find(key.view());
+}
+
+Calculator::Result Calculator::evaluate(const std::string_view expression)
+{
+    if (!isWithinLimits(expression)) {
+        return {std::numeric_limits<double>::quiet_NaN(), tooComplex};
+    }
+
+    CacheKey key;
+    if (const auto found = cached(expression, key); found) {
+        return *found;
+    }
+
+    return computeAndInsert(expression, key);
+}
+
+Calculator::Result Calculator::evaluateUncached(const std::string_view expression, const CacheKey& key)
+{
+    if (!isWithinLimits(expression)) {
+        return {std::numeric_limits<double>::quiet_NaN(), tooComplex};
+    }
+
+    return computeAndInsert(expression, key);
+}
+
+Calculator::Result Calculator::computeAndInsert(const std::string_view expression, const CacheKey& key)
+{
+    // Выражения без ключа (слишком длинные, с пробелами между лексемами) считаем мимо кэша.
+    if (key.length == 0) {
+        const std::string copy(expression);
+        return compute(copy.c_str());
+    }
+
+    // Считаем исходный текст, а не ключ. Без пробелов ключ и есть исходный текст с нулем в конце.
+    const auto result = key.length == expression.size() ? compute(key.buffer.data())
+                                                        : compute(std::string(expression).c_str());
+    m_cache.insert(key.view(), result);
+
+    return result;
+}
+
+Calculator::BatchResult Calculator::evaluateBatch(const std::string_view batch,
+                                                  std::vector<std::string>& expressions,
+                                                  std::vector<double>& results)
+{
+    expressions.clear();
+    results.clear();
+
+    if (batch.empty()) {
+        return {BatchStatus::badSyntax, 0};
+    }
+
+    return batch.find('|') == std::string_view::npos
+           ? evaluateList(batch, expressions, results)
+           : evaluateBindings(batch, expressions, results);
+}
+
+Calculator::BatchResult Calculator::evaluateList(const std::string_view batch,
+                                                 std::vector<std::string>& expressions,
+                                                 std::vector<double>& results)
+{
+    BatchResult result {BatchStatus::ok, 0};
+
+    // Каждое выражение считаем отдельно - через кэш, как обычный calc.
+    split(batch, ';', [&](const std::string_view expression) {
+        if (results.size() == m_maxBatchSize) {
+            result = {BatchStatus::tooLarge, results.size()};
+            return false;
+        }
+
+        const auto [value, errorCode] = evaluate(expression);
+        if (errorCode != 0) {
+            result = {BatchStatus::badExpression, results.size()};
+            return false;
+        }
+
+        expressions.emplace_back(expression);
+        results.push_back(value);
+        return true;
+    });
+
+    return result;
+}
+
+Calculator::BatchResult Calculator::evaluateBindings(const std::string_view batch,
+                                                     std::vector<std::string>& expressions,
+                                                     std::vector<double>& results)
+{
+    const auto formulaEnd = batch.find('|');
+    const auto formula    = batch.substr(0, formulaEnd);
+    if (!isWithinLimits(formula)) {
+        return {BatchStatus::badExpression, 0};
+    }
+
+    // Разбираем привязки вида <имя>=<значение>,<значение>,... Значения храним столбцами.
+    std::vector<std::string_view>              names;
+    std::vector<std::vector<double>>           columns;
+    std::vector<std::vector<std::string_view>> texts; //!< Исходный текст значений (для журнала).
+    bool tooLarge = false;
+
+    const auto parsed = split(batch.substr(formulaEnd + 1), '|', [&](const std::string_view binding) {
+        const auto equals = binding.find('=');
+        if (equals == std::string_view::npos || !isIdentifier(binding.substr(0, equals))) return false;
+
+        names.push_back(binding.substr(0, equals));
+        auto& column = columns.emplace_back();
+        auto& text   = texts.emplace_back();
+
+        return split(binding.substr(equals + 1), ',', [&](const std::string_view token) {
+            if (column.size() == m_maxBatchSize) {
+                tooLarge = true;
+                return false;
+            }
+
+            double value = 0.0;
+            const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+            if (error != std::errc() || end != token.data() + token.size()) return false;
+
+            column.push_back(value);
+            text.push_back(token);
+            return true;
+        });
+    });
+
+    if (tooLarge) {
+        return {BatchStatus::tooLarge, m_maxBatchSize};
+    }
+    if (!parsed || columns.empty()) {
+        return {BatchStatus::badSyntax, 0};
+    }
+    // Все столбцы должны быть одной длины.
+    const auto count = columns.front().size();
+    for (const auto& column : columns) {
+        if (column.size() != count) return {BatchStatus::badSyntax, 0};
+    }
+
+    // Формулу разбираем и компилируем один раз на весь пакет. Переменные привязываем
+    // к подряд идущим ячейкам, чтобы программа знала их номера.
+    const std::vector<std::string> variableNames(names.begin(), names.end());
+    std::vector<double>      slots(names.size());
+    std::vector<te_variable> variables;
+    for (std::size_t k = 0; k < names.size(); ++k) {
+        variables.push_back({variableNames[k].c_str(), &slots[k], TE_VARIABLE, nullptr});
+    }
+
+    const std::string expression(formula);
+    int errorCode = 0;
+    auto* root = te_compile(expression.c_str(), variables.data(), static_cast<int>(variables.size()), &errorCode);
+    if (!root) {
+        return {BatchStatus::badExpression, 0};
+    }
+
+    Program program;
+    const auto compiled = program.compile(root, slots.data(), slots.size());
+
+    std::vector<const double*> data;
+    data.reserve(columns.size());
+    for (const auto& column : columns) {
+        data.push_back(column.data());
+    }
+
+    results.resize(count);
+    if (compiled) {
+        program.runBatch(data.data(), count, results.data());
+    } else {
+        // Запасной путь на случай, если дерево не удалось скомпилировать.
+        for (std::size_t i = 0; i < count; ++i) {
+            for (std::size_t k = 0; k < slots.size(); ++k) {
+                slots[k] = data[k][i];
+            }
+            results[i] = te_eval(root);
+        }
+    }
+    te_free(root);
+
+    // В журнал пишем формулу вместе с конкретными значениями переменных.
+    expressions.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto& expression = expressions.emplace_back(formula);
+        for (std::size_t k = 0; k < names.size(); ++k) {
+            expression.append("|").append(names[k]).append("=").append(texts[k][i]);
+        }
+    }
+
+    return {BatchStatus::ok, 0};
+}
+
+ExpressionCache::Stats Calculator::cacheStats() const
+{
+    return m_cache.stats();
+}
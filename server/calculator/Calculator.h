@@ -0,0 +1,89 @@
+#ifndef SERVER_CALCULATOR_H
+#define SERVER_CALCULATOR_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "ExpressionCache.h"
+
+/// Вычисляет математические выражения, запоминая результаты уже посчитанных.
+/// Выражения tinyexpr без переменных всегда дают один и тот же результат,
+/// поэтому их можно безопасно кэшировать по тексту.
+class Calculator {
+
+public:
+    /// Результат вычисления. errorCode != 0 означает некорректное выражение,
+    /// tooComplex - выражение, превышающее ограничения длины или вложенности.
+    using Result = ExpressionCache::Value;
+    static constexpr int tooComplex = -1;
+
+    enum class BatchStatus : uint8_t { ok = 0, badSyntax, badExpression, tooLarge };
+
+    /// Ключ выражения в кэше. cached() заполняет его, а evaluateUncached берет готовым,
+    /// чтобы не нормализовать выражение второй раз.
+    struct CacheKey {
+        std::array<char, ExpressionCache::maxKeyLength + 1> buffer; //!< Ключ с завершающим нулем.
+        std::size_t length = 0;                                     //!< 0 - выражение не кэшируется.
+
+        std::string_view view() const { return {buffer.data(), length}; }
+    };
+
+    /// Результат пакетного вычисления. failedIndex - номер (с нуля) первого некорректного выражения.
+    struct BatchResult {
+        BatchStatus status;
+        std::size_t failedIndex;
+    };
+
+    /// Параметризированный конструктор класса. Выражения длиннее maxExpressionLength символов
+    /// или со скобками глубже maxNestingDepth не считаются: разбор tinyexpr рекурсивен, а время
+    /// его работы и вычисления растет с длиной выражения.
+    explicit Calculator(std::size_t cacheCapacity, std::size_t cacheShards, std::size_t maxBatchSize,
+                        std::size_t maxExpressionLength, std::size_t maxNestingDepth);
+
+    /// Явно запрещаем любое копирование данных.
+    Calculator(const Calculator& other) = delete;
+    Calculator& operator=(const Calculator& other) = delete;
+
+    /// Вычисляет выражение. При попадании в кэш разбор не выполняется вовсе.
+    Result evaluate(std::string_view expression);
+    /// Только ищет результат в кэше - это дешево, и вычисление можно не отдавать в пул потоков.
+    std::optional<Result> cached(std::string_view expression, CacheKey& key);
+    /// Вычисляет выражение, для которого cached() с ключом key только что промахнулся, и кладет
+    /// результат в кэш. Кэш второй раз не спрашивается: ни поиска, ни второго промаха в счетчиках.
+    Result evaluateUncached(std::string_view expression, const CacheKey& key);
+
+    /// Вычисляет пакет выражений. Поддерживаются две формы:
+    ///  - список выражений через ';':                  "1+2;sin(0.5);2^10";
+    ///  - одна формула и значения переменных через '|': "x*1.2+y|x=1,2,3|y=4,5,6".
+    /// Во второй форме формула разбирается один раз и считается сразу по массивам значений.
+    /// В expressions попадает текст каждого выражения пакета (для журнала), в results - результаты.
+    BatchResult evaluateBatch(std::string_view batch,
+                              std::vector<std::string>& expressions,
+                              std::vector<double>& results);
+
+    /// Возвращает счетчики попаданий и промахов кэша.
+    ExpressionCache::Stats cacheStats() const;
+
+private:
+    /// Укладывается ли выражение в ограничения длины и вложенности.
+    bool isWithinLimits(std::string_view expression) const;
+    Result computeAndInsert(std::string_view expression, const CacheKey& key);
+    BatchResult evaluateList(std::string_view batch,
+                             std::vector<std::string>& expressions,
+                             std::vector<double>& results);
+    BatchResult evaluateBindings(std::string_view batch,
+                                 std::vector<std::string>& expressions,
+                                 std::vector<double>& results);
+
+private:
+    ExpressionCache   m_cache;        //!< Кэш результатов.
+    const std::size_t m_maxBatchSize; //!< Максимальное число выражений в пакете.
+    const std::size_t m_maxExpressionLength;
+    const std::size_t m_maxNestingDepth;
+};
+
+#endif //SERVER_CALCULATOR_H
@@ -0,0 +1,115 @@
+#include "ExpressionCache.h"
+
+#include <algorithm>
+
+ExpressionCache::ExpressionCache(std::size_t capacity, std::size_t shardCount)
+                                 : m_shardCount(std::max<std::size_t>(shardCount, 1))
+                                 , m_shards(std::make_unique<Shard[]>(m_shardCount))
+{
+    const auto perShard = std::max<std::size_t>(capacity / m_shardCount, 1);
+
+    for (std::size_t i = 0; i < m_shardCount; ++i) {
+        // Память под записи и корзины выделяем один раз, чтобы потом ее не трогать.
+        m_shards[i].capacity = perShard;
+        m_shards[i].entries.reserve(perShard);
+        m_shards[i].index.reserve(perShard);
+    }
+}
+
+std::optional<ExpressionCache::Value> ExpressionCache::find(std::string_view key)
+{
+    auto& shard = shardFor(key);
+
+    std::lock_guard lock(shard.mutex);
+
+    const auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+        shard.misses.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    // Переносим запись в начало списка как самую свежую.
+    unlink(shard, found->second);
+    pushFront(shard, found->second);
+
+    shard.hits.fetch_add(1, std::memory_order_relaxed);
+    return shard.entries[found->second].value;
+}
+
+void ExpressionCache::insert(std::string_view key, Value value)
+{
+    if (key.size() > maxKeyLength) return;
+
+    auto& shard = shardFor(key);
+
+    std::lock_guard lock(shard.mutex);
+
+    // Пока мы считали, значение мог положить другой поток.
+    if (const auto found = shard.index.find(key); found != shard.index.end()) {
+        shard.entries[found->second].value = value;
+        return;
+    }
+
+    std::uint32_t position;
+    if (shard.entries.size() < shard.capacity) {
+        position = static_cast<std::uint32_t>(shard.entries.size());
+        shard.entries.emplace_back();
+    } else {
+        // Шард заполнен - вытесняем самую старую запись. Ключ в индексе смотрит
+        // на память записи, поэтому удаляем его до того, как перезапишем ключ.
+        position = shard.tail;
+        shard.index.erase(shard.entries[position].keyView());
+        unlink(shard, position);
+    }
+
+    auto& entry = shard.entries[position];
+    std::copy(key.begin(), key.end(), entry.key.begin());
+    entry.keyLength = static_cast<std::uint8_t>(key.size());
+    entry.value     = value;
+
+    pushFront(shard, position);
+    shard.index.emplace(entry.keyView(), position);
+}
+
+ExpressionCache::Stats ExpressionCache::stats() const
+{
+    Stats result {0, 0};
+
+    for (std::size_t i = 0; i < m_shardCount; ++i) {
+        result.hits   += m_shards[i].hits.load(std::memory_order_relaxed);
+        result.misses += m_shards[i].misses.load(std::memory_order_relaxed);
+    }
+
+    return result;
+}
+
+ExpressionCache::Shard& ExpressionCache::shardFor(std::string_view key)
+{
+    return m_shards[std::hash<std::string_view>{}(key) % m_shardCount];
+}
+
+void ExpressionCache::unlink(Shard& shard, std::uint32_t position)
+{
+    auto& entry = shard.entries[position];
+
+    if (entry.prev != npos) shard.entries[entry.prev].next = entry.next;
+    else                    shard.head = entry.next;
+
+    if (entry.next != npos) shard.entries[entry.next].prev = entry.prev;
+    else                    shard.tail = entry.prev;
+
+    entry.prev = entry.next = npos;
+}
+
+void ExpressionCache::pushFront(Shard& shard, std::uint32_t position)
+{
+    auto& entry = shard.entries[position];
+
+    entry.prev = npos;
+    entry.next = shard.head;
+
+    if (shard.head != npos) shard.entries[shard.head].prev = position;
+    shard.head = position;
+
+    if (shard.tail == npos) shard.tail = position;
+}
@@ -0,0 +1,83 @@
+#ifndef SERVER_EXPRESSIONCACHE_H
+#define SERVER_EXPRESSIONCACHE_H
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+/// Ограниченный по размеру LRU-кэш результатов вычисления выражений.
+/// Разбит на независимые шарды со своими мьютексами, чтобы потоки сервера не толкались
+/// на одной блокировке. Ключи хранятся внутри заранее выделенных записей, поэтому
+/// поиск (в том числе удачный) не выделяет память.
+class ExpressionCache {
+
+public:
+    /// Максимальная длина ключа. Более длинные выражения не кэшируются.
+    static constexpr std::size_t maxKeyLength = 128;
+
+    /// Закэшированный результат: значение либо код ошибки разбора (как у te_interp).
+    struct Value {
+        double result;
+        int    errorCode;
+    };
+
+    struct Stats {
+        std::uint64_t hits;
+        std::uint64_t misses;
+    };
+
+    /// Параметризированный конструктор класса.
+    explicit ExpressionCache(std::size_t capacity, std::size_t shardCount);
+
+    /// Явно запрещаем любое копирование данных.
+    ExpressionCache(const ExpressionCache& other) = delete;
+    ExpressionCache& operator=(const ExpressionCache& other) = delete;
+
+    /// Ищет значение по ключу и помечает запись как недавно использованную.
+    std::optional<Value> find(std::string_view key);
+    /// Кладет значение в кэш, вытесняя самую давно использованную запись шарда.
+    void insert(std::string_view key, Value value);
+    /// Возвращает суммарные счетчики попаданий и промахов по всем шардам.
+    Stats stats() const;
+
+private:
+    static constexpr std::uint32_t npos = UINT32_MAX;
+
+    struct Entry {
+        std::array<char, maxKeyLength> key;
+        std::uint8_t  keyLength = 0;
+        Value         value {};
+        std::uint32_t prev = npos; //!< Более свежая запись.
+        std::uint32_t next = npos; //!< Более старая запись.
+
+        std::string_view keyView() const { return {key.data(), keyLength}; }
+    };
+
+    struct alignas(64) Shard {
+        std::mutex    mutex;
+        std::size_t   capacity = 0; //!< Максимальное число записей в шарде.
+        std::vector<Entry> entries; //!< Заранее выделенные записи.
+        std::unordered_map<std::string_view, std::uint32_t> index; //!< Ключ -> номер записи.
+        std::uint32_t head = npos;  //!< Самая свежая запись.
+        std::uint32_t tail = npos;  //!< Самая старая запись (кандидат на вытеснение).
+        std::atomic<std::uint64_t> hits   {0};
+        std::atomic<std::uint64_t> misses {0};
+    };
+
+    Shard& shardFor(std::string_view key);
+
+    static void unlink(Shard& shard, std::uint32_t position);
+    static void pushFront(Shard& shard, std::uint32_t position);
+
+private:
+    std::size_t              m_shardCount;
+    std::unique_ptr<Shard[]> m_shards;
+};
+
+#endif //SERVER_EXPRESSIONCACHE_H
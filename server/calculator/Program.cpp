@@ -0,0 +1,381 @@
+#include "Program.h"
+
+#include <cmath>
+#include <array>
+#include <limits>
+#include <algorithm>
+
+#include <tinyexpr.h>
+
+// Константы и макросы из tinyexpr.c, которые не экспортируются в заголовок.
+enum { TE_CONSTANT = 1 };
+
+static constexpr int typeMask(int type)   { return type & 0x0000001F; }
+static constexpr bool isPure(int type)    { return (type & TE_FLAG_PURE) != 0; }
+static constexpr bool isClosure(int type) { return (type & TE_CLOSURE0) != 0; }
+static constexpr int arityOf(int type)    { return (type & (TE_FUNCTION0 | TE_CLOSURE0)) ? (type & 0x00000007) : 0; }
+
+namespace {
+    /// Указатели на внутренние (static) функции tinyexpr для операторов.
+    /// Снаружи их не достать, поэтому вытаскиваем из деревьев, разобранных из выражений-образцов.
+    struct KnownOperations {
+        const void* add      = nullptr;
+        const void* subtract = nullptr;
+        const void* multiply = nullptr;
+        const void* divide   = nullptr;
+        const void* negate   = nullptr;
+        const void* power    = nullptr;
+        const void* modulo   = nullptr;
+    };
+
+    const void* probe(const char* expression)
+    {
+        double a = 0.0, b = 0.0;
+        const te_variable variables[] = {{"a", &a, TE_VARIABLE, nullptr},
+                                         {"b", &b, TE_VARIABLE, nullptr}};
+        int errorCode = 0;
+        auto* root = te_compile(expression, variables, 2, &errorCode);
+        if (!root) return nullptr;
+
+        const void* function = (root->type & (TE_FUNCTION0 | TE_CLOSURE0)) ? root->function : nullptr;
+        te_free(root);
+
+        return function;
+    }
+
+    const KnownOperations& knownOperations()
+    {
+        static const KnownOperations operations = []() {
+            KnownOperations result;
+            result.add      = probe("a+b");
+            result.subtract = probe("a-b");
+            result.multiply = probe("a*b");
+            result.divide   = probe("a/b");
+            result.negate   = probe("-a");
+            result.power    = probe("a^b");
+            result.modulo   = probe("a%b");
+            return result;
+        }();
+
+        return operations;
+    }
+
+    /// Вызывает функцию tinyexpr произвольной арности (как это делает te_eval).
+    double call(const void* function, void* context, bool closure, int arity, const double* a)
+    {
+        using f0 = double (*)();
+        using f1 = double (*)(double);
+        using f2 = double (*)(double, double);
+        using f3 = double (*)(double, double, double);
+        using f4 = double (*)(double, double, double, double);
+        using f5 = double (*)(double, double, double, double, double);
+        using f6 = double (*)(double, double, double, double, double, double);
+        using f7 = double (*)(double, double, double, double, double, double, double);
+
+        using c0 = double (*)(void*);
+        using c1 = double (*)(void*, double);
+        using c2 = double (*)(void*, double, double);
+        using c3 = double (*)(void*, double, double, double);
+        using c4 = double (*)(void*, double, double, double, double);
+        using c5 = double (*)(void*, double, double, double, double, double);
+        using c6 = double (*)(void*, double, double, double, double, double, double);
+        using c7 = double (*)(void*, double, double, double, double, double, double, double);
+
+        if (closure) {
+            switch (arity) {
+                case 0: return reinterpret_cast<c0>(function)(context);
+                case 1: return reinterpret_cast<c1>(function)(context, a[0]);
+                case 2: return reinterpret_cast<c2>(function)(context, a[0], a[1]);
+                case 3: return reinterpret_cast<c3>(function)(context, a[0], a[1], a[2]);
+                case 4: return reinterpret_cast<c4>(function)(context, a[0], a[1], a[2], a[3]);
+                case 5: return reinterpret_cast<c5>(function)(context, a[0], a[1], a[2], a[3], a[4]);
+                case 6: return reinterpret_cast<c6>(function)(context, a[0], a[1], a[2], a[3], a[4], a[5]);
+                case 7: return reinterpret_cast<c7>(function)(context, a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+                default: return std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+
+        switch (arity) {
+            case 0: return reinterpret_cast<f0>(function)();
+            case 1: return reinterpret_cast<f1>(function)(a[0]);
+            case 2: return reinterpret_cast<f2>(function)(a[0], a[1]);
+            case 3: return reinterpret_cast<f3>(function)(a[0], a[1], a[2]);
+            case 4: return reinterpret_cast<f4>(function)(a[0], a[1], a[2], a[3]);
+            case 5: return reinterpret_cast<f5>(function)(a[0], a[1], a[2], a[3], a[4]);
+            case 6: return reinterpret_cast<f6>(function)(a[0], a[1], a[2], a[3], a[4], a[5]);
+            case 7: return reinterpret_cast<f7>(function)(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+            default: return std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+}
+
+bool Program::compile(const te_expr* root, const double* variables, std::size_t variableCount)
+{
+    m_code.clear();
+    m_registerCount = 0;
+    m_variables     = variables;
+    m_variableCount = variableCount;
+
+    const auto compiled = root && compileNode(root, 0);
+
+    m_variables     = nullptr;
+    m_variableCount = 0;
+
+    if (!compiled) {
+        m_code.clear();
+        m_registerCount = 0;
+    }
+
+    return compiled;
+}
+
+void Program::emit(const Instruction& instruction)
+{
+    Slot slot;
+    slot.instruction = instruction;
+    m_code.push_back(slot);
+}
+
+bool Program::compileNode(const te_expr* node, std::uint16_t dst)
+{
+    if (dst == std::numeric_limits<std::uint16_t>::max()) return false;
+    m_registerCount = std::max<std::size_t>(m_registerCount, dst + 1u);
+
+    Instruction instruction {};
+    instruction.dst = dst;
+
+    switch (typeMask(node->type)) {
+        case TE_CONSTANT:
+            instruction.op    = OpCode::constant;
+            instruction.value = node->value;
+            emit(instruction);
+            return true;
+        case TE_VARIABLE: {
+            if (!m_variables || node->bound < m_variables || node->bound >= m_variables + m_variableCount) {
+                return false;
+            }
+            instruction.op = OpCode::variable;
+            instruction.a  = static_cast<std::uint16_t>(node->bound - m_variables);
+            emit(instruction);
+            return true;
+        }
+        default:
+            break;
+    }
+
+    const auto arity   = arityOf(node->type);
+    const auto closure = isClosure(node->type);
+
+    // Аргументы кладем в регистры dst, dst + 1, ... - результат потом пишется поверх первого.
+    // Так регистры переиспользуются, и их нужно не больше, чем (глубина дерева) * (арность).
+    std::uint16_t arguments[7];
+    bool constantArguments = true;
+    std::array<double, 7> values {};
+    const auto start = m_code.size();
+
+    for (int i = 0; i < arity; ++i) {
+        arguments[i] = static_cast<std::uint16_t>(dst + i);
+        const auto before = m_code.size();
+        if (!compileNode(static_cast<const te_expr*>(node->parameters[i]), arguments[i])) return false;
+        // Аргумент, который свернулся в одну константу.
+        const auto& last = m_code.back().instruction;
+        if (m_code.size() - before == 1 && last.op == OpCode::constant) {
+            values[i] = last.value;
+        } else {
+            constantArguments = false;
+        }
+    }
+
+    // Сворачиваем чистую функцию от констант прямо при компиляции.
+    if (isPure(node->type) && constantArguments) {
+        m_code.resize(start);
+        instruction.op    = OpCode::constant;
+        instruction.value = call(node->function, closure ? node->parameters[arity] : nullptr,
+                                 closure, arity, values.data());
+        emit(instruction);
+        return true;
+    }
+
+    const auto& known = knownOperations();
+    const auto* function = node->function;
+    instruction.a = arity > 0 ? arguments[0] : 0;
+    instruction.b = arity > 1 ? arguments[1] : 0;
+
+    if (!closure && arity == 2 && function == known.add)           instruction.op = OpCode::add;
+    else if (!closure && arity == 2 && function == known.subtract) instruction.op = OpCode::subtract;
+    else if (!closure && arity == 2 && function == known.multiply) instruction.op = OpCode::multiply;
+    else if (!closure && arity == 2 && function == known.divide)   instruction.op = OpCode::divide;
+    else if (!closure && arity == 1 && function == known.negate)   instruction.op = OpCode::negate;
+    else if (!closure && arity == 2 && function == known.power)    instruction.op = OpCode::power;
+    else if (!closure && arity == 2 && function == known.modulo)   instruction.op = OpCode::modulo;
+    else if (!closure && arity == 1) {
+        instruction.op       = OpCode::call1;
+        instruction.function = function;
+    } else if (!closure && arity == 2) {
+        instruction.op       = OpCode::call2;
+        instruction.function = function;
+    } else {
+        instruction.op       = closure ? OpCode::closureN : OpCode::callN;
+        instruction.arity    = static_cast<std::uint8_t>(arity);
+        instruction.function = function;
+        emit(instruction);
+
+        Slot operands;
+        std::fill(std::begin(operands.operands.registers), std::end(operands.operands.registers), 0);
+        std::copy(arguments, arguments + arity, operands.operands.registers);
+        m_code.push_back(operands);
+
+        if (closure) {
+            Instruction context {};
+            context.context = node->parameters[arity];
+            emit(context);
+        }
+        return true;
+    }
+
+    emit(instruction);
+    return true;
+}
+
+double Program::run(const double* variables) const
+{
+    if (m_registerCount <= stackRegisters) {
+        std::array<double, stackRegisters> registers;
+        execute(registers.data(), variables);
+        return registers[0];
+    }
+
+    std::vector<double> registers(m_registerCount);
+    execute(registers.data(), variables);
+    return registers[0];
+}
+
+void Program::execute(double* r, const double* variables) const
+{
+    const auto* ip  = m_code.data();
+    const auto* end = ip + m_code.size();
+
+    while (ip != end) {
+        const auto& in = ip->instruction;
+
+        switch (in.op) {
+            case OpCode::constant: r[in.dst] = in.value;                 break;
+            case OpCode::variable: r[in.dst] = variables[in.a];          break;
+            case OpCode::add:      r[in.dst] = r[in.a] + r[in.b];        break;
+            case OpCode::subtract: r[in.dst] = r[in.a] - r[in.b];        break;
+            case OpCode::multiply: r[in.dst] = r[in.a] * r[in.b];        break;
+            case OpCode::divide:   r[in.dst] = r[in.a] / r[in.b];        break;
+            case OpCode::negate:   r[in.dst] = -r[in.a];                 break;
+            case OpCode::power:    r[in.dst] = std::pow(r[in.a], r[in.b]);  break;
+            case OpCode::modulo:   r[in.dst] = std::fmod(r[in.a], r[in.b]); break;
+            case OpCode::call1:
+                r[in.dst] = reinterpret_cast<double (*)(double)>(in.function)(r[in.a]);
+                break;
+            case OpCode::call2:
+                r[in.dst] = reinterpret_cast<double (*)(double, double)>(in.function)(r[in.a], r[in.b]);
+                break;
+            case OpCode::callN:
+            case OpCode::closureN: {
+                const auto& operands = ip[1].operands;
+                const auto closure   = in.op == OpCode::closureN;
+                double arguments[7];
+                for (int i = 0; i < in.arity; ++i) {
+                    arguments[i] = r[operands.registers[i]];
+                }
+                r[in.dst] = call(in.function, closure ? ip[2].instruction.context : nullptr,
+                                 closure, in.arity, arguments);
+                ip += closure ? 2 : 1;
+                break;
+            }
+        }
+
+        ++ip;
+    }
+}
+
+void Program::runBatch(const double* const* columns, std::size_t count, double* results) const
+{
+    // Регистры - это столбцы по chunkSize значений.
+    std::vector<double> registers(std::max<std::size_t>(m_registerCount, 1) * chunkSize);
+
+    for (std::size_t offset = 0; offset < count; offset += chunkSize) {
+        const auto length = std::min(chunkSize, count - offset);
+        executeBatch(registers.data(), columns, offset, length);
+        std::copy_n(registers.data(), length, results + offset);
+    }
+}
+
+void Program::executeBatch(double* registers, const double* const* columns,
+                           std::size_t offset, std::size_t length) const
+{
+    const auto column = [registers](std::uint16_t index) { return registers + index * chunkSize; };
+
+    const auto* ip  = m_code.data();
+    const auto* end = ip + m_code.size();
+
+    while (ip != end) {
+        const auto& in = ip->instruction;
+        // Результат может писаться поверх первого аргумента - это безопасно, так как
+        // i-й элемент результата зависит только от i-х элементов аргументов.
+        auto* out       = column(in.dst);
+        const double* a = column(in.a);
+        const double* b = column(in.b);
+
+        switch (in.op) {
+            case OpCode::constant:
+                std::fill_n(out, length, in.value);
+                break;
+            case OpCode::variable:
+                std::copy_n(columns[in.a] + offset, length, out);
+                break;
+            case OpCode::add:
+                for (std::size_t i = 0; i < length; ++i) out[i] = a[i] + b[i];
+                break;
+            case OpCode::subtract:
+                for (std::size_t i = 0; i < length; ++i) out[i] = a[i] - b[i];
+                break;
+            case OpCode::multiply:
+                for (std::size_t i = 0; i < length; ++i) out[i] = a[i] * b[i];
+                break;
+            case OpCode::divide:
+                for (std::size_t i = 0; i < length; ++i) out[i] = a[i] / b[i];
+                break;
+            case OpCode::negate:
+                for (std::size_t i = 0; i < length; ++i) out[i] = -a[i];
+                break;
+            case OpCode::power:
+                for (std::size_t i = 0; i < length; ++i) out[i] = std::pow(a[i], b[i]);
+                break;
+            case OpCode::modulo:
+                for (std::size_t i = 0; i < length; ++i) out[i] = std::fmod(a[i], b[i]);
+                break;
+            case OpCode::call1: {
+                const auto function = reinterpret_cast<double (*)(double)>(in.function);
+                for (std::size_t i = 0; i < length; ++i) out[i] = function(a[i]);
+                break;
+            }
+            case OpCode::call2: {
+                const auto function = reinterpret_cast<double (*)(double, double)>(in.function);
+                for (std::size_t i = 0; i < length; ++i) out[i] = function(a[i], b[i]);
+                break;
+            }
+            case OpCode::callN:
+            case OpCode::closureN: {
+                const auto& operands = ip[1].operands;
+                const auto closure   = in.op == OpCode::closureN;
+                auto* context        = closure ? ip[2].instruction.context : nullptr;
+                double arguments[7];
+                for (std::size_t i = 0; i < length; ++i) {
+                    for (int k = 0; k < in.arity; ++k) {
+                        arguments[k] = column(operands.registers[k])[i];
+                    }
+                    out[i] = call(in.function, context, closure, in.arity, arguments);
+                }
+                ip += closure ? 2 : 1;
+                break;
+            }
+        }
+
+        ++ip;
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef SERVER_PROGRAM_H
+#define SERVER_PROGRAM_H
+
+#include <vector>
+#include <cstdint>
+
+struct te_expr;
+
+/// Скомпилированное выражение tinyexpr.
+/// Дерево te_expr обходится один раз при компиляции: константные поддеревья сворачиваются,
+/// а остальное превращается в линейную регистровую программу, лежащую одним непрерывным
+/// блоком. Программа выполняется плоским циклом по инструкциям - без рекурсии и без разбора
+/// типов узлов. Все вычисления ведутся в double.
+class Program {
+
+public:
+    /// Код операции. Арифметика выполняется прямо в цикле интерпретатора,
+    /// остальные функции tinyexpr вызываются через указатель.
+    enum class OpCode : uint8_t {
+        constant = 0, //!< r[dst] = value
+        variable,     //!< r[dst] = variables[a]
+        add,          //!< r[dst] = r[a] + r[b]
+        subtract,     //!< r[dst] = r[a] - r[b]
+        multiply,     //!< r[dst] = r[a] * r[b]
+        divide,       //!< r[dst] = r[a] / r[b]
+        negate,       //!< r[dst] = -r[a]
+        power,        //!< r[dst] = pow(r[a], r[b])
+        modulo,       //!< r[dst] = fmod(r[a], r[b])
+        call1,        //!< r[dst] = function(r[a])
+        call2,        //!< r[dst] = function(r[a], r[b])
+        callN,        //!< Следующий слот - номера регистров аргументов.
+        closureN      //!< Как callN, плюс еще один слот с контекстом замыкания.
+    };
+
+    /// Инструкция занимает 16 байт. Инструкции callN/closureN занимают 2/3 слота подряд.
+    struct Instruction {
+        OpCode        op;
+        std::uint8_t  arity;
+        std::uint16_t dst;
+        std::uint16_t a;
+        std::uint16_t b;
+        union {
+            double      value;
+            const void* function;
+            void*       context;
+        };
+    };
+
+    /// Слот с номерами регистров аргументов для callN/closureN.
+    struct Operands {
+        std::uint16_t registers[8];
+    };
+
+    union Slot {
+        Instruction instruction;
+        Operands    operands;
+    };
+
+    /// Компилирует дерево. Переменные дерева должны быть привязаны к адресам
+    /// variables[0 .. variableCount); переменная с адресом variables + k получает номер k.
+    /// Возвращает false, если дерево не поддерживается (тогда его нужно считать te_eval).
+    bool compile(const te_expr* root, const double* variables = nullptr, std::size_t variableCount = 0);
+
+    /// Выполняет программу для одного набора значений переменных.
+    double run(const double* variables = nullptr) const;
+    /// Выполняет программу для count наборов: columns[k][i] - значение k-й переменной в i-м наборе.
+    /// Каждая инструкция обрабатывает сразу блок наборов, поэтому циклы векторизуются.
+    void runBatch(const double* const* columns, std::size_t count, double* results) const;
+
+    /// Размер программы в слотах.
+    std::size_t size() const { return m_code.size(); }
+    /// Число регистров, нужных программе.
+    std::size_t registerCount() const { return m_registerCount; }
+
+private:
+    /// Максимум регистров, которые помещаются в регистровый файл на стеке.
+    static constexpr std::size_t stackRegisters = 64;
+    /// Размер блока наборов в runBatch.
+    static constexpr std::size_t chunkSize = 128;
+
+    bool compileNode(const te_expr* node, std::uint16_t dst);
+    void emit(const Instruction& instruction);
+
+    void execute(double* registers, const double* variables) const;
+    void executeBatch(double* registers, const double* const* columns,
+                      std::size_t offset, std::size_t length) const;
+
+private:
+    std::vector<Slot> m_code;              //!< Инструкции программы.
+    std::size_t       m_registerCount = 0;
+
+    const double*     m_variables     = nullptr; //!< Используется только при компиляции.
+    std::size_t       m_variableCount = 0;
+};
+
+#endif //SERVER_PROGRAM_H
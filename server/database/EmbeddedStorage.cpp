@@ -0,0 +1,228 @@
+#include "EmbeddedStorage.h"
+#include "Logger.h"
+
+#include <array>
+#include <cmath>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/asio/use_awaitable.hpp>
+
+/// Атомарно списывает amount, если на балансе достаточно. Возвращает баланс после списания.
+static std::optional<std::int32_t> charge(std::atomic<std::int32_t>& balance, std::int32_t amount)
+{
+    auto current = balance.load(std::memory_order_relaxed);
+    while (current >= amount && amount > 0) {
+        if (balance.compare_exchange_weak(current, current - amount, std::memory_order_relaxed)) {
+            return current - amount;
+        }
+    }
+
+    return std::nullopt;
+}
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+EmbeddedStorage::EmbeddedStorage(const std::string& usersPath,
+                                 const std::string& logPath,
+                                 std::size_t maxLogSize,
+                                 std::size_t logGrowStep,
+                                 std::chrono::milliseconds syncInterval,
+                                 bool waitForSync,
+                                 Logger& logger)
+                                 : m_log(logPath, maxLogSize, logGrowStep, syncInterval, logger)
+                                 , m_waitForSync(waitForSync)
+                                 , mr_logger(logger)
+{
+    loadUsers(usersPath);
+
+    // Восстанавливаем балансы: каждая запись журнала - одно списание.
+    std::size_t records = 0, orphans = 0;
+    m_log.replay([this, &records, &orphans](const SessionLog::Record& record, const std::uint64_t position) {
+        ++records;
+        if (const auto found = m_byID.find(record.userID); found != m_byID.end()) {
+            found->second->balance.fetch_sub(1, std::memory_order_relaxed);
+            found->second->history.push_back(position);
+        } else {
+            ++orphans;
+        }
+    });
+
+    mr_logger.info("sessions", "recovered ", records, " session log records (", orphans, " of unknown users)");
+
+    m_log.start();
+}
+
+void EmbeddedStorage::loadUsers(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Не удалось открыть файл пользователей " + path);
+    }
+
+    std::string line;
+    for (std::size_t number = 1; std::getline(file, line); ++number) {
+        if (line.empty() || line.front() == '#') continue;
+
+        auto user = std::make_unique<UserRecord>();
+        std::int32_t balance = 0;
+        std::istringstream fields(line);
+        if (!(fields >> user->id >> user->login >> user->password >> balance)) {
+            throw std::runtime_error("Некорректная строка " + std::to_string(number) + " в файле " + path);
+        }
+        user->balance.store(balance);
+
+        if (m_byID.count(user->id) != 0 || m_byLogin.count(user->login) != 0) {
+            throw std::runtime_error("Повторяющийся пользователь в строке " + std::to_string(number)
+                                     + " файла " + path);
+        }
+        m_byID.emplace(user->id, user.get());
+        m_byLogin.emplace(user->login, user.get());
+        m_users.push_back(std::move(user));
+    }
+}
+
+void EmbeddedStorage::stop(std::function<void()> onStopped)
+{
+    // Сбрасываем журнал на диск и будим всех, кто его ждет.
+    m_log.stop();
+    onStopped();
+}
+
+boost::asio::awaitable<Storage::AuthResult> EmbeddedStorage::auth(boost::asio::io_context&,
+                                                                  const std::string_view login,
+                                                                  const std::string_view password)
+{
+    const auto found = m_byLogin.find(login);
+    if (found == m_byLogin.end() || found->second->password != password) {
+        co_return AuthResult {};
+    }
+
+    co_return AuthResult {found->second->id, found->second->balance.load(std::memory_order_relaxed)};
+}
+
+boost::asio::awaitable<Storage::ChargeResult> EmbeddedStorage::chargeAndLog(boost::asio::io_context&,
+                                                                            const std::int64_t userID,
+                                                                            const std::string_view expression,
+                                                                            const double resultOfExpression)
+{
+    const auto found = m_byID.find(userID);
+    if (found == m_byID.end()) {
+        co_return ChargeResult {ChargeStatus::failed, 0};
+    }
+
+    const auto balance = charge(found->second->balance, 1);
+    if (!balance) {
+        co_return ChargeResult {ChargeStatus::insufficientFunds, 0};
+    }
+
+    const SessionLog::Record record {userID, now(), resultOfExpression, expression};
+    co_return co_await log(*found->second, *balance, &record, 1);
+}
+
+boost::asio::awaitable<Storage::ChargeResult> EmbeddedStorage::chargeAndLogBatch(
+        boost::asio::io_context&,
+        const std::int64_t userID,
+        const std::vector<std::string>& expressions,
+        const std::vector<double>& results)
+{
+    const auto found = m_byID.find(userID);
+    if (found == m_byID.end()) {
+        co_return ChargeResult {ChargeStatus::failed, 0};
+    }
+
+    const auto balance = charge(found->second->balance, static_cast<std::int32_t>(expressions.size()));
+    if (!balance) {
+        co_return ChargeResult {ChargeStatus::insufficientFunds, 0};
+    }
+
+    const auto timestamp = now();
+    std::vector<SessionLog::Record> records;
+    records.reserve(expressions.size());
+    for (std::size_t i = 0; i < expressions.size(); ++i) {
+        records.push_back({userID, timestamp, results[i], expressions[i]});
+    }
+
+    co_return co_await log(*found->second, *balance, records.data(), records.size());
+}
+
+boost::asio::awaitable<Storage::ChargeResult> EmbeddedStorage::log(UserRecord& user,
+                                                                   std::int32_t balance,
+                                                                   const SessionLog::Record* records,
+                                                                   std::size_t count)
+{
+    const auto amount = static_cast<std::int32_t>(count);
+
+    // Журнал заполнен (или сервер останавливается) - списание без записи недопустимо.
+    std::vector<std::uint64_t> positions(count);
+    const auto position = m_log.append(records, count, positions.data());
+    if (!position) {
+        user.balance.fetch_add(amount, std::memory_order_relaxed);
+        co_return ChargeResult {ChargeStatus::failed, 0};
+    }
+
+    // Другая сессия пользователя могла дописать свои записи раньше наших, но отметить их позже.
+    {
+        const std::lock_guard lock(user.historyMutex);
+        if (user.history.empty() || user.history.back() < positions.front()) {
+            user.history.insert(user.history.end(), positions.begin(), positions.end());
+        } else {
+            user.history.insert(std::upper_bound(user.history.begin(), user.history.end(), positions.front()),
+                                positions.begin(), positions.end());
+        }
+    }
+
+    // Запись уже в журнале, и при перезапуске списание восстановится из него. Если диск
+    // подвел, клиенту об этом сообщаем, но деньги не возвращаем - иначе баланс разошелся бы с журналом.
+    if (m_waitForSync && !co_await m_log.asyncSync(*position, boost::asio::use_awaitable)) {
+        co_return ChargeResult {ChargeStatus::failed, 0};
+    }
+
+    co_return ChargeResult {ChargeStatus::charged, balance};
+}
+
+boost::asio::awaitable<std::optional<std::vector<Storage::HistoryEntry>>> EmbeddedStorage::history(
+        boost::asio::io_context&,
+        const std::int64_t userID,
+        const std::optional<HistoryCursor> before,
+        const std::size_t limit)
+{
+    std::vector<HistoryEntry> entries;
+    const auto found = m_byID.find(userID);
+    if (found == m_byID.end()) {
+        co_return entries;
+    }
+
+    // Позицию страницы находим двоичным поиском, а записи читаем из журнала уже без блокировки.
+    std::vector<std::uint64_t> positions;
+    {
+        auto& user = *found->second;
+        const std::lock_guard lock(user.historyMutex);
+        const auto end = before
+                ? std::lower_bound(user.history.begin(), user.history.end(),
+                                   static_cast<std::uint64_t>(std::max<std::int64_t>(before->id, 0)))
+                : user.history.end();
+        const auto size = std::min<std::size_t>(limit, static_cast<std::size_t>(end - user.history.begin()));
+        positions.assign(end - static_cast<std::ptrdiff_t>(size), end);
+    }
+
+    entries.reserve(positions.size());
+    for (auto position = positions.rbegin(); position != positions.rend(); ++position) {
+        const auto record = m_log.read(*position);
+        std::array<char, 32> result;
+        const auto [end, error] = std::to_chars(result.data(), result.data() + result.size(),
+                                                record.resultOfExpression);
+        entries.push_back({std::llround(record.timestamp * 1e6),
+                           static_cast<std::int64_t>(*position),
+                           std::string(record.expression),
+                           std::string(result.data(), end)});
+    }
+
+    co_return entries;
+}
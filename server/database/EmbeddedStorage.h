@@ -0,0 +1,92 @@
+#ifndef SERVER_EMBEDDEDSTORAGE_H
+#define SERVER_EMBEDDEDSTORAGE_H
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "Storage.h"
+#include "SessionLog.h"
+
+/// Хранилище без базы данных: таблица users в памяти процесса, таблица sessions - в файле
+/// журнала (SessionLog).
+///
+/// Пользователи и начальные балансы читаются из текстового файла со строками
+/// "id login password account_balance" (как в script.sql). Каждая запись журнала - это одно
+/// списание, поэтому при запуске баланс восстанавливается как начальный минус число записей
+/// пользователя в журнале. Отдельно балансы не хранятся и рассогласоваться с журналом не могут.
+class EmbeddedStorage : public Storage {
+
+public:
+    /// Читает пользователей, открывает журнал и восстанавливает балансы.
+    /// Бросает исключение, если файлы не удалось прочитать.
+    explicit EmbeddedStorage(const std::string& usersPath,
+                             const std::string& logPath,
+                             std::size_t maxLogSize,
+                             std::size_t logGrowStep,
+                             std::chrono::milliseconds syncInterval,
+                             bool waitForSync,
+                             Logger& logger);
+    ~EmbeddedStorage() override = default;
+
+    /// Явно запрещаем любое копирование данных.
+    EmbeddedStorage(const EmbeddedStorage& other) = delete;
+    EmbeddedStorage& operator=(const EmbeddedStorage& other) = delete;
+
+    void stop(std::function<void()> onStopped) override;
+
+    boost::asio::awaitable<AuthResult> auth(boost::asio::io_context& context,
+                                            const std::string_view login,
+                                            const std::string_view password) override;
+    /// Если waitForSync, ответ приходит только после того, как запись журнала сброшена на диск
+    /// (вместе с записями остальных соединений, см. SessionLog).
+    boost::asio::awaitable<ChargeResult> chargeAndLog(boost::asio::io_context& context,
+                                                      const std::int64_t userID,
+                                                      const std::string_view expression,
+                                                      const double resultOfExpression) override;
+    boost::asio::awaitable<ChargeResult> chargeAndLogBatch(boost::asio::io_context& context,
+                                                           const std::int64_t userID,
+                                                           const std::vector<std::string>& expressions,
+                                                           const std::vector<double>& results) override;
+    /// Ключ записи истории - ее позиция в журнале (time в позиции не участвует).
+    boost::asio::awaitable<std::optional<std::vector<HistoryEntry>>> history(
+            boost::asio::io_context& context,
+            const std::int64_t userID,
+            const std::optional<HistoryCursor> before,
+            const std::size_t limit) override;
+
+private:
+    struct UserRecord {
+        std::int64_t              id;
+        std::string               login;
+        std::string               password;
+        std::atomic<std::int32_t> balance;
+
+        std::mutex                 historyMutex; //!< Защищает history.
+        std::vector<std::uint64_t> history;      //!< Позиции записей пользователя в журнале, по возрастанию.
+    };
+
+    void loadUsers(const std::string& path);
+    /// Пишет записи в журнал (и ждет диска, если нужно), списание уже сделано и balance - баланс
+    /// после него. Если записать не удалось, возвращает списанное.
+    boost::asio::awaitable<ChargeResult> log(UserRecord& user,
+                                             std::int32_t balance,
+                                             const SessionLog::Record* records,
+                                             std::size_t count);
+
+private:
+    /// После загрузки состав пользователей не меняется, поэтому индексы читаются без блокировок.
+    std::vector<std::unique_ptr<UserRecord>>            m_users;
+    std::unordered_map<std::string_view, UserRecord*>   m_byLogin; //!< Ключ - UserRecord::login.
+    std::unordered_map<std::int64_t, UserRecord*>       m_byID;
+
+    SessionLog m_log;
+    const bool m_waitForSync;
+    Logger&    mr_logger; //!< Журнал сообщений.
+};
+
+#endif //SERVER_EMBEDDEDSTORAGE_H
@@ -1,109 +1,523 @@
 #include "PostgreSQLDatabase.h"
 #include "../models/Structures.h"
+#include "Metrics.h"
+#include "Logger.h"
+#include "config.h"
 
-#include <iostream>
+#include <vector>
+#include <boost/asio/error.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <ozo/request.h>
 #include <ozo/shortcuts.h>
 
+/// Токен завершения для co_await: ошибка запроса пишется в errorCode, а не бросается исключением.
+static auto awaitInto(ozo::error_code& errorCode)
+{
+    return boost::asio::redirect_error(boost::asio::use_awaitable, errorCode);
+}
+
 template <typename ConnectionType>
-static auto handleDatabaseConnectionError(ConnectionType& connection, const ozo::error_code& errorCode){
-    std::cerr << "Request failed with error: " << errorCode.message() << '\n';
-    if (!ozo::is_null_recursive(connection)) {
-        if (auto msg = ozo::error_message(connection); !msg.empty()) {
-            std::cerr << ", error message: " << msg << '\n';
+static auto handleDatabaseConnectionError(Metrics& metrics, Logger& logger, ConnectionType& connection,
+                                          const ozo::error_code& errorCode){
+    metrics.record(Metrics::Error::database);
+    // Одна строка на ошибку: при отказе базы одинаковые ошибки всех запросов журнал склеит.
+    if (ozo::is_null_recursive(connection)) {
+        logger.error("database", "request failed with error: ", errorCode.message());
+        return;
+    }
+    const auto& message = ozo::error_message(connection);
+    const auto& context = ozo::get_error_context(connection);
+    logger.error("database", "request failed with error: ", errorCode.message(),
+                 std::string_view(message).empty() ? "" : ", error message: ", message,
+                 std::string_view(context).empty() ? "" : ", error context: ", context);
+}
+
+template <typename Query, typename Output>
+boost::asio::awaitable<OzoConnection_t> PostgreSQLDatabase::request(boost::asio::io_context& context,
+                                                                    Query query,
+                                                                    std::chrono::steady_clock::duration timeout,
+                                                                    Output output,
+                                                                    ozo::error_code& errorCode)
+{
+    // Соединение берем отдельно от запроса, чтобы видеть, сколько ждем свободное соединение пула.
+    const auto started = Metrics::Clock::now();
+    auto connection = co_await ozo::get_connection(m_ozoConnectionPool[context], timeout, awaitInto(errorCode));
+    const auto waited = Metrics::Clock::now() - started;
+    mr_metrics.poolWait().record(waited);
+    if (errorCode) {
+        co_return connection;
+    }
+    // Ожидание соединения входит в общий срок запроса, как и в ozo::request с пулом. Если срок
+    // весь ушел на ожидание, запрос не отправляем: с нулевым или отрицательным сроком он либо
+    // сразу оборвется, либо (смотря по драйверу) будет ждать без срока.
+    if (waited >= timeout) {
+        errorCode = boost::asio::error::timed_out;
+        co_return connection;
+    }
+
+    co_return co_await ozo::request(std::move(connection), std::move(query), timeout - waited, output,
+                                    awaitInto(errorCode));
+}
+
+PostgreSQLDatabase::PostgreSQLDatabase(boost::asio::io_context& context,
+                                       const config::Settings::Database& settings,
+                                       Metrics& metrics,
+                                       Logger& logger)
+                                       : m_settings(settings)
+                                       , m_ozoConnectionPool(makeOzoConnectionPool(m_settings))
+                                       , mr_metrics(metrics)
+                                       , mr_logger(logger)
+{
+    if constexpr (config::db::journal::enabled) {
+        m_sessionJournal = std::make_unique<SessionJournal>(context, *this,
+                                                            config::db::journal::capacity,
+                                                            config::db::journal::batchSize,
+                                                            config::db::journal::flushInterval,
+                                                            mr_logger);
+        m_sessionJournal->start();
+    }
+
+    if constexpr (config::db::users::enabled) {
+        const auto syncUsers = [this](boost::asio::io_context& context,
+                                      const std::vector<std::int64_t>& ids,
+                                      const std::vector<std::int32_t>& charges) {
+            return this->syncUsers(context, ids, charges);
+        };
+        m_userTable = std::make_unique<UserTable>(context, syncUsers,
+                                                  config::db::users::capacity,
+                                                  config::db::users::syncInterval,
+                                                  config::db::users::idleTimeout);
+        m_userTable->start();
+    }
+}
+
+void PostgreSQLDatabase::stop(std::function<void()> onStopped)
+{
+    // Сначала пишем списания из кэша пользователей, потом сбрасываем журнал сессий.
+    auto stopJournal = [this, onStopped = std::move(onStopped)]() mutable {
+        if (m_sessionJournal) {
+            m_sessionJournal->stop(std::move(onStopped));
+            return;
+        }
+        onStopped();
+    };
+
+    if (m_userTable) {
+        m_userTable->stop(std::move(stopJournal));
+        return;
+    }
+
+    stopJournal();
+}
+
+std::size_t PostgreSQLDatabase::prewarm(boost::asio::io_context& context)
+{
+    std::optional<std::size_t> ready;
+    boost::asio::co_spawn(context, prewarmConnections(context),
+                          [&ready](std::exception_ptr exception, std::size_t count) {
+                              ready = exception ? 0 : count;
+                          });
+    // Очереди задач еще не запущены, поэтому крутим эту сами, пока прогрев не закончится.
+    while (!ready && context.run_one() != 0) {}
+
+    return ready.value_or(0);
+}
+
+boost::asio::awaitable<std::size_t> PostgreSQLDatabase::prewarmConnections(boost::asio::io_context& context)
+{
+    // Держим все соединения разом, иначе пул выдавал бы одно и то же.
+    std::vector<OzoConnection_t> connections;
+    connections.reserve(m_settings.poolMinSize);
+
+    for (std::size_t i = 0; i < m_settings.poolMinSize; ++i) {
+        ozo::error_code errorCode;
+        auto connection = co_await ozo::get_connection(m_ozoConnectionPool[context], m_settings.batchTimeout,
+                                                       awaitInto(errorCode));
+        if (errorCode) {
+            handleDatabaseConnectionError<decltype(connection)>(mr_metrics, mr_logger, connection, errorCode);
+            break;
         }
-        if (auto ctx = ozo::get_error_context(connection); !ctx.empty()) {
-            std::cerr << ", error context: " << ctx << '\n';
+        connections.push_back(std::move(connection));
+    }
+
+    // Проверка заодно вызывает все функции сервера с заведомо пустым результатом: PL/pgSQL
+    // строит планы их запросов на этом соединении, а отсутствие функций (не выполнен
+    // script.sql) видно сразу, а не на первом клиенте.
+    std::size_t ready = 0;
+    for (auto& connection : connections) {
+        ozo::rows_of<std::int64_t> result;
+        ozo::error_code errorCode;
+        const auto query = ozo::make_query(
+                "SELECT (SELECT count(*) FROM calc_auth('', ''))"
+                "     + (SELECT count(*) FROM calc_charge(0, 0))"
+                "     + (SELECT count(*) FROM calc_charge_and_log(0, '{}', '{}'))"
+                "     + (SELECT count(*) FROM calc_history(0, NULL, NULL, 0))");
+        connection = co_await ozo::request(std::move(connection), query, m_settings.batchTimeout,
+                                           ozo::into(result), awaitInto(errorCode));
+        if (errorCode) {
+            handleDatabaseConnectionError<decltype(connection)>(mr_metrics, mr_logger, connection, errorCode);
+            continue;
         }
+        ++ready;
     }
+
+    // Соединения возвращаются в пул, когда vector разрушается (неудачные пул закроет).
+    co_return ready;
 }
 
-PostgreSQLDatabase::PostgreSQLDatabase(boost::asio::io_context& context,
-                                       const std::string_view constring)
-                                       : mr_context(context)
-                                       , m_ozoConnectionPool(makeOzoConnectionPool(constring))
-                                       {}
-
-PostgreSQLDatabase::authReturnT PostgreSQLDatabase::auth(const std::string_view login,
-                                                         const std::string_view password,
-                                                         boost::asio::yield_context& yield)
+boost::asio::awaitable<PostgreSQLDatabase::AuthResult> PostgreSQLDatabase::auth(boost::asio::io_context& context,
+                                                                                const std::string_view login,
+                                                                                const std::string_view password)
 {
     // Для удобства ввода используем литералы.
     using namespace ozo::literals;
     using namespace std::chrono_literals;
 
+    // Пользователь уже входил недавно - база не нужна.
+    if (m_userTable) {
+        if (const auto cached = m_userTable->find(login, password); cached) {
+            co_return AuthResult { cached->id, cached->balance };
+        }
+    }
+
     // Хранит в себе результат запроса
     // @todo Добавить поддержку кастомных типов.
     ozo::rows_of<std::optional<std::int64_t>, std::optional<std::int32_t>> result;
 
     // Содержит в себе код ошибки.
     ozo::error_code errorCode;
-    // Формируем запрос (я не мастер БД, поэтому можно самому поправить)
-    const auto query = ozo::make_query("SELECT id, account_balance FROM users WHERE login = $1 AND password = $2",
-                                       login, password);
+    // Запросы к users и sessions живут в функциях PL/pgSQL (script.sql): их планы строятся
+    // один раз на соединение, а здесь остается только вызов.
+    const auto query = ozo::make_query("SELECT id, account_balance FROM calc_auth($1, $2)", login, password);
     // Делаем запрос в базу данных.
-    const auto connection = ozo::request(m_ozoConnectionPool[mr_context],
-                                         query, 5s, ozo::into(result), yield[errorCode]);
+    const auto connection = co_await request(context, query, m_settings.authTimeout,
+                                             ozo::into(result), errorCode);
     // Обрабатываем возможные ошибки в запросе.
     if (errorCode) {
-        handleDatabaseConnectionError<decltype(connection)>(connection, errorCode);
+        handleDatabaseConnectionError<decltype(connection)>(mr_metrics, mr_logger, connection, errorCode);
     }
     // Если в ответ на запрос пришли непустые данные, считаем это успехом!
     if (!result.empty()) {
-        return { std::get<0>(result.front()), std::get<1>(result.front()) };
+        const auto& [id, balance] = result.front();
+        if (m_userTable && id && balance) {
+            m_userTable->store(login, password, *id, *balance);
+        }
+        co_return AuthResult { id, balance };
+    }
+
+    co_return AuthResult {};
+}
+
+boost::asio::awaitable<PostgreSQLDatabase::ChargeResult> PostgreSQLDatabase::chargeAndLog(
+        boost::asio::io_context& context,
+        const std::int64_t userID,
+        const std::string_view expression,
+        const double resultOfExpression)
+{
+    // Для удобства ввода используем литералы.
+    using namespace ozo::literals;
+    using namespace std::chrono_literals;
+
+    // Пользователь есть в кэше - списываем в памяти, в базу списание уйдет при синхронизации.
+    if (m_userTable) {
+        std::int32_t balance = 0;
+        const auto status = m_userTable->charge(userID, 1, balance);
+        if (status == UserTable::ChargeStatus::insufficientFunds) {
+            co_return ChargeResult {ChargeStatus::insufficientFunds, 0};
+        }
+        if (status == UserTable::ChargeStatus::charged) {
+            co_await logSessions(context, userID, &expression, &resultOfExpression, 1);
+            co_return ChargeResult {ChargeStatus::charged, balance};
+        }
+    }
+
+    // Хранит в себе результат запроса - баланс после списания.
+    ozo::rows_of<std::int32_t> result;
+    // Содержит в себе код ошибки.
+    ozo::error_code errorCode;
+
+    if (m_sessionJournal) {
+        // Списываем атомарно на стороне базы: баланс из памяти соединения может быть
+        // устаревшим (например, у пользователя открыто несколько соединений).
+        const auto query = ozo::make_query("SELECT account_balance FROM calc_charge($1, 1)", userID);
+        const auto connection = co_await request(context, query, m_settings.queryTimeout,
+                                                 ozo::into(result), errorCode);
+        if (errorCode) {
+            handleDatabaseConnectionError<decltype(connection)>(mr_metrics, mr_logger, connection, errorCode);
+            co_return ChargeResult {ChargeStatus::failed, 0};
+        }
+        if (result.empty()) {
+            co_return ChargeResult {ChargeStatus::insufficientFunds, 0};
+        }
+        // Запись в журнал откладываем. Если журнал переполнен, пишем сами и ждем базу.
+        if (!m_sessionJournal->push(userID, expression, resultOfExpression)) {
+            const SessionJournal::Row row {userID,
+                                           std::chrono::duration<double>(
+                                                   std::chrono::system_clock::now().time_since_epoch()).count(),
+                                           std::string(expression),
+                                           resultOfExpression};
+            co_await insertSessions(context, &row, 1);
+        }
+
+        co_return ChargeResult {ChargeStatus::charged, std::get<0>(result.front())};
+    }
+
+    // Без журнала списываем и пишем сессию одним запросом (пакетом из одного выражения):
+    // если денег не хватило, функция не вернет строк и ничего не запишет.
+    const std::vector<std::string> expressions {std::string(expression)};
+    const std::vector<double>      results {resultOfExpression};
+    const auto query = ozo::make_query("SELECT account_balance FROM calc_charge_and_log($1, $2, $3)",
+                                       userID, expressions, results);
+    // Делаем запрос в базу данных.
+    const auto connection = co_await request(context, query, m_settings.queryTimeout,
+                                             ozo::into(result), errorCode);
+    // Обрабатываем ошибки в запросе ...
+    if (errorCode) {
+        handleDatabaseConnectionError<decltype(connection)>(mr_metrics, mr_logger, connection, errorCode);
+        co_return ChargeResult {ChargeStatus::failed, 0};
+    }
+    if (result.empty()) {
+        co_return ChargeResult {ChargeStatus::insufficientFunds, 0};
     }
 
-    return {};
+    co_return ChargeResult {ChargeStatus::charged, std::get<0>(result.front())};
 }
 
-bool PostgreSQLDatabase::sendCalcResult(const std::int64_t userID,
-                                        const std::string_view expression,
-                                        const float resultOfExpression,
-                                        const boost::asio::yield_context& yield)
+boost::asio::awaitable<PostgreSQLDatabase::ChargeResult> PostgreSQLDatabase::chargeAndLogBatch(
+        boost::asio::io_context& context,
+        const std::int64_t userID,
+        const std::vector<std::string>& expressions,
+        const std::vector<double>& results)
+{
+    // Для удобства ввода используем литералы.
+    using namespace ozo::literals;
+    using namespace std::chrono_literals;
+
+    const auto count = static_cast<std::int32_t>(expressions.size());
+
+    // Пользователь есть в кэше - списываем в памяти, в базу списание уйдет при синхронизации.
+    if (m_userTable) {
+        std::int32_t balance = 0;
+        const auto status = m_userTable->charge(userID, count, balance);
+        if (status == UserTable::ChargeStatus::insufficientFunds) {
+            co_return ChargeResult {ChargeStatus::insufficientFunds, 0};
+        }
+        if (status == UserTable::ChargeStatus::charged) {
+            const std::vector<std::string_view> views(expressions.begin(), expressions.end());
+            co_await logSessions(context, userID, views.data(), results.data(), views.size());
+            co_return ChargeResult {ChargeStatus::charged, balance};
+        }
+    }
+
+    // Хранит в себе результат запроса - баланс после списания.
+    ozo::rows_of<std::int32_t> result;
+    // Содержит в себе код ошибки.
+    ozo::error_code errorCode;
+
+    if (m_sessionJournal) {
+        const auto query = ozo::make_query("SELECT account_balance FROM calc_charge($1, $2)", userID, count);
+        const auto connection = co_await request(context, query, m_settings.queryTimeout,
+                                                 ozo::into(result), errorCode);
+        if (errorCode) {
+            handleDatabaseConnectionError<decltype(connection)>(mr_metrics, mr_logger, connection, errorCode);
+            co_return ChargeResult {ChargeStatus::failed, 0};
+        }
+        if (result.empty()) {
+            co_return ChargeResult {ChargeStatus::insufficientFunds, 0};
+        }
+        // То, что не влезло в журнал, пишем сами одним запросом.
+        std::vector<SessionJournal::Row> overflow;
+        for (std::size_t i = 0; i < expressions.size(); ++i) {
+            if (!m_sessionJournal->push(userID, expressions[i], results[i])) {
+                overflow.push_back({userID,
+                                    std::chrono::duration<double>(
+                                            std::chrono::system_clock::now().time_since_epoch()).count(),
+                                    expressions[i],
+                                    results[i]});
+            }
+        }
+        if (!overflow.empty()) {
+            co_await insertSessions(context, overflow.data(), overflow.size());
+        }
+
+        co_return ChargeResult {ChargeStatus::charged, std::get<0>(result.front())};
+    }
+
+    // Без журнала списываем и пишем весь пакет одним запросом.
+    const auto query = ozo::make_query("SELECT account_balance FROM calc_charge_and_log($1, $2, $3)",
+                                       userID, expressions, results);
+    // Делаем запрос в базу данных.
+    const auto connection = co_await request(context, query, m_settings.batchTimeout,
+                                             ozo::into(result), errorCode);
+    // Обрабатываем ошибки в запросе ...
+    if (errorCode) {
+        handleDatabaseConnectionError<decltype(connection)>(mr_metrics, mr_logger, connection, errorCode);
+        co_return ChargeResult {ChargeStatus::failed, 0};
+    }
+    if (result.empty()) {
+        co_return ChargeResult {ChargeStatus::insufficientFunds, 0};
+    }
+
+    co_return ChargeResult {ChargeStatus::charged, std::get<0>(result.front())};
+}
+
+boost::asio::awaitable<std::optional<std::vector<PostgreSQLDatabase::HistoryEntry>>> PostgreSQLDatabase::history(
+        boost::asio::io_context& context,
+        const std::int64_t userID,
+        const std::optional<HistoryCursor> before,
+        const std::size_t limit)
 {
     // Для удобства ввода используем литералы.
     using namespace ozo::literals;
     using namespace std::chrono_literals;
 
     // Хранит в себе результат запроса
-    ozo::rows_of<std::optional<std::int32_t>> result;
+    ozo::rows_of<std::int64_t, std::int64_t, std::string, std::string> result;
+    // Содержит в себе код ошибки.
+    ozo::error_code errorCode;
+    // Без позиции функция получает NULL и начинает с самой новой записи.
+    const auto beforeTime = before ? std::optional<std::int64_t>(before->time) : std::nullopt;
+    const auto beforeID   = before ? std::optional<std::int64_t>(before->id) : std::nullopt;
+    const auto query = ozo::make_query(
+            "SELECT date_us, id, expression, result_of_expression FROM calc_history($1, $2, $3, $4)",
+            userID, beforeTime, beforeID, static_cast<std::int32_t>(limit));
+    // Делаем запрос в базу данных.
+    const auto connection = co_await request(context, query, m_settings.queryTimeout,
+                                             ozo::into(result), errorCode);
+    // Обрабатываем ошибки в запросе ...
+    if (errorCode) {
+        handleDatabaseConnectionError<decltype(connection)>(mr_metrics, mr_logger, connection, errorCode);
+        co_return std::nullopt;
+    }
+
+    std::vector<HistoryEntry> entries;
+    entries.reserve(result.size());
+    for (auto& [time, id, expression, resultOfExpression] : result) {
+        entries.push_back({time, id, std::move(expression), std::move(resultOfExpression)});
+    }
+
+    co_return entries;
+}
+
+boost::asio::awaitable<void> PostgreSQLDatabase::logSessions(boost::asio::io_context& context,
+                                                             const std::int64_t userID,
+                                                             const std::string_view* expressions,
+                                                             const double* results,
+                                                             std::size_t count)
+{
+    const auto now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // То, что не влезло в журнал (или все, если журнала нет), пишем сами одним запросом.
+    std::vector<SessionJournal::Row> overflow;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (!m_sessionJournal || !m_sessionJournal->push(userID, expressions[i], results[i])) {
+            overflow.push_back({userID, now, std::string(expressions[i]), results[i]});
+        }
+    }
+
+    if (!overflow.empty()) {
+        co_await insertSessions(context, overflow.data(), overflow.size());
+    }
+}
+
+boost::asio::awaitable<std::optional<std::vector<UserTable::Snapshot>>> PostgreSQLDatabase::syncUsers(
+        boost::asio::io_context& context,
+        const std::vector<std::int64_t>& ids,
+        const std::vector<std::int32_t>& charges)
+{
+    // Для удобства ввода используем литералы.
+    using namespace ozo::literals;
+    using namespace std::chrono_literals;
+
+    // Хранит в себе результат запроса
+    ozo::rows_of<std::int64_t, std::int32_t, std::string, std::int32_t> result;
     // Содержит в себе код ошибки.
     ozo::error_code errorCode;
-    // Формируем запрос.
-    const auto query =ozo::make_query(
-            "INSERT INTO sessions(user_id, date, expression, result_of_expression) VALUES($1, NOW(), $2, $3)",
-            userID, expression, resultOfExpression);
+    // Списываем накопленное только там, где есть что списывать и где баланса хватает, а читаем
+    // всех: основной SELECT видит users до UPDATE, поэтому для измененных строк берем баланс
+    // из RETURNING. Последний столбец - списание, которое база не приняла (0 - приняла все).
+    const auto query = ozo::make_query(
+            "WITH cached AS ("
+            "    SELECT * FROM unnest($1::bigint[], $2::int[]) AS t(id, charge)"
+            "), charged AS ("
+            "    UPDATE users SET account_balance = users.account_balance - cached.charge "
+            "    FROM cached WHERE users.id = cached.id AND cached.charge > 0 "
+            "                  AND users.account_balance >= cached.charge "
+            "    RETURNING users.id, users.account_balance"
+            ") "
+            "SELECT users.id, COALESCE(charged.account_balance, users.account_balance), users.password, "
+            "       CASE WHEN charged.id IS NULL THEN cached.charge ELSE 0 END "
+            "FROM users JOIN cached ON cached.id = users.id "
+            "LEFT JOIN charged ON charged.id = users.id",
+            ids, charges);
     // Делаем запрос в базу данных.
-    const auto connection = ozo::request(m_ozoConnectionPool[mr_context],
-                                         query, 2s, ozo::into(result), yield);
+    const auto connection = co_await request(context, query, m_settings.batchTimeout,
+                                             ozo::into(result), errorCode);
     // Обрабатываем ошибки в запросе ...
     if (errorCode) {
-        handleDatabaseConnectionError<decltype(connection)>(connection, errorCode);
-        return false;
+        handleDatabaseConnectionError<decltype(connection)>(mr_metrics, mr_logger, connection, errorCode);
+        co_return std::nullopt;
+    }
+
+    std::vector<UserTable::Snapshot> rows;
+    rows.reserve(result.size());
+    for (auto& [id, balance, password, rejected] : result) {
+        // Баланс уменьшили в обход этого процесса - кэш выровняется по базе, а списание теряется.
+        if (rejected > 0) {
+            mr_logger.warning("database", "cached charge of ", rejected, " rejected: user ", id,
+                              " has only ", balance, " in the database");
+        }
+        rows.push_back({id, balance, std::move(password)});
     }
 
-    return true;
+    co_return rows;
 }
 
-void PostgreSQLDatabase::updateBalance(const std::int64_t userID,
-                                       const std::int32_t accountBalance,
-                                       boost::asio::yield_context& yield)
+boost::asio::awaitable<bool> PostgreSQLDatabase::insertSessions(boost::asio::io_context& context,
+                                                                const SessionJournal::Row* rows,
+                                                                std::size_t count)
 {
     // Для удобства ввода используем литералы.
     using namespace ozo::literals;
     using namespace std::chrono_literals;
-    // ...
+
+    // Раскладываем строки по столбцам, чтобы передать их массивами в один запрос.
+    std::vector<std::int64_t> userIDs;
+    std::vector<double>       dates;
+    std::vector<std::string>  expressions;
+    std::vector<double>       results;
+    userIDs.reserve(count);
+    dates.reserve(count);
+    expressions.reserve(count);
+    results.reserve(count);
+
+    for (std::size_t i = 0; i < count; ++i) {
+        userIDs.push_back(rows[i].userID);
+        dates.push_back(rows[i].timestamp);
+        expressions.push_back(rows[i].expression);
+        results.push_back(rows[i].resultOfExpression);
+    }
+
+    // Хранит в себе результат запроса
     ozo::rows_of<std::optional<std::int32_t>> result;
-    // ...
+    // Содержит в себе код ошибки.
     ozo::error_code errorCode;
-    // Формируем запрос.
-    const auto updateQuery = ozo::make_query(
-            "UPDATE users SET account_balance = $1 WHERE id = $2",
-            accountBalance, userID);
-    const auto connection = ozo::request(m_ozoConnectionPool[mr_context],
-                                               updateQuery, 2s, ozo::into(result), yield);
+    // Многострочная вставка одним запросом: массивы разворачиваются в строки через unnest.
+    const auto query = ozo::make_query(
+            "INSERT INTO sessions(user_id, date, expression, result_of_expression) "
+            "SELECT user_id, to_timestamp(date)::timestamp, expression, result::text "
+            "FROM unnest($1::bigint[], $2::float8[], $3::text[], $4::float8[]) AS t(user_id, date, expression, result)",
+            userIDs, dates, expressions, results);
+    // Делаем запрос в базу данных.
+    const auto connection = co_await request(context, query, m_settings.batchTimeout,
+                                             ozo::into(result), errorCode);
     // Обрабатываем ошибки в запросе ...
     if (errorCode) {
-        handleDatabaseConnectionError<decltype(connection)>(connection, errorCode);
+        handleDatabaseConnectionError<decltype(connection)>(mr_metrics, mr_logger, connection, errorCode);
+        co_return false;
     }
+
+    co_return true;
 }
@@ -3,16 +3,33 @@
 
 #define BOOST_HANA_CONFIG_ENABLE_STRING_UDL 1
 
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
 #include <string_view>
 
+#include <boost/asio/awaitable.hpp>
+
 #include <ozo/connection_info.h>
 #include <ozo/connection_pool.h>
 
+#include "Settings.h"
+#include "Storage.h"
+#include "SessionJournal.h"
+#include "UserTable.h"
+
 using namespace std::string_view_literals;
 
-static auto makeOzoConnectionPool(const std::string_view constring) {
-    auto connectionInfo = ozo::connection_info(constring.data());
+static auto makeOzoConnectionPool(const config::Settings::Database& settings) {
+    auto connectionInfo = ozo::connection_info(settings.constring);
     ozo::connection_pool_config  connectionConfig;
+    connectionConfig.capacity       = settings.poolCapacity;
+    connectionConfig.queue_capacity = settings.queueCapacity;
+    connectionConfig.idle_timeout   = settings.idleTimeout;
+    connectionConfig.lifespan       = settings.lifespan;
 
     /**
      * Можно задать конфигурацию соединения через config.<параметр> = <значение> (даже несколько)
@@ -20,36 +37,101 @@ static auto makeOzoConnectionPool(const std::string_view constring) {
      * см. документацию: https://github.com/yandex/ozo
      * */
 
+    // По умолчанию пул создается потокобезопасным (внутри resource_pool защищен мьютексом),
+    // так что им могут одновременно пользоваться все шарды сервера. Соединение привязывается
+    // к io_context того шарда, который его запросил (см. m_ozoConnectionPool[context]).
     return ozo::make_connection_pool(connectionInfo, connectionConfig);
 }
 
 using OzoConnectionPool_t = std::invoke_result_t<
-        decltype(&makeOzoConnectionPool), const std::string_view>;
+        decltype(&makeOzoConnectionPool), const config::Settings::Database&>;
+/// Соединение, выданное пулом.
+using OzoConnection_t = ozo::connection_type<
+        decltype(std::declval<OzoConnectionPool_t&>()[std::declval<boost::asio::io_context&>()])>;
 
 class User;
+class Logger;
+class Metrics;
 
-class PostgreSQLDatabase {
-    using authReturnT = std::pair<std::optional<std::int64_t>, std::optional<std::int32_t>>;
+class PostgreSQLDatabase : public Storage {
 public:
-    explicit PostgreSQLDatabase(boost::asio::io_context& context,  const std::string_view constring);
-    ~PostgreSQLDatabase() = default;
+    /// Контекст нужен для фоновых задач (сброса журнала сессий).
+    explicit PostgreSQLDatabase(boost::asio::io_context& context,
+                                const config::Settings::Database& settings,
+                                Metrics& metrics,
+                                Logger& logger);
+    ~PostgreSQLDatabase() override = default;
+
+    /// Сбрасывает все отложенные записи и вызывает обработчик по завершении.
+    void stop(std::function<void()> onStopped) override;
+
+    /// Заранее открывает db.pool_min_size соединений пула и проверяет каждое, заодно строя на нем
+    /// планы запросов сервера, - чтобы первые клиенты не ждали ни соединения, ни планирования.
+    /// Вызывается до запуска очередей задач: сам крутит context, пока прогрев не закончится.
+    /// Возвращает, сколько соединений готово.
+    std::size_t prewarm(boost::asio::io_context& context);
+
+    /** Все запросы - корутины, выполняются в контексте (шарде) вызывающей стороны. */
 
     /// Проверяет наличие пользователя в базе данных.
-    authReturnT auth(const std::string_view login,
-                     const std::string_view password,
-                     boost::asio::yield_context& yield);
-    /// Обновляет баланс пользователя.
-    void updateBalance(const std::int64_t userID,
-                       const std::int32_t accountBalance,
-                       boost::asio::yield_context& yield);
-    /// Отправляет результат математического операции на сервер.
-    bool sendCalcResult(const std::int64_t userID,
-                        const std::string_view expression,
-                        const float resultOfExpression,
-                        const boost::asio::yield_context& yield);
+    boost::asio::awaitable<AuthResult> auth(boost::asio::io_context& context,
+                                            const std::string_view login,
+                                            const std::string_view password) override;
+    /// Списывает единицу с баланса пользователя (если он положительный) и записывает
+    /// результат вычисления в sessions - за один запрос к базе.
+    /// Если журнал сессий включен, запись в sessions откладывается, а списание остается синхронным.
+    boost::asio::awaitable<ChargeResult> chargeAndLog(boost::asio::io_context& context,
+                                                      const std::int64_t userID,
+                                                      const std::string_view expression,
+                                                      const double resultOfExpression) override;
+    /// То же для пакета: списывает expressions.size() единиц разом (только если хватает на весь
+    /// пакет) и записывает все результаты - одной операцией с базой.
+    boost::asio::awaitable<ChargeResult> chargeAndLogBatch(boost::asio::io_context& context,
+                                                           const std::int64_t userID,
+                                                           const std::vector<std::string>& expressions,
+                                                           const std::vector<double>& results) override;
+    /// Страница истории из sessions (функция calc_history). Записи, еще лежащие в журнале
+    /// сессий, в нее не попадают, пока журнал их не сбросит.
+    boost::asio::awaitable<std::optional<std::vector<HistoryEntry>>> history(
+            boost::asio::io_context& context,
+            const std::int64_t userID,
+            const std::optional<HistoryCursor> before,
+            const std::size_t limit) override;
+    /// Списывает накопленные в кэше списания (charges[i] с пользователя ids[i]) и возвращает
+    /// актуальные баланс и пароль этих пользователей. nullopt - ошибка базы.
+    boost::asio::awaitable<std::optional<std::vector<UserTable::Snapshot>>> syncUsers(
+            boost::asio::io_context& context,
+            const std::vector<std::int64_t>& ids,
+            const std::vector<std::int32_t>& charges);
+    /// Записывает пачку строк в таблицу sessions одним запросом.
+    boost::asio::awaitable<bool> insertSessions(boost::asio::io_context& context,
+                                                const SessionJournal::Row* rows,
+                                                std::size_t count);
 private:
-    OzoConnectionPool_t      m_ozoConnectionPool;
-    boost::asio::io_context& mr_context;
+    const config::Settings::Database m_settings;
+    OzoConnectionPool_t             m_ozoConnectionPool;
+    std::unique_ptr<SessionJournal> m_sessionJournal; //!< Журнал сессий (может отсутствовать).
+    std::unique_ptr<UserTable>      m_userTable;      //!< Кэш пользователей (может отсутствовать).
+    Metrics&                        mr_metrics;
+    Logger&                         mr_logger;        //!< Ошибки запросов пишутся в журнал без ожидания.
+
+    /// Берет соединение из пула (замеряя, сколько его пришлось ждать) и выполняет на нем запрос.
+    template <typename Query, typename Output>
+    boost::asio::awaitable<OzoConnection_t> request(boost::asio::io_context& context,
+                                                    Query query,
+                                                    std::chrono::steady_clock::duration timeout,
+                                                    Output output,
+                                                    ozo::error_code& errorCode);
+
+    /// Корутина прогрева (см. prewarm).
+    boost::asio::awaitable<std::size_t> prewarmConnections(boost::asio::io_context& context);
+
+    /// Записывает сессии после списания в кэше: в журнал, а если он выключен или переполнен - сразу.
+    boost::asio::awaitable<void> logSessions(boost::asio::io_context& context,
+                                             const std::int64_t userID,
+                                             const std::string_view* expressions,
+                                             const double* results,
+                                             std::size_t count);
 };
 
 #endif //SERVER_POSTGRESQLDATABASE_H
@@ -0,0 +1,133 @@
+#include "SessionJournal.h"
+#include "PostgreSQLDatabase.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+SessionJournal::SessionJournal(boost::asio::io_context& context,
+                               PostgreSQLDatabase& database,
+                               std::size_t capacity,
+                               std::size_t batchSize,
+                               std::chrono::milliseconds flushInterval,
+                               Logger& logger)
+                               : mr_context(context)
+                               , mr_database(database)
+                               , mr_logger(logger)
+                               , m_timer(context)
+                               , m_capacity(capacity)
+                               , m_batchSize(std::max<std::size_t>(batchSize, 1))
+                               , m_flushInterval(flushInterval)
+{
+    m_queue.reserve(m_capacity);
+    m_batch.reserve(m_capacity);
+}
+
+bool SessionJournal::push(std::int64_t userID, std::string_view expression, double resultOfExpression)
+{
+    const auto now = std::chrono::duration<double>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::lock_guard lock(m_mutex);
+    // Очередь переполнена - пусть вызывающая сторона ждет базу сама (обратное давление).
+    if (m_stopping || m_queue.size() + m_inFlight >= m_capacity) {
+        return false;
+    }
+
+    m_queue.push_back({userID, now, std::string(expression), resultOfExpression});
+    // Набралась полная пачка - будим фоновую корутину, не дожидаясь таймера.
+    if (m_queue.size() >= m_batchSize && !m_wakeupScheduled) {
+        m_wakeupScheduled = true;
+        boost::asio::post(mr_context, [this]() { m_timer.cancel(); });
+    }
+
+    return true;
+}
+
+void SessionJournal::start()
+{
+    boost::asio::co_spawn(mr_context, flushLoop(), boost::asio::detached);
+}
+
+void SessionJournal::stop(std::function<void()> onStopped)
+{
+    boost::asio::post(mr_context, [this, onStopped = std::move(onStopped)]() mutable {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_onStopped = std::move(onStopped);
+        m_timer.cancel();
+    });
+}
+
+boost::asio::awaitable<void> SessionJournal::flushLoop()
+{
+    while (true) {
+        bool stopping;
+        {
+            std::lock_guard lock(m_mutex);
+            stopping          = m_stopping;
+            m_wakeupScheduled = false;
+            // Если предыдущая пачка записана, забираем всю очередь целиком. Векторы просто
+            // меняются местами, так что память переиспользуется.
+            if (m_batch.empty()) {
+                std::swap(m_batch, m_queue);
+                m_inFlight = m_batch.size();
+            }
+        }
+
+        const bool written = co_await writeBatch();
+
+        {
+            std::lock_guard lock(m_mutex);
+            if (stopping) {
+                if (m_batch.empty() && m_queue.empty()) break;
+                // База недоступна - дальше ждать нечего.
+                if (!written) {
+                    mr_logger.error("sessions", "rows lost on shutdown: ", m_batch.size() + m_queue.size());
+                    break;
+                }
+                continue;
+            }
+            // Пока мы писали, набралась еще одна пачка - пишем сразу.
+            if (written && m_queue.size() >= m_batchSize) continue;
+        }
+
+        boost::system::error_code errorCode;
+        m_timer.expires_after(m_flushInterval);
+        co_await m_timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, errorCode));
+    }
+
+    if (m_onStopped) {
+        m_onStopped();
+    }
+}
+
+boost::asio::awaitable<bool> SessionJournal::writeBatch()
+{
+    std::size_t written = 0;
+    bool succeeded = true;
+
+    while (written < m_batch.size()) {
+        const auto count = std::min(m_batchSize, m_batch.size() - written);
+        // При ошибке оставляем неотправленные строки и пробуем еще раз на следующем тике.
+        if (!co_await mr_database.insertSessions(mr_context, m_batch.data() + written, count)) {
+            succeeded = false;
+            break;
+        }
+        written += count;
+    }
+
+    m_batch.erase(m_batch.begin(), m_batch.begin() + static_cast<std::ptrdiff_t>(written));
+
+    std::lock_guard lock(m_mutex);
+    m_inFlight = m_batch.size();
+
+    co_return succeeded;
+}
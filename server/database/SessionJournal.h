@@ -0,0 +1,81 @@
+#ifndef SERVER_SESSIONJOURNAL_H
+#define SERVER_SESSIONJOURNAL_H
+
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/awaitable.hpp>
+
+class PostgreSQLDatabase;
+class Logger;
+
+/// Журнал сессий с отложенной записью (write-behind).
+/// Строки таблицы sessions копятся в памяти и пачками сбрасываются в базу данных фоновой
+/// корутиной - по таймеру или как только набралась полная пачка. Клиенту больше не нужно
+/// ждать записи в журнал, чтобы получить ответ.
+class SessionJournal {
+
+public:
+    /// Строка таблицы sessions.
+    struct Row {
+        std::int64_t userID;
+        double       timestamp;          //!< Время вычисления (секунды с начала эпохи).
+        std::string  expression;
+        double       resultOfExpression;
+    };
+
+    /// Параметризированный конструктор класса.
+    explicit SessionJournal(boost::asio::io_context& context,
+                            PostgreSQLDatabase& database,
+                            std::size_t capacity,
+                            std::size_t batchSize,
+                            std::chrono::milliseconds flushInterval,
+                            Logger& logger);
+
+    /// Явно запрещаем любое копирование данных.
+    SessionJournal(const SessionJournal& other) = delete;
+    SessionJournal& operator=(const SessionJournal& other) = delete;
+
+    /// Кладет строку в очередь. Потокобезопасен.
+    /// Возвращает false, если очередь переполнена (база не успевает) или журнал остановлен -
+    /// в этом случае вызывающая сторона должна записать строку сама.
+    bool push(std::int64_t userID, std::string_view expression, double resultOfExpression);
+
+    /// Запускает фоновую корутину сброса.
+    void start();
+    /// Сбрасывает все, что осталось в очереди, и вызывает обработчик по завершении.
+    void stop(std::function<void()> onStopped);
+
+private:
+    boost::asio::awaitable<void> flushLoop();
+    /// Пишет m_batch в базу пачками по m_batchSize. Записанные строки удаляются из m_batch.
+    boost::asio::awaitable<bool> writeBatch();
+
+private:
+    boost::asio::io_context&  mr_context;  //!< Контекст фоновой корутины.
+    PostgreSQLDatabase&       mr_database; //!< База данных.
+    Logger&                   mr_logger;   //!< Журнал сообщений.
+    boost::asio::steady_timer m_timer;     //!< Таймер периодического сброса.
+
+    std::mutex       m_mutex;            //!< Защищает поля ниже.
+    std::vector<Row> m_queue;            //!< Строки, ожидающие сброса.
+    std::size_t      m_inFlight = 0;     //!< Сколько строк сейчас пишется (размер m_batch).
+    bool             m_stopping = false;
+    bool             m_wakeupScheduled = false;
+
+    std::vector<Row>      m_batch;     //!< Строки, которые пишет фоновая корутина.
+    std::function<void()> m_onStopped; //!< Вызывается после финального сброса.
+
+    const std::size_t               m_capacity;      //!< Максимум строк в памяти.
+    const std::size_t               m_batchSize;     //!< Максимум строк в одном запросе.
+    const std::chrono::milliseconds m_flushInterval; //!< Период сброса.
+};
+
+#endif //SERVER_SESSIONJOURNAL_H
@@ -0,0 +1,328 @@
+#include "SessionLog.h"
+#include "Logger.h"
+
+#include <array>
+#include <cstring>
+#include <algorithm>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    /// Заголовок файла журнала.
+    struct FileHeader {
+        char          magic[8];
+        std::uint32_t version;
+        std::uint32_t reserved;
+    };
+
+    constexpr char          magic[8]       = {'C', 'A', 'L', 'C', 'S', 'L', 'O', 'G'};
+    constexpr std::uint32_t version        = 1;
+    constexpr std::size_t   headerSize     = sizeof(FileHeader);
+    constexpr std::size_t   recordHeader   = 2 * sizeof(std::uint32_t);   //!< Длина и контрольная сумма.
+    constexpr std::size_t   fixedPayload   = 3 * sizeof(std::uint64_t);   //!< userID, timestamp, result.
+    constexpr std::size_t   maxPayload     = 16 * 1024 * 1024;            //!< Защита от мусора при чтении.
+
+    constexpr std::size_t align8(std::size_t size) { return (size + 7) & ~std::size_t {7}; }
+
+    /// Таблица CRC32 (полином 0xEDB88320).
+    constexpr auto crcTable = []() {
+        std::array<std::uint32_t, 256> table {};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            auto value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            table[i] = value;
+        }
+        return table;
+    }();
+
+    /// CRC32 данных, продолжающая сумму seed (так суммы записей сцепляются в цепочку).
+    std::uint32_t crc32(std::uint32_t seed, const std::byte* data, std::size_t size)
+    {
+        auto crc = ~seed;
+        for (std::size_t i = 0; i < size; ++i) {
+            crc = crcTable[(crc ^ static_cast<std::uint32_t>(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    [[noreturn]] void throwSystemError(const std::string& what)
+    {
+        throw std::system_error(errno, std::system_category(), what);
+    }
+}
+
+SessionLog::SessionLog(const std::string& path,
+                       std::size_t maxSize,
+                       std::size_t growStep,
+                       std::chrono::milliseconds syncInterval,
+                       Logger& logger)
+                       : m_maxSize(std::max(maxSize, headerSize))
+                       , m_growStep(std::max<std::size_t>(growStep, 4096))
+                       , m_syncInterval(syncInterval)
+                       , mr_logger(logger)
+{
+    m_file = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_file < 0) {
+        throwSystemError("Не удалось открыть журнал сессий " + path);
+    }
+
+    struct stat status {};
+    if (::fstat(m_file, &status) != 0) {
+        ::close(m_file);
+        throwSystemError("Не удалось открыть журнал сессий " + path);
+    }
+    m_fileSize = static_cast<std::uint64_t>(status.st_size);
+
+    if (m_fileSize > m_maxSize) {
+        ::close(m_file);
+        throw std::runtime_error("Журнал сессий " + path + " больше допустимого размера");
+    }
+
+    const bool created = m_fileSize == 0;
+    if (created && !reserve(headerSize)) {
+        ::close(m_file);
+        throwSystemError("Не удалось создать журнал сессий " + path);
+    }
+
+    // Отображаем сразу весь допустимый размер: файл растет под отображением, и адреса не меняются.
+    void* data = ::mmap(nullptr, m_maxSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+    if (data == MAP_FAILED) {
+        ::close(m_file);
+        throwSystemError("Не удалось отобразить журнал сессий " + path);
+    }
+    m_data = static_cast<std::byte*>(data);
+
+    if (created) {
+        FileHeader header {};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        std::memcpy(m_data, &header, sizeof(header));
+        ::msync(m_data, headerSize, MS_SYNC);
+        ::fsync(m_file);
+    } else {
+        FileHeader header {};
+        if (m_fileSize >= headerSize) {
+            std::memcpy(&header, m_data, sizeof(header));
+        }
+        if (m_fileSize < headerSize || std::memcmp(header.magic, magic, sizeof(magic)) != 0
+            || header.version != version) {
+            ::munmap(m_data, m_maxSize);
+            ::close(m_file);
+            throw std::runtime_error("Файл " + path + " не является журналом сессий");
+        }
+    }
+
+    m_written = headerSize;
+    m_synced  = headerSize;
+    m_resized = false;
+}
+
+SessionLog::~SessionLog()
+{
+    stop();
+
+    if (m_data != nullptr) {
+        ::munmap(m_data, m_maxSize);
+    }
+    if (m_file >= 0) {
+        ::close(m_file);
+    }
+}
+
+void SessionLog::replay(const std::function<void(const Record&, std::uint64_t position)>& visitor)
+{
+    std::uint64_t offset = headerSize;
+    std::uint32_t crc    = 0;
+
+    while (offset + recordHeader <= m_fileSize) {
+        std::uint32_t length, storedCrc;
+        std::memcpy(&length, m_data + offset, sizeof(length));
+        std::memcpy(&storedCrc, m_data + offset + sizeof(length), sizeof(storedCrc));
+
+        // Нули (недописанный хвост), мусор или обрыв цепочки - журнал кончился.
+        if (length < fixedPayload || length > maxPayload || offset + recordHeader + length > m_fileSize) break;
+
+        const auto* payload = m_data + offset + recordHeader;
+        if (crc32(crc, payload, length) != storedCrc) break;
+
+        visitor(read(offset), offset);
+
+        crc     = storedCrc;
+        offset += align8(recordHeader + length);
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_written = offset;
+    m_synced  = offset;
+    m_lastCrc = crc;
+}
+
+SessionLog::Record SessionLog::read(const std::uint64_t position) const
+{
+    std::uint32_t length;
+    std::memcpy(&length, m_data + position, sizeof(length));
+    const auto* payload = m_data + position + recordHeader;
+
+    Record record {};
+    std::memcpy(&record.userID, payload, sizeof(record.userID));
+    std::memcpy(&record.timestamp, payload + 8, sizeof(record.timestamp));
+    std::memcpy(&record.resultOfExpression, payload + 16, sizeof(record.resultOfExpression));
+    record.expression = std::string_view(reinterpret_cast<const char*>(payload + fixedPayload),
+                                         length - fixedPayload);
+    return record;
+}
+
+std::optional<std::uint64_t> SessionLog::append(const Record* records, std::size_t count,
+                                                std::uint64_t* positions)
+{
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        size += align8(recordHeader + fixedPayload + records[i].expression.size());
+    }
+
+    std::lock_guard lock(m_mutex);
+    if (m_stopping || !reserve(m_written + size)) {
+        return std::nullopt;
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto& record = records[i];
+        const auto  length = static_cast<std::uint32_t>(fixedPayload + record.expression.size());
+
+        if (positions != nullptr) {
+            positions[i] = m_written;
+        }
+        auto* header  = m_data + m_written;
+        auto* payload = header + recordHeader;
+        std::memcpy(payload, &record.userID, sizeof(record.userID));
+        std::memcpy(payload + 8, &record.timestamp, sizeof(record.timestamp));
+        std::memcpy(payload + 16, &record.resultOfExpression, sizeof(record.resultOfExpression));
+        std::memcpy(payload + fixedPayload, record.expression.data(), record.expression.size());
+
+        m_lastCrc = crc32(m_lastCrc, payload, length);
+        std::memcpy(header, &length, sizeof(length));
+        std::memcpy(header + sizeof(length), &m_lastCrc, sizeof(m_lastCrc));
+
+        // Выравнивание заполняем нулями, чтобы содержимое файла не зависело от прошлых данных.
+        const auto padded = align8(recordHeader + length);
+        std::memset(payload + length, 0, padded - recordHeader - length);
+        m_written += padded;
+    }
+
+    return m_written;
+}
+
+bool SessionLog::reserve(std::uint64_t size)
+{
+    if (size <= m_fileSize) return true;
+    if (size > m_maxSize) return false;
+
+    // Место выделяем сразу (а не дырой в файле): запись в отображение без места на диске
+    // закончилась бы SIGBUS, а так ошибка придет здесь.
+    const auto newSize = std::min<std::uint64_t>(m_maxSize, (size + m_growStep - 1) / m_growStep * m_growStep);
+    if (::posix_fallocate(m_file, static_cast<off_t>(m_fileSize), static_cast<off_t>(newSize - m_fileSize)) != 0) {
+        return false;
+    }
+
+    m_fileSize = newSize;
+    m_resized  = true;
+
+    return true;
+}
+
+void SessionLog::addWaiter(std::uint64_t position, std::unique_ptr<Waiter> waiter)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        if (position > m_synced) {
+            waiter->position = position;
+            m_waiters.push_back(std::move(waiter));
+            m_condition.notify_one();
+            return;
+        }
+    }
+
+    waiter->complete(true);
+}
+
+void SessionLog::start()
+{
+    m_syncThread = std::thread([this]() { syncLoop(); });
+}
+
+void SessionLog::stop()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_one();
+
+    if (m_syncThread.joinable()) {
+        m_syncThread.join();
+    }
+
+    // Поток сброса не запускался или уже вышел - будим тех, кто остался.
+    std::vector<std::unique_ptr<Waiter>> waiters;
+    {
+        std::lock_guard lock(m_mutex);
+        waiters.swap(m_waiters);
+    }
+    for (auto& waiter : waiters) {
+        waiter->complete(waiter->position <= m_synced);
+    }
+}
+
+void SessionLog::syncLoop()
+{
+    static const auto pageSize = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+
+    std::vector<std::unique_ptr<Waiter>> waiters;
+    std::unique_lock lock(m_mutex);
+
+    while (true) {
+        m_condition.wait_for(lock, m_syncInterval, [this]() { return m_stopping || !m_waiters.empty(); });
+
+        // Все, что записано к этому моменту, сбрасываем одним вызовом - за всех ожидающих сразу.
+        const auto from     = m_synced;
+        const auto to       = m_written;
+        const bool resized  = std::exchange(m_resized, false);
+        const bool stopping = m_stopping;
+        waiters.swap(m_waiters);
+        lock.unlock();
+
+        bool synced = true;
+        if (to > from) {
+            const auto begin = from / pageSize * pageSize;
+            synced = ::msync(m_data + begin, to - begin, MS_SYNC) == 0;
+        }
+        // Размер файла - метаданные, msync их не сбрасывает.
+        if (synced && resized) {
+            synced = ::fdatasync(m_file) == 0;
+        }
+        if (!synced) {
+            mr_logger.error("sessions", "failed to sync the session log: ", std::strerror(errno));
+        }
+
+        for (auto& waiter : waiters) {
+            waiter->complete(synced);
+        }
+        waiters.clear();
+
+        lock.lock();
+        if (synced) {
+            m_synced = std::max(m_synced, to);
+        } else if (resized) {
+            m_resized = true;
+        }
+
+        if (stopping) break;
+    }
+}
@@ -0,0 +1,138 @@
+#ifndef SERVER_SESSIONLOG_H
+#define SERVER_SESSIONLOG_H
+
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include <string_view>
+#include <condition_variable>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/associated_executor.hpp>
+
+class Logger;
+
+/// Журнал сессий в файле: отображенный в память (mmap), только на дописывание.
+///
+/// Формат: заголовок файла, затем записи, выровненные по 8 байт:
+///   [длина полезных данных: uint32][контрольная сумма: uint32][userID][timestamp][result][выражение]
+/// Контрольная сумма - CRC32 полезных данных, засеянная суммой предыдущей записи. Цепочка сумм
+/// обрывается на первой недописанной записи, а старые записи за ней (оставшиеся после прошлого
+/// восстановления) не сойдутся с новой цепочкой, поэтому хвост файла обнулять не нужно.
+///
+/// Дописывание - memcpy под мьютексом. На диск данные сбрасывает отдельный поток: все записи,
+/// накопившиеся к моменту сброса, уходят одним msync (group commit), и все, кто их ждал, будят
+/// одновременно. Файл растет кусками по growStep, а отображается сразу на maxSize, поэтому
+/// адреса записей не меняются и сбрасывать их можно без мьютекса.
+class SessionLog {
+
+public:
+    /// Запись журнала. expression указывает либо в файл, либо в память вызывающей стороны.
+    struct Record {
+        std::int64_t     userID;
+        double           timestamp;          //!< Время вычисления (секунды с начала эпохи).
+        double           resultOfExpression;
+        std::string_view expression;
+    };
+
+    /// Открывает (или создает) файл журнала. Бросает std::system_error при ошибке.
+    explicit SessionLog(const std::string& path,
+                        std::size_t maxSize,
+                        std::size_t growStep,
+                        std::chrono::milliseconds syncInterval,
+                        Logger& logger);
+    ~SessionLog();
+
+    /// Явно запрещаем любое копирование данных.
+    SessionLog(const SessionLog& other) = delete;
+    SessionLog& operator=(const SessionLog& other) = delete;
+
+    /// Проходит по всем целым записям (при запуске, до start()), передавая и позицию каждой.
+    /// Запоминает, где журнал кончается.
+    void replay(const std::function<void(const Record&, std::uint64_t position)>& visitor);
+
+    /// Дописывает записи одним куском. Потокобезопасен. Возвращает позицию конца последней
+    /// записи (для asyncSync) или nullopt, если журнал заполнен или остановлен.
+    /// Если positions задан, в него пишутся позиции начала записей (для read).
+    std::optional<std::uint64_t> append(const Record* records, std::size_t count,
+                                        std::uint64_t* positions = nullptr);
+
+    /// Читает запись по позиции, полученной от replay или append. Записанное не меняется,
+    /// поэтому блокировка не нужна: достаточно, чтобы позиция была получена после записи.
+    Record read(std::uint64_t position) const;
+
+    /// Ждет, пока журнал до позиции position окажется на диске. Сигнатура обработчика - void(bool):
+    /// false, если сбросить не удалось. Обработчик вызывается через свой исполнитель.
+    template <typename CompletionToken>
+    auto asyncSync(std::uint64_t position, CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void(bool)>(
+                [this](auto handler, std::uint64_t position) {
+                    using Handler = decltype(handler);
+                    addWaiter(position, std::make_unique<WaiterImpl<Handler>>(std::move(handler)));
+                },
+                token, position);
+    }
+
+    /// Запускает поток сброса.
+    void start();
+    /// Сбрасывает все записанное на диск и останавливает поток сброса.
+    void stop();
+
+private:
+    /// Ожидающий сброса. Обработчики асинхронных операций только перемещаемы, поэтому не std::function.
+    struct Waiter {
+        virtual ~Waiter() = default;
+        virtual void complete(bool synced) = 0;
+
+        std::uint64_t position = 0;
+    };
+
+    template <typename Handler>
+    struct WaiterImpl : Waiter {
+        explicit WaiterImpl(Handler&& handler) : handler(std::move(handler)) {}
+
+        void complete(bool synced) override
+        {
+            // Возвращаемся в поток (шард) ожидающего.
+            const auto executor = boost::asio::get_associated_executor(handler);
+            boost::asio::post(executor, [handler = std::move(handler), synced]() mutable { handler(synced); });
+        }
+
+        Handler handler;
+    };
+
+    void addWaiter(std::uint64_t position, std::unique_ptr<Waiter> waiter);
+    void syncLoop();
+    /// Увеличивает файл так, чтобы в него влезло size байт. Вызывается под мьютексом.
+    bool reserve(std::uint64_t size);
+
+private:
+    int            m_file    = -1;
+    std::byte*     m_data    = nullptr;
+    std::size_t    m_maxSize;
+    std::size_t    m_growStep;
+    std::uint64_t  m_fileSize;        //!< Текущий размер файла.
+
+    std::mutex              m_mutex;     //!< Защищает поля ниже.
+    std::condition_variable m_condition; //!< Будит поток сброса.
+    std::uint64_t m_written  = 0;        //!< Конец последней записи.
+    std::uint64_t m_synced   = 0;        //!< До куда журнал точно на диске.
+    std::uint32_t m_lastCrc  = 0;        //!< Контрольная сумма последней записи.
+    bool          m_resized  = false;    //!< Файл вырос после последнего сброса.
+    bool          m_stopping = false;
+    std::vector<std::unique_ptr<Waiter>> m_waiters;
+
+    const std::chrono::milliseconds m_syncInterval; //!< Период сброса, если никто не ждет.
+    Logger&                         mr_logger;      //!< Журнал сообщений (ошибки сброса).
+    std::thread                     m_syncThread;
+};
+
+#endif //SERVER_SESSIONLOG_H
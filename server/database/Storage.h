@@ -0,0 +1,78 @@
+#ifndef SERVER_STORAGE_H
+#define SERVER_STORAGE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <optional>
+#include <functional>
+#include <string_view>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/awaitable.hpp>
+
+/// Хранилище пользователей и журнала вычислений, с которым работают соединения.
+/// Реализации: PostgreSQLDatabase (база данных) и EmbeddedStorage (память процесса + файл журнала).
+class Storage {
+
+public:
+    /// Идентификатор и баланс пользователя. Пустые значения - пользователь не найден.
+    using AuthResult = std::pair<std::optional<std::int64_t>, std::optional<std::int32_t>>;
+
+    enum class ChargeStatus : uint8_t { charged = 0, insufficientFunds, failed };
+
+    /// Результат списания. balance - актуальный баланс после списания.
+    struct ChargeResult {
+        ChargeStatus status;
+        std::int32_t balance;
+    };
+
+    /// Запись истории вычислений пользователя.
+    struct HistoryEntry {
+        std::int64_t time;       //!< Время вычисления (микросекунды с начала эпохи).
+        std::int64_t id;         //!< Ключ записи в хранилище (вместе с time - позиция в истории).
+        std::string  expression;
+        std::string  result;
+    };
+
+    /// Позиция в истории: следующая страница начинается с записей строго старше (time, id).
+    struct HistoryCursor {
+        std::int64_t time;
+        std::int64_t id;
+    };
+
+    virtual ~Storage() = default;
+
+    /// Сбрасывает все отложенные записи и вызывает обработчик по завершении.
+    virtual void stop(std::function<void()> onStopped) = 0;
+
+    /** Все запросы - корутины, выполняются в контексте (шарде) вызывающей стороны. */
+
+    /// Проверяет логин и пароль пользователя.
+    virtual boost::asio::awaitable<AuthResult> auth(boost::asio::io_context& context,
+                                                    const std::string_view login,
+                                                    const std::string_view password) = 0;
+    /// Списывает единицу с баланса пользователя (если он положительный) и записывает
+    /// результат вычисления в журнал сессий.
+    virtual boost::asio::awaitable<ChargeResult> chargeAndLog(boost::asio::io_context& context,
+                                                              const std::int64_t userID,
+                                                              const std::string_view expression,
+                                                              const double resultOfExpression) = 0;
+    /// То же для пакета: списывает expressions.size() единиц разом (только если хватает на весь
+    /// пакет) и записывает все результаты.
+    virtual boost::asio::awaitable<ChargeResult> chargeAndLogBatch(boost::asio::io_context& context,
+                                                                   const std::int64_t userID,
+                                                                   const std::vector<std::string>& expressions,
+                                                                   const std::vector<double>& results) = 0;
+    /// Страница истории пользователя: не больше limit записей старше before (без before - самые
+    /// новые), от новых к старым. Страница находится по позиции, а не по номеру, поэтому ее
+    /// стоимость не зависит от того, сколько записей в истории. nullopt - ошибка хранилища.
+    virtual boost::asio::awaitable<std::optional<std::vector<HistoryEntry>>> history(
+            boost::asio::io_context& context,
+            const std::int64_t userID,
+            const std::optional<HistoryCursor> before,
+            const std::size_t limit) = 0;
+};
+
+#endif //SERVER_STORAGE_H
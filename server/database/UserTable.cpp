@@ -0,0 +1,259 @@
+#include "UserTable.h"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+UserTable::UserTable(boost::asio::io_context& context,
+                     SyncUsers syncUsers,
+                     std::size_t capacity,
+                     std::chrono::milliseconds syncInterval,
+                     std::chrono::seconds idleTimeout)
+                     : mr_context(context)
+                     , m_syncUsers(std::move(syncUsers))
+                     , m_timer(context)
+                     , m_byLogin(std::make_unique<Shard<std::string_view>[]>(shardCount))
+                     , m_byID(std::make_unique<Shard<std::int64_t>[]>(shardCount))
+                     , m_capacity(capacity)
+                     , m_syncInterval(syncInterval)
+                     , m_idleTimeout(idleTimeout)
+                     {}
+
+std::optional<UserTable::Credentials> UserTable::find(std::string_view login, std::string_view password)
+{
+    auto& shard = loginShard(login);
+
+    std::lock_guard lock(shard.mutex);
+
+    const auto found = shard.entries.find(login);
+    if (found == shard.entries.end() || found->second->password != password) {
+        return std::nullopt;
+    }
+
+    auto& entry = *found->second;
+    entry.lastUsed.store(now(), std::memory_order_relaxed);
+
+    return Credentials {entry.id, entry.balance.load(std::memory_order_relaxed)};
+}
+
+void UserTable::store(std::string_view login, std::string_view password, std::int64_t id, std::int32_t balance)
+{
+    // Кэш заполнен - пользователь будет работать напрямую с базой.
+    if (m_size.load(std::memory_order_relaxed) >= m_capacity) return;
+
+    auto entry = std::make_shared<Entry>();
+    entry->id       = id;
+    entry->login    = login;
+    entry->password = password;
+    entry->balance.store(balance);
+    entry->pending.store(0);
+    entry->known = balance;
+    entry->lastUsed.store(now());
+
+    {
+        auto& shard = idShard(id);
+        std::lock_guard lock(shard.mutex);
+        // Пользователь уже есть (например, вошел с другого соединения) - у кэша баланс свежее.
+        if (!shard.entries.emplace(id, entry).second) return;
+    }
+    {
+        auto& shard = loginShard(login);
+        std::lock_guard lock(shard.mutex);
+        // Ключ ссылается на строку записи, поэтому старую запись удаляем вместе с ее ключом.
+        shard.entries.erase(entry->login);
+        shard.entries.emplace(entry->login, entry);
+    }
+
+    m_size.fetch_add(1, std::memory_order_relaxed);
+}
+
+UserTable::ChargeStatus UserTable::charge(std::int64_t id, std::int32_t amount, std::int32_t& balance)
+{
+    // Списываем под мьютексом шарда: под ним же evict проверяет pending и убирает запись,
+    // поэтому списание не может попасть в уже вытесненную запись, которую sync больше не увидит.
+    auto& shard = idShard(id);
+    std::lock_guard lock(shard.mutex);
+    const auto found = shard.entries.find(id);
+    if (found == shard.entries.end()) {
+        return ChargeStatus::unknownUser;
+    }
+
+    auto& entry = *found->second;
+    entry.lastUsed.store(now(), std::memory_order_relaxed);
+    // Уменьшаем баланс, только если его хватает. sync прибавляет к балансу поправки без
+    // мьютекса, поэтому сравнение и запись все равно должны быть одной операцией.
+    auto current = entry.balance.load(std::memory_order_relaxed);
+    do {
+        if (current < amount) {
+            return ChargeStatus::insufficientFunds;
+        }
+    } while (!entry.balance.compare_exchange_weak(current, current - amount, std::memory_order_relaxed));
+
+    entry.pending.fetch_add(amount, std::memory_order_relaxed);
+    balance = current - amount;
+
+    return ChargeStatus::charged;
+}
+
+void UserTable::start()
+{
+    boost::asio::co_spawn(mr_context, syncLoop(), boost::asio::detached);
+}
+
+void UserTable::stop(std::function<void()> onStopped)
+{
+    boost::asio::post(mr_context, [this, onStopped = std::move(onStopped)]() mutable {
+        m_stopping  = true;
+        m_onStopped = std::move(onStopped);
+        m_timer.cancel();
+    });
+}
+
+boost::asio::awaitable<void> UserTable::syncLoop()
+{
+    while (!m_stopping) {
+        boost::system::error_code errorCode;
+        m_timer.expires_after(m_syncInterval);
+        co_await m_timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, errorCode));
+
+        co_await sync();
+    }
+    // Списания, сделанные во время последней синхронизации, тоже нужно записать.
+    co_await sync();
+
+    if (m_onStopped) {
+        m_onStopped();
+    }
+}
+
+boost::asio::awaitable<bool> UserTable::sync()
+{
+    // Снимок всех закэшированных пользователей и их незаписанных списаний.
+    std::vector<EntryPtr>     entries;
+    std::vector<std::int64_t> ids;
+    std::vector<std::int32_t> charges;
+
+    for (std::size_t i = 0; i < shardCount; ++i) {
+        std::lock_guard lock(m_byID[i].mutex);
+        for (const auto& [id, entry] : m_byID[i].entries) {
+            entries.push_back(entry);
+        }
+    }
+
+    if (entries.empty()) co_return true;
+
+    for (const auto& entry : entries) {
+        ids.push_back(entry->id);
+        charges.push_back(entry->pending.exchange(0, std::memory_order_relaxed));
+    }
+
+    const auto rows = co_await m_syncUsers(mr_context, ids, charges);
+    if (!rows) {
+        // База недоступна - возвращаем списания, попробуем в следующий раз.
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            entries[i]->pending.fetch_add(charges[i], std::memory_order_relaxed);
+        }
+        co_return false;
+    }
+
+    std::unordered_map<std::int64_t, const Snapshot*> actual;
+    for (const auto& row : *rows) {
+        actual.emplace(row.id, &row);
+    }
+
+    const auto idleSince = now() - std::chrono::duration_cast<std::chrono::nanoseconds>(m_idleTimeout).count();
+
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const auto& entry = entries[i];
+        const auto found = actual.find(entry->id);
+        // Пользователя удалили из базы.
+        if (found == actual.end()) {
+            erase(entry);
+            continue;
+        }
+
+        // Кэш считал, что в базе станет known - charges[i]. Разницу с настоящим балансом
+        // (изменения в обход сервера, не принятые базой списания) прибавляем, а не записываем
+        // баланс целиком: charge в это время продолжает уменьшать его своим CAS.
+        const auto actualBalance = found->second->balance;
+        entry->balance.fetch_add(actualBalance - (entry->known - charges[i]), std::memory_order_relaxed);
+        entry->known = actualBalance;
+        {
+            auto& shard = loginShard(entry->login);
+            std::lock_guard lock(shard.mutex);
+            entry->password = found->second->password;
+        }
+
+        // Давно неактивных пользователей без незаписанных списаний вытесняем.
+        evict(entry, idleSince);
+    }
+
+    co_return true;
+}
+
+void UserTable::erase(const EntryPtr& entry)
+{
+    eraseLogin(entry);
+    {
+        auto& shard = idShard(entry->id);
+        std::lock_guard lock(shard.mutex);
+        if (const auto found = shard.entries.find(entry->id);
+            found != shard.entries.end() && found->second == entry) {
+            shard.entries.erase(found);
+            m_size.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool UserTable::evict(const EntryPtr& entry, std::int64_t idleSince)
+{
+    {
+        // Проверка и удаление - под мьютексом, под которым списывает charge: списание либо
+        // успело попасть в pending (и запись остается до следующей синхронизации), либо
+        // уже не найдет запись и пойдет в базу.
+        auto& shard = idShard(entry->id);
+        std::lock_guard lock(shard.mutex);
+        if (entry->lastUsed.load(std::memory_order_relaxed) >= idleSince
+            || entry->pending.load(std::memory_order_relaxed) != 0) {
+            return false;
+        }
+        const auto found = shard.entries.find(entry->id);
+        if (found == shard.entries.end() || found->second != entry) {
+            return false;
+        }
+        shard.entries.erase(found);
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+    }
+    // Вход, пока запись еще есть в шарде логинов, найдет ее, но списать с нее уже не сможет.
+    eraseLogin(entry);
+
+    return true;
+}
+
+void UserTable::eraseLogin(const EntryPtr& entry)
+{
+    auto& shard = loginShard(entry->login);
+    std::lock_guard lock(shard.mutex);
+    if (const auto found = shard.entries.find(entry->login);
+        found != shard.entries.end() && found->second == entry) {
+        shard.entries.erase(found);
+    }
+}
+
+UserTable::Shard<std::string_view>& UserTable::loginShard(std::string_view login)
+{
+    return m_byLogin[std::hash<std::string_view>{}(login) % shardCount];
+}
+
+UserTable::Shard<std::int64_t>& UserTable::idShard(std::int64_t id)
+{
+    return m_byID[static_cast<std::uint64_t>(id) % shardCount];
+}
+
+std::int64_t UserTable::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
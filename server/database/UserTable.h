@@ -0,0 +1,135 @@
+#ifndef SERVER_USERTABLE_H
+#define SERVER_USERTABLE_H
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/awaitable.hpp>
+
+/// Кэш таблицы users в памяти процесса.
+/// Хранит учетные данные и баланс вошедших пользователей, так что повторный вход не ходит
+/// в базу, а списания выполняются атомарным уменьшением счетчика в памяти. Накопленные
+/// списания периодически одним запросом пишутся в users, а в ответ приходят актуальные
+/// баланс и пароль всех закэшированных пользователей - так кэш узнает об изменениях,
+/// сделанных в базе в обход сервера (с задержкой не больше периода синхронизации).
+///
+/// Кэш рассчитан на то, что списывает с users только этот процесс. Если баланс в базе
+/// уменьшили в обход него (другой экземпляр сервера, ручная правка), списания успеют пройти
+/// по устаревшему балансу: база их не примет (баланс в ней не уходит ниже нуля), а кэш после
+/// синхронизации выровняется по базе. Такие списания теряются и пишутся в журнал.
+class UserTable {
+
+public:
+    /// Данные пользователя, нужные при входе.
+    struct Credentials {
+        std::int64_t id;
+        std::int32_t balance;
+    };
+
+    /// Строка users, которую возвращает синхронизация.
+    struct Snapshot {
+        std::int64_t id;
+        std::int32_t balance;
+        std::string  password;
+    };
+
+    enum class ChargeStatus : uint8_t { charged = 0, insufficientFunds, unknownUser };
+
+    /// Запрос синхронизации к базе: списывает charges с пользователей ids и возвращает их
+    /// актуальные строки users (nullopt - база недоступна). В сервере это
+    /// PostgreSQLDatabase::syncUsers.
+    using SyncUsers = std::function<boost::asio::awaitable<std::optional<std::vector<Snapshot>>>(
+            boost::asio::io_context& context,
+            const std::vector<std::int64_t>& ids,
+            const std::vector<std::int32_t>& charges)>;
+
+    /// Параметризированный конструктор класса.
+    explicit UserTable(boost::asio::io_context& context,
+                       SyncUsers syncUsers,
+                       std::size_t capacity,
+                       std::chrono::milliseconds syncInterval,
+                       std::chrono::seconds idleTimeout);
+
+    /// Явно запрещаем любое копирование данных.
+    UserTable(const UserTable& other) = delete;
+    UserTable& operator=(const UserTable& other) = delete;
+
+    /// Ищет пользователя по логину и паролю. Промах (в том числе неверный пароль) означает,
+    /// что нужно спросить базу данных.
+    std::optional<Credentials> find(std::string_view login, std::string_view password);
+    /// Запоминает пользователя после успешного входа через базу данных.
+    void store(std::string_view login, std::string_view password, std::int64_t id, std::int32_t balance);
+    /// Атомарно списывает amount с баланса, если его хватает. balance - баланс после списания.
+    /// unknownUser - пользователя нет в кэше (в том числе его только что вытеснили), списывать
+    /// нужно через базу.
+    ChargeStatus charge(std::int64_t id, std::int32_t amount, std::int32_t& balance);
+
+    /// Запускает фоновую синхронизацию с базой.
+    void start();
+    /// Пишет в базу оставшиеся списания и вызывает обработчик по завершении.
+    void stop(std::function<void()> onStopped);
+
+private:
+    struct Entry {
+        std::int64_t              id;
+        std::string               login;
+        std::string               password; //!< Защищен мьютексом шарда логинов.
+        std::atomic<std::int32_t> balance;  //!< Баланс с учетом еще не записанных списаний.
+        std::atomic<std::int32_t> pending;  //!< Списания, которые еще не записаны в базу.
+        std::int32_t              known;    //!< Баланс в базе по последней синхронизации (только sync).
+        std::atomic<std::int64_t> lastUsed; //!< Время последнего обращения (steady_clock, нс).
+    };
+
+    using EntryPtr = std::shared_ptr<Entry>;
+
+    template <typename Key>
+    struct alignas(64) Shard {
+        std::mutex                         mutex;
+        std::unordered_map<Key, EntryPtr>  entries;
+    };
+
+    static constexpr std::size_t shardCount = 16;
+
+    Shard<std::string_view>& loginShard(std::string_view login);
+    Shard<std::int64_t>&     idShard(std::int64_t id);
+
+    boost::asio::awaitable<void> syncLoop();
+    /// Пишет накопленные списания и обновляет кэш. Возвращает false при ошибке базы.
+    boost::asio::awaitable<bool> sync();
+    void erase(const EntryPtr& entry);
+    /// Вытесняет запись, если она простаивает с idleSince и незаписанных списаний у нее нет.
+    bool evict(const EntryPtr& entry, std::int64_t idleSince);
+    void eraseLogin(const EntryPtr& entry);
+
+    static std::int64_t now();
+
+private:
+    boost::asio::io_context&  mr_context; //!< Контекст фоновой корутины.
+    const SyncUsers           m_syncUsers; //!< Запрос синхронизации к базе.
+    boost::asio::steady_timer m_timer;    //!< Таймер периодической синхронизации.
+
+    /// Ключ - представление Entry::login самой записи, поэтому поиск по логину не выделяет память.
+    std::unique_ptr<Shard<std::string_view>[]> m_byLogin; //!< Логин -> пользователь.
+    std::unique_ptr<Shard<std::int64_t>[]>     m_byID;    //!< Идентификатор -> пользователь.
+    std::atomic<std::size_t>                   m_size {0};
+
+    bool                  m_stopping = false;
+    std::function<void()> m_onStopped;
+
+    const std::size_t               m_capacity;     //!< Максимум пользователей в кэше.
+    const std::chrono::milliseconds m_syncInterval; //!< Период синхронизации с базой.
+    const std::chrono::seconds      m_idleTimeout;  //!< Через сколько вытеснять неактивных.
+};
+
+#endif //SERVER_USERTABLE_H
@@ -1,29 +1,151 @@
-
-#define BOOST_COROUTINES_NO_DEPRECATION_WARNING 0;
+#include <thread>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <algorithm>
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/post.hpp>
 
 #include "Server.h"
+#include "AdmissionController.h"
+#include "SessionRegistry.h"
+#include "ComputePool.h"
+#include "Calculator.h"
+#include "EmbeddedStorage.h"
 #include "PostgreSQLDatabase.h"
+#include "Logger.h"
+#include "TraceWriter.h"
+#include "Metrics.h"
+#include "MetricsServer.h"
+#include "Settings.h"
 #include "config.h"
 
 int main(int argc, char* argv[])
 {
     try {
-        // Создаем очередь задач.
-        boost::asio::io_context context;
+        // Настройки из файла, заданного первым аргументом (или из server.ini, если он есть).
+        const auto settings = config::Settings::load(argc > 1 ? argv[1] : config::settingsFile, argc > 1);
+        // Количество шардов: по одному потоку, очереди задач и серверу на каждый.
+        const auto threadCount = settings.net.threads != 0
+                ? settings.net.threads
+                : std::max(1u, std::thread::hardware_concurrency());
         // Необходимы для создания точки доступа.
-        auto address = boost::asio::ip::address::from_string(config::net::address);
-        auto port    = config::net::port;
+        auto address = boost::asio::ip::address::from_string(settings.net.address);
+        auto port    = settings.net.port;
         // Создаем точку доступа по заданным через консоль адресу и порту.
         boost::asio::ip::tcp::endpoint endpoint(address, port);
-        // Создаем базу данных.
-        PostgreSQLDatabase database(context, config::db::constring);
-        // Создаем сервер.
-        Server localServer(context, database, endpoint);
-        // Запускам сервер.
-        localServer.run();
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+        std::clog << "Транспорт: io_uring" << std::endl;
+#else
+        std::clog << "Транспорт: epoll" << std::endl;
+#endif
+        // Создаем очереди задач. Каждую очередь крутит ровно один поток,
+        // поэтому соединениям внутри шарда не нужны ни strand-ы, ни мьютексы.
+        std::vector<std::unique_ptr<boost::asio::io_context>> contexts;
+        for (unsigned int i = 0; i < threadCount; ++i) {
+            contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+        }
+        // Журнал сообщений общий для всех шардов: запись в него не ждет ни файла, ни других потоков.
+        Logger logger(settings.log.file, settings.log.level, config::log::ringCapacity,
+                      config::log::maxPerSecond, config::log::flushInterval, config::log::dedupWindow);
+        // Метрики общие для всех шардов. Отдает их отдельный сервер в первом шарде.
+        Metrics metrics(threadCount);
+        std::unique_ptr<MetricsServer> metricsServer;
+        if constexpr (config::metrics::enabled) {
+            const boost::asio::ip::tcp::endpoint metricsEndpoint(
+                    boost::asio::ip::address::from_string(config::metrics::address), config::metrics::port);
+            metricsServer = std::make_unique<MetricsServer>(*contexts.front(), metrics, metricsEndpoint,
+                                                            config::metrics::requestTimeout);
+        }
+        // Создаем хранилище. Оно общее и потокобезопасное, поэтому одного экземпляра
+        // хватает на все шарды. Фоновые задачи базы данных живут в первом шарде.
+        std::unique_ptr<Storage> storage;
+        if constexpr (config::storage::backend == config::storage::Backend::embedded) {
+            namespace embedded = config::storage::embedded;
+            storage = std::make_unique<EmbeddedStorage>(embedded::usersFile, embedded::sessionLog,
+                                                        embedded::maxLogSize, embedded::logGrowStep,
+                                                        embedded::syncInterval, embedded::waitForSync, logger);
+        } else {
+            auto database = std::make_unique<PostgreSQLDatabase>(*contexts.front(), settings.db, metrics, logger);
+            // Пул прогреваем до того, как акцепторы начнут принимать клиентов.
+            const auto ready = database->prewarm(*contexts.front());
+            std::clog << "Соединений с базой данных готово: " << ready << " из " << settings.db.poolMinSize
+                      << std::endl;
+            storage = std::move(database);
+        }
+        // Создаем калькулятор с общим для всех шардов кэшем результатов.
+        Calculator calculator(config::calc::cacheCapacity, config::calc::cacheShards,
+                              config::calc::maxBatchSize, config::calc::maxExpressionLength,
+                              config::calc::maxNestingDepth);
+        metrics.setCacheStats([&calculator]() {
+            const auto stats = calculator.cacheStats();
+            return Metrics::CacheStats {stats.hits, stats.misses};
+        });
+        // Выражения считаются в отдельном пуле потоков, чтобы потоки шардов занимались только вводом-выводом.
+        ComputePool compute(config::calc::computeThreads);
+        // Ограничение одновременных операций с хранилищем - тоже одно на все шарды.
+        AdmissionController admission(settings.admission.maxInFlight, settings.admission.maxQueued,
+                                      settings.admission.queueTimeout);
+        // Сессии пользователей тоже общие: пользователь может войти через соединения разных шардов.
+        SessionRegistry sessions(settings.net.maxSessionsPerUser);
+        // Трасса трафика пишется, только если для нее задан файл.
+        std::unique_ptr<TraceWriter> trace;
+        if (!settings.trace.file.empty()) {
+            trace = std::make_unique<TraceWriter>(settings.trace.file, config::trace::flushSize,
+                                                  config::trace::maxBuffered, config::trace::flushInterval,
+                                                  logger);
+            std::clog << "Трасса трафика пишется в " << settings.trace.file << std::endl;
+        }
+        // Создаем серверы.
+        const Connection::Timeouts timeouts {settings.net.handshakeTimeout, settings.net.idleTimeout,
+                                             settings.net.writeTimeout};
+        std::vector<std::unique_ptr<Server>> servers;
+        for (auto& context : contexts) {
+            servers.push_back(std::make_unique<Server>(*context, *storage, calculator, endpoint,
+                                                       config::net::connectionsPerChunk, timeouts,
+                                                       admission, sessions, compute, metrics,
+                                                       trace.get()));
+        }
+        // По сигналу останавливаем прием соединений, сбрасываем отложенные записи в базу
+        // и только после этого гасим очереди задач.
+        boost::asio::signal_set signals(*contexts.front(), SIGINT, SIGTERM);
+        signals.async_wait([&](const boost::system::error_code& errorCode, int) {
+            if (errorCode) return;
+
+            for (std::size_t i = 0; i < servers.size(); ++i) {
+                boost::asio::post(*contexts[i], [&server = *servers[i]]() { server.stop(); });
+            }
+            // Обработчик сигнала выполняется в первом шарде, там же, где и сервер метрик.
+            if (metricsServer) {
+                metricsServer->stop();
+            }
+
+            storage->stop([&contexts]() {
+                for (auto& context : contexts) {
+                    context->stop();
+                }
+            });
+        });
+        // Запускаем все шарды, кроме первого, в отдельных потоках.
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < threadCount; ++i) {
+            threads.emplace_back([&server = *servers[i]]() {
+                try {
+                    server.run();
+                } catch (const std::exception& exc) {
+                    std::cerr << exc.what() << std::endl;
+                }
+            });
+        }
+        // Первый шард крутится в главном потоке.
+        servers.front()->run();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
     } catch (const std::exception& exc) {
         std::cerr << exc.what() << std::endl;
         return EXIT_FAILURE;
@@ -0,0 +1,157 @@
+#include "Metrics.h"
+
+#include <bit>
+#include <iterator>
+#include <algorithm>
+#include <charconv>
+
+namespace {
+    constexpr const char* stageNames[] = {"read", "validate", "evaluate", "auth", "charge", "history", "write"};
+    constexpr const char* errorNames[] = {"bad_request", "bad_expression", "auth_failed",
+                                          "insufficient_funds", "busy", "storage", "database", "socket",
+                                          "session_limit"};
+    constexpr const char* timeoutNames[] = {"handshake", "idle", "write"};
+
+    static_assert(std::size(stageNames) == static_cast<std::size_t>(Metrics::Stage::count));
+    static_assert(std::size(errorNames) == static_cast<std::size_t>(Metrics::Error::count));
+    static_assert(std::size(timeoutNames) == static_cast<std::size_t>(Metrics::Timeout::count));
+
+    void appendNumber(std::string& output, const double value)
+    {
+        std::array<char, 32> buffer;
+        const auto [end, error] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+        output.append(buffer.data(), end);
+    }
+
+    /// Дописывает гистограмму name{labels} в формате Prometheus (бакеты накопленные).
+    void appendHistogram(std::string& output, const std::string& name, const std::string& labels,
+                         const LatencyHistogram& histogram)
+    {
+        const auto snapshot  = histogram.snapshot();
+        const auto separator = labels.empty() ? "" : ",";
+
+        std::uint64_t cumulative = 0;
+        for (std::size_t i = 0; i < LatencyHistogram::bucketCount; ++i) {
+            cumulative += snapshot.buckets[i];
+            output += name + "_bucket{" + labels + separator + "le=\"";
+            appendNumber(output, LatencyHistogram::bound(i));
+            output += "\"} " + std::to_string(cumulative) + '\n';
+        }
+        output += name + "_bucket{" + labels + separator + "le=\"+Inf\"} " + std::to_string(snapshot.count) + '\n';
+
+        const auto braces = labels.empty() ? std::string() : '{' + labels + '}';
+        output += name + "_sum" + braces + ' ';
+        appendNumber(output, static_cast<double>(snapshot.nanoseconds) / 1e9);
+        output += '\n';
+        output += name + "_count" + braces + ' ' + std::to_string(snapshot.count) + '\n';
+    }
+}
+
+std::int64_t Counter::value() const
+{
+    std::int64_t sum = 0;
+    for (std::size_t i = 0; i < m_stripeCount; ++i) {
+        sum += m_stripes[i].value.load(std::memory_order_relaxed);
+    }
+
+    return sum;
+}
+
+void LatencyHistogram::record(const std::chrono::nanoseconds latency)
+{
+    const auto nanoseconds  = static_cast<std::uint64_t>(std::max<std::int64_t>(latency.count(), 0));
+    // Корзина i хранит значения до 2^i мкс включительно.
+    const auto microseconds = (nanoseconds + 999) / 1000;
+    const auto index        = std::min<std::size_t>(microseconds <= 1 ? 0 : std::bit_width(microseconds - 1),
+                                                    bucketCount);
+
+    auto& stripe = m_stripes[currentStripe() % m_stripeCount];
+    stripe.buckets[index].fetch_add(1, std::memory_order_relaxed);
+    stripe.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot snapshot;
+    for (std::size_t stripeIndex = 0; stripeIndex < m_stripeCount; ++stripeIndex) {
+        const auto& stripe = m_stripes[stripeIndex];
+        for (std::size_t i = 0; i <= bucketCount; ++i) {
+            const auto count = stripe.buckets[i].load(std::memory_order_relaxed);
+            snapshot.buckets[i] += count;
+            snapshot.count      += count;
+        }
+        snapshot.nanoseconds += stripe.nanoseconds.load(std::memory_order_relaxed);
+    }
+
+    return snapshot;
+}
+
+Metrics::Metrics(std::size_t stripeCount)
+                 : m_poolWait(stripeCount)
+                 , m_connections(stripeCount)
+                 , m_inFlight(stripeCount)
+{
+    m_stages.reserve(static_cast<std::size_t>(Stage::count));
+    for (std::size_t i = 0; i < static_cast<std::size_t>(Stage::count); ++i) {
+        m_stages.emplace_back(stripeCount);
+    }
+    m_errors.reserve(static_cast<std::size_t>(Error::count));
+    for (std::size_t i = 0; i < static_cast<std::size_t>(Error::count); ++i) {
+        m_errors.emplace_back(stripeCount);
+    }
+    m_timeouts.reserve(static_cast<std::size_t>(Timeout::count));
+    for (std::size_t i = 0; i < static_cast<std::size_t>(Timeout::count); ++i) {
+        m_timeouts.emplace_back(stripeCount);
+    }
+}
+
+std::string Metrics::render() const
+{
+    std::string output;
+    output.reserve(16 * 1024);
+
+    output += "# HELP calc_stage_duration_seconds Duration of request handling stages.\n"
+              "# TYPE calc_stage_duration_seconds histogram\n";
+    for (std::size_t i = 0; i < m_stages.size(); ++i) {
+        appendHistogram(output, "calc_stage_duration_seconds", std::string("stage=\"") + stageNames[i] + '"',
+                        m_stages[i]);
+    }
+
+    output += "# HELP calc_db_pool_wait_seconds Time spent waiting for a database connection from the pool.\n"
+              "# TYPE calc_db_pool_wait_seconds histogram\n";
+    appendHistogram(output, "calc_db_pool_wait_seconds", "", m_poolWait);
+
+    output += "# HELP calc_connections Open client connections.\n"
+              "# TYPE calc_connections gauge\n"
+              "calc_connections " + std::to_string(m_connections.value()) + '\n';
+
+    output += "# HELP calc_requests_in_flight Requests being handled right now.\n"
+              "# TYPE calc_requests_in_flight gauge\n"
+              "calc_requests_in_flight " + std::to_string(m_inFlight.value()) + '\n';
+
+    output += "# HELP calc_errors_total Failed requests by reason.\n"
+              "# TYPE calc_errors_total counter\n";
+    for (std::size_t i = 0; i < m_errors.size(); ++i) {
+        output += std::string("calc_errors_total{kind=\"") + errorNames[i] + "\"} "
+                + std::to_string(m_errors[i].value()) + '\n';
+    }
+
+    output += "# HELP calc_connection_timeouts_total Connections closed by the server on a timeout.\n"
+              "# TYPE calc_connection_timeouts_total counter\n";
+    for (std::size_t i = 0; i < m_timeouts.size(); ++i) {
+        output += std::string("calc_connection_timeouts_total{kind=\"") + timeoutNames[i] + "\"} "
+                + std::to_string(m_timeouts[i].value()) + '\n';
+    }
+
+    if (m_cacheStats) {
+        const auto cache = m_cacheStats();
+        output += "# HELP calc_expression_cache_hits_total Expressions answered from the result cache.\n"
+                  "# TYPE calc_expression_cache_hits_total counter\n"
+                  "calc_expression_cache_hits_total " + std::to_string(cache.hits) + '\n';
+        output += "# HELP calc_expression_cache_misses_total Cacheable expressions that had to be evaluated.\n"
+                  "# TYPE calc_expression_cache_misses_total counter\n"
+                  "calc_expression_cache_misses_total " + std::to_string(cache.misses) + '\n';
+    }
+
+    return output;
+}
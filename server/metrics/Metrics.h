@@ -0,0 +1,164 @@
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+/// Номер текущего потока среди потоков, писавших в метрики. Назначается при первой записи,
+/// по порядку. Пишут в метрики только потоки шардов, поэтому при числе полос, равном числу
+/// шардов (см. Metrics), у каждого шарда своя полоса - отдельная кэш-линия каждого счетчика,
+/// а запись - один relaxed fetch_add. Если писателей окажется больше, лишние делят полосы.
+inline std::size_t currentStripe()
+{
+    static std::atomic<std::size_t> next {0};
+    thread_local const std::size_t stripe = next.fetch_add(1, std::memory_order_relaxed);
+    return stripe;
+}
+
+/// Счетчик (или, если его и уменьшать, - текущее значение) без блокировок.
+class Counter {
+
+public:
+    explicit Counter(std::size_t stripeCount)
+                     : m_stripeCount(std::max<std::size_t>(stripeCount, 1))
+                     , m_stripes(std::make_unique<Stripe[]>(m_stripeCount)) {}
+
+    void add(std::int64_t value = 1)
+    {
+        m_stripes[currentStripe() % m_stripeCount].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /// Сумма по всем полосам. Читается без остановки писателей, поэтому значение
+    /// согласовано только приблизительно - для метрик этого достаточно.
+    std::int64_t value() const;
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<std::int64_t> value {0};
+    };
+
+    std::size_t               m_stripeCount;
+    std::unique_ptr<Stripe[]> m_stripes;
+};
+
+/// Гистограмма задержек без блокировок. Границы корзин - степени двойки микросекунд
+/// (1 мкс ... ~33 с) и +Inf, как бакеты гистограммы Prometheus.
+class LatencyHistogram {
+
+public:
+    static constexpr std::size_t bucketCount = 26; //!< Корзин с конечной границей.
+
+    struct Snapshot {
+        std::array<std::uint64_t, bucketCount + 1> buckets {}; //!< Не накопленные, последняя - +Inf.
+        std::uint64_t count       = 0;
+        std::uint64_t nanoseconds = 0; //!< Сумма всех значений.
+    };
+
+    explicit LatencyHistogram(std::size_t stripeCount)
+                              : m_stripeCount(std::max<std::size_t>(stripeCount, 1))
+                              , m_stripes(std::make_unique<Stripe[]>(m_stripeCount)) {}
+
+    void record(std::chrono::nanoseconds latency);
+    Snapshot snapshot() const;
+
+    /// Верхняя граница корзины index в секундах.
+    static double bound(std::size_t index) { return static_cast<double>(std::uint64_t {1} << index) / 1e6; }
+
+private:
+    struct alignas(64) Stripe {
+        std::array<std::atomic<std::uint64_t>, bucketCount + 1> buckets {};
+        std::atomic<std::uint64_t>                           nanoseconds {0};
+    };
+
+    std::size_t               m_stripeCount;
+    std::unique_ptr<Stripe[]> m_stripes;
+};
+
+/// Метрики сервера: задержки этапов обработки команды, соединения, ожидание пула базы данных
+/// и ошибки. Один экземпляр на процесс, пишут в него все шарды; отдает их MetricsServer.
+class Metrics {
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Этапы обработки команды.
+    enum class Stage : std::uint8_t {
+        read = 0,  //!< Дочитывание команды, пришедшей по частям.
+        validate,  //!< isValidRequest.
+        evaluate,  //!< Вычисление выражения (или пакета).
+        auth,      //!< Проверка логина и пароля в хранилище.
+        charge,    //!< Списание и запись результата в хранилище.
+        history,   //!< Чтение страницы истории из хранилища.
+        write,     //!< Отправка ответов.
+        count
+    };
+
+    enum class Error : std::uint8_t {
+        badRequest = 0,    //!< Некорректная или слишком длинная команда.
+        badExpression,     //!< Некорректное выражение.
+        authFailed,        //!< Неверный логин или пароль.
+        insufficientFunds, //!< Недостаточно средств.
+        busy,              //!< Отказ из-за перегрузки (AdmissionController).
+        storage,           //!< Хранилище не смогло выполнить запрос.
+        database,          //!< Ошибка запроса к базе данных.
+        socket,            //!< Ошибка чтения или записи сокета (кроме закрытия клиентом).
+        sessionLimit,      //!< Вход сверх net.max_sessions_per_user.
+        count
+    };
+
+    /// Сроки, по истечении которых сервер закрывает соединение.
+    enum class Timeout : std::uint8_t {
+        handshake = 0, //!< Клиент не вошел вовремя.
+        idle,          //!< Клиент слишком долго не присылал команду.
+        write,         //!< Клиент слишком долго не забирал ответ.
+        count
+    };
+
+    /// Счетчики кэша выражений. Их ведет сам кэш, метрики только читают их при выдаче.
+    struct CacheStats {
+        std::uint64_t hits;
+        std::uint64_t misses;
+    };
+
+    /// stripeCount - сколько полос у каждого счетчика: по одной на поток шарда.
+    explicit Metrics(std::size_t stripeCount);
+    Metrics(const Metrics& other) = delete;
+    Metrics& operator=(const Metrics& other) = delete;
+
+    /// Записывает длительность этапа, начавшегося в started.
+    void record(Stage stage, Clock::time_point started)
+    {
+        m_stages[static_cast<std::size_t>(stage)].record(Clock::now() - started);
+    }
+    void record(Error error) { m_errors[static_cast<std::size_t>(error)].add(); }
+    void record(Timeout timeout) { m_timeouts[static_cast<std::size_t>(timeout)].add(); }
+
+    LatencyHistogram& poolWait()    { return m_poolWait; }    //!< Ожидание соединения из пула базы.
+    Counter&          connections() { return m_connections; } //!< Открытые соединения.
+    Counter&          inFlight()    { return m_inFlight; }    //!< Команды, обрабатываемые прямо сейчас.
+
+    /// Откуда брать счетчики кэша выражений. Задается до запуска шардов (до первого render).
+    void setCacheStats(std::function<CacheStats()> source) { m_cacheStats = std::move(source); }
+
+    /// Все метрики в текстовом формате Prometheus.
+    std::string render() const;
+
+private:
+    std::vector<LatencyHistogram> m_stages;   //!< По этапам (Stage).
+    std::vector<Counter>          m_errors;   //!< По причинам (Error).
+    std::vector<Counter>          m_timeouts; //!< По срокам (Timeout).
+    LatencyHistogram m_poolWait;
+    Counter          m_connections;
+    Counter          m_inFlight;
+
+    std::function<CacheStats()> m_cacheStats; //!< Пусто - кэш выражений не выдается.
+};
+
+#endif //SERVER_METRICS_H
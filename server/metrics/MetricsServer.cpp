@@ -0,0 +1,83 @@
+#include "MetricsServer.h"
+
+#include <string>
+#include <iostream>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+
+#include "Metrics.h"
+
+MetricsServer::MetricsServer(boost::asio::io_context& context,
+                             const Metrics& metrics,
+                             const boost::asio::ip::tcp::endpoint& endpoint,
+                             std::chrono::milliseconds requestTimeout)
+                             : mr_context(context)
+                             , m_acceptor(context, endpoint)
+                             , mr_metrics(metrics)
+                             , m_requestTimeout(requestTimeout)
+{
+    std::clog << "Метрики: http://" << endpoint << "/metrics" << std::endl;
+    boost::asio::co_spawn(mr_context, accept(), boost::asio::detached);
+}
+
+void MetricsServer::stop()
+{
+    boost::system::error_code errorCode;
+    m_acceptor.close(errorCode);
+}
+
+boost::asio::awaitable<void> MetricsServer::accept()
+{
+    boost::system::error_code errorCode;
+
+    while (true) {
+        boost::asio::ip::tcp::socket socket(mr_context);
+        co_await m_acceptor.async_accept(socket, boost::asio::redirect_error(boost::asio::use_awaitable, errorCode));
+        if (errorCode) co_return;
+
+        boost::asio::co_spawn(mr_context, respond(std::move(socket)), boost::asio::detached);
+    }
+}
+
+boost::asio::awaitable<void> MetricsServer::respond(boost::asio::ip::tcp::socket socket)
+{
+    boost::system::error_code errorCode;
+    auto awaitInto = boost::asio::redirect_error(boost::asio::use_awaitable, errorCode);
+
+    // По истечении срока закрываем сокет: ожидающее чтение или запись завершится ошибкой.
+    // Таймер отменяется при выходе из корутины, и тогда обработчик сокет не трогает.
+    boost::asio::steady_timer deadline(mr_context, m_requestTimeout);
+    deadline.async_wait([&socket](const boost::system::error_code& timerError) {
+        if (timerError) return;
+        boost::system::error_code ignored;
+        socket.close(ignored);
+    });
+
+    // Читаем заголовки запроса целиком, но не больше maxRequestSize.
+    std::string request;
+    co_await boost::asio::async_read_until(socket, boost::asio::dynamic_buffer(request, maxRequestSize),
+                                           "\r\n\r\n", awaitInto);
+    if (errorCode) co_return;
+
+    std::string response;
+    if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET / ", 0) == 0) {
+        const auto body = mr_metrics.render();
+        response = "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                   "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                   "Connection: close\r\n\r\n" + body;
+    } else {
+        response = "HTTP/1.1 404 Not Found\r\n"
+                   "Content-Length: 0\r\n"
+                   "Connection: close\r\n\r\n";
+    }
+
+    co_await boost::asio::async_write(socket, boost::asio::buffer(response), awaitInto);
+    socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, errorCode);
+}
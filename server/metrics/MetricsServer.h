@@ -0,0 +1,44 @@
+#ifndef SERVER_METRICSSERVER_H
+#define SERVER_METRICSSERVER_H
+
+#include <chrono>
+#include <utility>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/awaitable.hpp>
+
+class Metrics;
+
+/// Отдает метрики в текстовом формате Prometheus по HTTP (GET /metrics) на отдельном порту.
+/// Запросы редкие (раз в несколько секунд), поэтому каждый обслуживается целиком
+/// и соединение сразу закрывается. Клиент, не уложившийся в requestTimeout, отключается.
+class MetricsServer {
+
+public:
+    explicit MetricsServer(boost::asio::io_context& context,
+                           const Metrics& metrics,
+                           const boost::asio::ip::tcp::endpoint& endpoint,
+                           std::chrono::milliseconds requestTimeout);
+
+    /// Явно запрещаем любое копирование данных.
+    MetricsServer(const MetricsServer& other) = delete;
+    MetricsServer& operator=(const MetricsServer& other) = delete;
+
+    /// Прекращает прием соединений.
+    void stop();
+
+private:
+    boost::asio::awaitable<void> accept();
+    boost::asio::awaitable<void> respond(boost::asio::ip::tcp::socket socket);
+
+    static constexpr std::size_t maxRequestSize = 8 * 1024;
+
+private:
+    boost::asio::io_context&       mr_context;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    const Metrics&                 mr_metrics;
+    const std::chrono::milliseconds m_requestTimeout;
+};
+
+#endif //SERVER_METRICSSERVER_H
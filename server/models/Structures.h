@@ -14,7 +14,7 @@ struct User {
     (std::string , login               ),
     (std::string , password            ),
     (std::string , expression          ),
-    (float       , resultOfExpression ));
+    (double      , resultOfExpression ));
 };
 
 #endif //SERVER_STRUCTURES_H
@@ -0,0 +1,214 @@
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include <tinyexpr.h>
+
+#include "Program.h"
+
+/// Сверка Program с tinyexpr: случайные выражения считаются скомпилированной программой
+/// (run и runBatch) и te_interp, результаты должны совпадать до бита (или оба быть NaN).
+/// Переменные v0 и v1 для te_interp подставляются в текст числами, записанными без потерь.
+
+namespace {
+    constexpr std::size_t variableCount = 2;
+    constexpr std::size_t batchSize     = 300; //!< Не кратно блоку runBatch: проверяется и хвост.
+
+    std::size_t failures = 0;
+
+    void fail(const std::string& expression, const char* what, double expected, double actual)
+    {
+        if (++failures <= 20) {
+            std::printf("FAIL %s: %s: te_interp = %.17g, Program = %.17g\n",
+                        what, expression.c_str(), expected, actual);
+        }
+    }
+
+    bool same(double left, double right)
+    {
+        return (std::isnan(left) && std::isnan(right)) || left == right;
+    }
+
+    class Generator {
+    public:
+        explicit Generator(unsigned seed) : m_random(seed) {}
+
+        /// Случайное выражение глубиной не больше depth. withVariables - можно ли использовать v0, v1.
+        std::string expression(int depth, bool withVariables)
+        {
+            if (depth == 0 || pick(4) == 0) return leaf(withVariables);
+
+            switch (pick(5)) {
+                case 0: {
+                    static const char* operators[] = {"+", "-", "*", "/", "^", "%"};
+                    return "(" + expression(depth - 1, withVariables) + operators[pick(6)]
+                         + expression(depth - 1, withVariables) + ")";
+                }
+                case 1:
+                    return "-" + expression(depth - 1, withVariables);
+                case 2: {
+                    static const char* functions[] = {"sin", "cos", "tan", "sqrt", "abs", "exp", "ln", "log", "acos"};
+                    return std::string(functions[pick(9)]) + "(" + expression(depth - 1, withVariables) + ")";
+                }
+                case 3: {
+                    static const char* functions[] = {"pow", "atan2"};
+                    return std::string(functions[pick(2)]) + "(" + expression(depth - 1, withVariables) + ","
+                         + expression(depth - 1, withVariables) + ")";
+                }
+                default:
+                    return expression(depth - 1, withVariables) + "*" + expression(depth - 1, withVariables);
+            }
+        }
+
+        double value()
+        {
+            return std::uniform_real_distribution<double>(-4.0, 4.0)(m_random);
+        }
+
+    private:
+        std::size_t pick(std::size_t count) { return m_random() % count; }
+
+        std::string leaf(bool withVariables)
+        {
+            if (withVariables && pick(2) == 0) return "v" + std::to_string(pick(variableCount));
+            if (pick(8) == 0) return pick(2) == 0 ? "pi" : "e";
+
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.3g", value());
+            return text;
+        }
+
+        std::mt19937 m_random;
+    };
+
+    /// Подставляет значения переменных в текст, чтобы посчитать его te_interp.
+    std::string substitute(const std::string& expression, const double* values)
+    {
+        std::string result;
+        for (std::size_t i = 0; i < expression.size(); ++i) {
+            if (expression[i] == 'v' && i + 1 < expression.size()) {
+                char text[40];
+                std::snprintf(text, sizeof(text), "(%.17g)", values[expression[i + 1] - '0']);
+                result.append(text);
+                ++i;
+            } else {
+                result.push_back(expression[i]);
+            }
+        }
+        return result;
+    }
+
+    double interpret(const std::string& expression)
+    {
+        int errorCode = 0;
+        return te_interp(expression.c_str(), &errorCode);
+    }
+
+    /// Выражение без переменных: сворачивается при компиляции целиком.
+    void checkConstant(const std::string& expression)
+    {
+        int errorCode = 0;
+        auto* root = te_compile(expression.c_str(), nullptr, 0, &errorCode);
+        if (!root) {
+            fail(expression, "te_compile", 0, 0);
+            return;
+        }
+
+        Program program;
+        const auto compiled = program.compile(root);
+        te_free(root);
+        if (!compiled) {
+            fail(expression, "compile", 0, 0);
+            return;
+        }
+        if (program.size() != 1) {
+            fail(expression, "constant folding", 1, static_cast<double>(program.size()));
+        }
+
+        const auto expected = interpret(expression);
+        const auto actual   = program.run();
+        if (!same(expected, actual)) fail(expression, "run", expected, actual);
+    }
+
+    /// Выражение с переменными: run на каждом наборе и runBatch на всех сразу.
+    void checkVariables(const std::string& expression, Generator& generator)
+    {
+        double slots[variableCount] = {};
+        const te_variable variables[] = {{"v0", &slots[0], TE_VARIABLE, nullptr},
+                                         {"v1", &slots[1], TE_VARIABLE, nullptr}};
+        int errorCode = 0;
+        auto* root = te_compile(expression.c_str(), variables, variableCount, &errorCode);
+        if (!root) {
+            fail(expression, "te_compile", 0, 0);
+            return;
+        }
+
+        Program program;
+        const auto compiled = program.compile(root, slots, variableCount);
+        te_free(root);
+        if (!compiled) {
+            fail(expression, "compile", 0, 0);
+            return;
+        }
+
+        std::vector<double> columns[variableCount];
+        for (auto& column : columns) {
+            column.resize(batchSize);
+            for (auto& value : column) value = generator.value();
+        }
+        const double* data[variableCount] = {columns[0].data(), columns[1].data()};
+        std::vector<double> results(batchSize);
+        program.runBatch(data, batchSize, results.data());
+
+        for (std::size_t i = 0; i < batchSize; ++i) {
+            const double values[variableCount] = {columns[0][i], columns[1][i]};
+            const auto expected = interpret(substitute(expression, values));
+
+            const auto scalar = program.run(values);
+            if (!same(expected, scalar)) fail(expression, "run", expected, scalar);
+            if (!same(expected, results[i])) fail(expression, "runBatch", expected, results[i]);
+        }
+    }
+}
+
+int main()
+{
+    Generator generator(20240601);
+
+    for (int i = 0; i < 2000; ++i) {
+        checkConstant(generator.expression(1 + i % 8, false));
+    }
+    for (int i = 0; i < 300; ++i) {
+        checkVariables(generator.expression(1 + i % 8, true), generator);
+    }
+
+    // Глубокая правая вложенность: регистров больше, чем помещается на стеке (64).
+    std::string deep = "v0";
+    for (int i = 0; i < 100; ++i) {
+        deep = (i % 2 == 0 ? "v1-(" : "v0*0.5+(") + deep + ")";
+    }
+    {
+        double slots[variableCount] = {};
+        const te_variable variables[] = {{"v0", &slots[0], TE_VARIABLE, nullptr},
+                                         {"v1", &slots[1], TE_VARIABLE, nullptr}};
+        int errorCode = 0;
+        auto* root = te_compile(deep.c_str(), variables, variableCount, &errorCode);
+        Program program;
+        if (!root || !program.compile(root, slots, variableCount) || program.registerCount() <= 64) {
+            std::printf("FAIL deep expression does not reach the register spill path\n");
+            ++failures;
+        }
+        te_free(root);
+    }
+    checkVariables(deep, generator);
+
+    if (failures != 0) {
+        std::printf("%zu mismatches\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("OK\n");
+    return EXIT_SUCCESS;
+}
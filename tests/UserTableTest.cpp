@@ -0,0 +1,136 @@
+#include <utility>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+
+#include <boost/asio/io_context.hpp>
+
+#include "UserTable.h"
+
+/// Списания из кэша пользователей не теряются при вытеснении: соединения списывают с нескольких
+/// пользователей, а синхронизация каждые несколько миллисекунд вытесняет всех (idleTimeout = 0).
+/// Списание, не нашедшее пользователя, идет "в базу" напрямую, а вошедший заново пользователь
+/// снова попадает в кэш. В конце в базу должно быть записано ровно столько, сколько списано.
+
+namespace {
+    constexpr std::int64_t  userCount     = 4;
+    constexpr std::int32_t  startBalance  = 1'000'000'000;
+    constexpr int           chargerCount  = 4;
+    constexpr auto          testDuration  = std::chrono::milliseconds(1500);
+
+    /// База в памяти: баланс каждого пользователя.
+    class FakeDatabase {
+    public:
+        FakeDatabase()
+        {
+            for (std::int64_t id = 0; id < userCount; ++id) m_balances[id] = startBalance;
+        }
+
+        /// Списание мимо кэша (как calc_charge).
+        std::int32_t charge(std::int64_t id)
+        {
+            std::lock_guard lock(m_mutex);
+            return --m_balances[id];
+        }
+
+        std::int32_t balance(std::int64_t id)
+        {
+            std::lock_guard lock(m_mutex);
+            return m_balances[id];
+        }
+
+        boost::asio::awaitable<std::optional<std::vector<UserTable::Snapshot>>> syncUsers(
+                const std::vector<std::int64_t>& ids, const std::vector<std::int32_t>& charges)
+        {
+            std::vector<UserTable::Snapshot> rows;
+            std::lock_guard lock(m_mutex);
+            for (std::size_t i = 0; i < ids.size(); ++i) {
+                m_balances[ids[i]] -= charges[i];
+                rows.push_back({ids[i], m_balances[ids[i]], password(ids[i])});
+            }
+            co_return rows;
+        }
+
+        static std::string login(std::int64_t id) { return "user" + std::to_string(id); }
+        static std::string password(std::int64_t id) { return "password" + std::to_string(id); }
+
+    private:
+        std::mutex                                     m_mutex;
+        std::unordered_map<std::int64_t, std::int32_t> m_balances;
+    };
+}
+
+int main()
+{
+    FakeDatabase database;
+    boost::asio::io_context context;
+    UserTable table(context,
+                    [&database](boost::asio::io_context&, const std::vector<std::int64_t>& ids,
+                                const std::vector<std::int32_t>& charges) {
+                        return database.syncUsers(ids, charges);
+                    },
+                    1024, std::chrono::milliseconds(1), std::chrono::seconds(0));
+    table.start();
+    std::thread syncThread([&context]() { context.run(); });
+
+    std::atomic<bool>         running {true};
+    std::atomic<std::int64_t> charged {0};
+    std::atomic<std::int64_t> evictions {0};
+    std::vector<std::thread>  chargers;
+    for (int i = 0; i < chargerCount; ++i) {
+        chargers.emplace_back([&, i]() {
+            for (std::int64_t n = i; running.load(std::memory_order_relaxed); ++n) {
+                const auto id = n % userCount;
+                std::int32_t balance = 0;
+                switch (table.charge(id, 1, balance)) {
+                    case UserTable::ChargeStatus::charged:
+                        charged.fetch_add(1, std::memory_order_relaxed);
+                        break;
+                    case UserTable::ChargeStatus::unknownUser:
+                        // Вытеснен: списываем через базу и входим заново, как PostgreSQLDatabase.
+                        database.charge(id);
+                        evictions.fetch_add(1, std::memory_order_relaxed);
+                        table.store(FakeDatabase::login(id), FakeDatabase::password(id), id, database.balance(id));
+                        break;
+                    case UserTable::ChargeStatus::insufficientFunds:
+                        std::printf("FAIL unexpected insufficient funds\n");
+                        std::exit(EXIT_FAILURE);
+                }
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(testDuration);
+    running = false;
+    for (auto& charger : chargers) charger.join();
+
+    // Остановка пишет в базу все, что осталось в кэше.
+    table.stop([]() {});
+    syncThread.join();
+
+    std::int64_t written = 0;
+    for (std::int64_t id = 0; id < userCount; ++id) {
+        written += startBalance - database.balance(id);
+    }
+    const auto expected = charged.load() + evictions.load();
+    std::printf("charged in cache %lld, through the database %lld, written %lld\n",
+                static_cast<long long>(charged.load()), static_cast<long long>(evictions.load()),
+                static_cast<long long>(written));
+
+    if (evictions.load() == 0) {
+        std::printf("FAIL no evictions happened, the race was not exercised\n");
+        return EXIT_FAILURE;
+    }
+    if (written != expected) {
+        std::printf("FAIL %lld charges lost\n", static_cast<long long>(expected - written));
+        return EXIT_FAILURE;
+    }
+    std::printf("OK\n");
+    return EXIT_SUCCESS;
+}